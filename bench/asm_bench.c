@@ -0,0 +1,222 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <libgen.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include "assemble.c"
+#define main hw5_asm_main
+#include "assembler.c"
+#undef main
+
+// asm_bench: time pass_one, pass_two and a full hw5-asm run on each input,
+// report lines/sec and peak RSS, and optionally compare against a baseline file.
+//
+// Baseline lines look like:  <name> <pass_one l/s> <pass_two l/s> <e2e l/s> <rss KiB>
+
+#define MAX_BENCH 64
+
+typedef struct {
+    char name[MAX_LABEL];
+    long lines;
+    double pass_one;   // lines/sec
+    double pass_two;
+    double e2e;
+    long rss_kb;       // peak RSS of the hw5-asm process
+} BenchResult;
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static long count_lines(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) error_exit("Cannot open input file");
+    long n = 0;
+    int c, last = '\n';
+    while ((c = getc(f)) != EOF) {
+        if (c == '\n') n++;
+        last = c;
+    }
+    if (last != '\n') n++;
+    fclose(f);
+    return n;
+}
+
+// Run hw5-asm as a child; returns wall time and stores its peak RSS
+static double run_assembler(const char *asm_path, const char *input, const char *output, long *rss_kb) {
+    double t0 = now_sec();
+    pid_t pid = fork();
+    if (pid < 0) error_exit("fork failed");
+    if (pid == 0) {
+        execl(asm_path, asm_path, "-Tdata=after", "-m", "64M", input, output, (char *)NULL);
+        _exit(127);
+    }
+    int status;
+    struct rusage ru;
+    if (wait4(pid, &status, 0, &ru) < 0) error_exit("wait failed");
+    double elapsed = now_sec() - t0;
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) error_exit("hw5-asm failed on benchmark input");
+    *rss_kb = ru.ru_maxrss;
+    return elapsed;
+}
+
+static void bench_file(const char *asm_path, const char *input, int runs, BenchResult *res) {
+    char tmp[MAX_LINE];
+    strcpy(tmp, input);
+    snprintf(res->name, sizeof(res->name), "%s", basename(tmp));
+    res->lines = count_lines(input);
+
+    char out[512];
+    snprintf(out, sizeof(out), "%s.bench.tko", input);
+    tmp_out = out;
+
+    uint8_t *src;
+    size_t len;
+    if (load_file(NULL, input, &src, &len) != 0) error_exit("Cannot open input file");
+
+    // Generated programs can be far larger than the default code window
+    AsmOptions opts;
+    asm_default_options(&opts);
+    opts.data_after = true;
+    opts.mem_size = 64 << 20;
+
+    // Best of N: the minimum is the least noisy estimate of the real cost
+    double best_one = 1e30, best_two = 1e30, best_e2e = 1e30;
+    res->rss_kb = 0;
+    for (int r = 0; r < runs; r++) {
+        Asm *as = asm_new(&opts);
+        if (!as) error_exit("Out of memory");
+        if (setjmp(as->fail) != 0) error_exit(as->error);
+        asm_start(as);
+        double t0 = now_sec();
+        struct tinker_file_header header = pass_one(as, (const char *)src, len, as->symbols);
+        double t1 = now_sec();
+        pass_two(as, as->symbols, header);
+        double t2 = now_sec();
+        asm_free(as);
+
+        if (t1 - t0 < best_one) best_one = t1 - t0;
+        if (t2 - t1 < best_two) best_two = t2 - t1;
+
+        long rss;
+        double e2e = run_assembler(asm_path, input, out, &rss);
+        if (e2e < best_e2e) best_e2e = e2e;
+        if (rss > res->rss_kb) res->rss_kb = rss;
+    }
+    free(src);
+    remove(out);
+    tmp_out = NULL;
+
+    res->pass_one = res->lines / best_one;
+    res->pass_two = res->lines / best_two;
+    res->e2e = res->lines / best_e2e;
+}
+
+static int load_baseline(const char *path, BenchResult *base, int max) {
+    FILE *f = fopen(path, "r");
+    if (!f) return 0;
+    int n = 0;
+    char line[MAX_LINE];
+    while (n < max && fgets(line, sizeof(line), f)) {
+        if (line[0] == '#') continue;
+        BenchResult *b = &base[n];
+        if (sscanf(line, "%256s %lf %lf %lf %ld", b->name, &b->pass_one, &b->pass_two, &b->e2e, &b->rss_kb) == 5) n++;
+    }
+    fclose(f);
+    return n;
+}
+
+static int check_rate(const char *name, const char *metric, double now, double base, double tol) {
+    if (now >= base * (1.0 - tol)) return 0;
+    printf("REGRESSION %s %s: %.0f lines/s vs baseline %.0f (%.1f%% slower)\n",
+           name, metric, now, base, 100.0 * (1.0 - now / base));
+    return 1;
+}
+
+static int compare(const BenchResult *res, int n, const BenchResult *base, int nbase, double tol) {
+    int regressions = 0;
+    for (int i = 0; i < n; i++) {
+        const BenchResult *b = NULL;
+        for (int j = 0; j < nbase; j++) {
+            if (strcmp(base[j].name, res[i].name) == 0) b = &base[j];
+        }
+        if (!b) {
+            printf("NOTE %s has no baseline entry\n", res[i].name);
+            continue;
+        }
+        regressions += check_rate(res[i].name, "pass_one", res[i].pass_one, b->pass_one, tol);
+        regressions += check_rate(res[i].name, "pass_two", res[i].pass_two, b->pass_two, tol);
+        regressions += check_rate(res[i].name, "e2e", res[i].e2e, b->e2e, tol);
+        if (res[i].rss_kb > b->rss_kb * (1.0 + tol)) {
+            printf("REGRESSION %s rss: %ld KiB vs baseline %ld KiB\n", res[i].name, res[i].rss_kb, b->rss_kb);
+            regressions++;
+        }
+    }
+    return regressions;
+}
+
+static void save_baseline(const char *path, const BenchResult *res, int n) {
+    FILE *f = fopen(path, "w");
+    if (!f) error_exit("Cannot open baseline file");
+    fprintf(f, "# name pass_one_lps pass_two_lps e2e_lps rss_kb\n");
+    for (int i = 0; i < n; i++) {
+        fprintf(f, "%s %.0f %.0f %.0f %ld\n", res[i].name, res[i].pass_one, res[i].pass_two, res[i].e2e, res[i].rss_kb);
+    }
+    fclose(f);
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-a hw5-asm] [-r runs] [-b baseline] [-s save] [-t tolerance%%] <input.tk>...\n", prog);
+    exit(1);
+}
+
+int main(int argc, char **argv) {
+    const char *asm_path = "./hw5-asm";
+    const char *baseline = NULL;
+    const char *save = NULL;
+    int runs = 3;
+    double tol = 0.10;
+
+    int c;
+    while ((c = getopt(argc, argv, "a:r:b:s:t:")) != -1) {
+        switch (c) {
+            case 'a': asm_path = optarg; break;
+            case 'r': runs = atoi(optarg); break;
+            case 'b': baseline = optarg; break;
+            case 's': save = optarg; break;
+            case 't': tol = atof(optarg) / 100.0; break;
+            default: usage(argv[0]);
+        }
+    }
+    if (optind >= argc || runs < 1 || argc - optind > MAX_BENCH) usage(argv[0]);
+
+    BenchResult results[MAX_BENCH];
+    int n = 0;
+    printf("%-24s %10s %14s %14s %14s %10s\n", "input", "lines", "pass_one l/s", "pass_two l/s", "e2e l/s", "rss KiB");
+    for (int i = optind; i < argc; i++, n++) {
+        bench_file(asm_path, argv[i], runs, &results[n]);
+        BenchResult *r = &results[n];
+        printf("%-24s %10ld %14.0f %14.0f %14.0f %10ld\n", r->name, r->lines, r->pass_one, r->pass_two, r->e2e, r->rss_kb);
+    }
+
+    int status = 0;
+    if (baseline) {
+        BenchResult base[MAX_BENCH];
+        int nbase = load_baseline(baseline, base, MAX_BENCH);
+        if (nbase == 0) {
+            printf("NOTE no baseline entries in %s\n", baseline);
+        } else if (compare(results, n, base, nbase, tol) > 0) {
+            status = 1;
+        } else {
+            printf("No regressions against %s (tolerance %.0f%%)\n", baseline, tol * 100.0);
+        }
+    }
+    if (save) save_baseline(save, results, n);
+    return status;
+}
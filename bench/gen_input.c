@@ -0,0 +1,203 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+
+// gen_input: write the stdin stream for a bench/workloads program at a given
+// size, and optionally the output a correct run prints (-e).
+// Output is deterministic for a given seed so baselines stay comparable.
+//
+// Float workloads use small multiples of 1/4, so every sum and product is exact
+// and the expected result does not depend on evaluation order.
+
+static uint64_t rng_state;
+
+static uint64_t rng_next(void) {
+    // xorshift64*
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+static uint64_t bits(double d) {
+    uint64_t u;
+    memcpy(&u, &d, 8);
+    return u;
+}
+
+static double small_double(void) {
+    return (double)((int)(rng_next() % 64) - 32) / 4.0;
+}
+
+static void *xcalloc(size_t n, size_t size) {
+    void *p = calloc(n, size);
+    if (!p) {
+        fprintf(stderr, "Error: Out of memory\n");
+        exit(1);
+    }
+    return p;
+}
+
+static void put(FILE *f, uint64_t v) {
+    fprintf(f, "%llu\n", (unsigned long long)v);
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void gen_matmul(FILE *in, FILE *exp, long n) {
+    double *a = xcalloc(n * n, sizeof(double));
+    double *b = xcalloc(n * n, sizeof(double));
+    put(in, n);
+    for (long i = 0; i < n * n; i++) put(in, bits(a[i] = small_double()));
+    for (long i = 0; i < n * n; i++) put(in, bits(b[i] = small_double()));
+
+    double total = 0.0;
+    for (long i = 0; i < n; i++) {
+        for (long j = 0; j < n; j++) {
+            double acc = 0.0;
+            for (long k = 0; k < n; k++) acc += a[i * n + k] * b[k * n + j];
+            total += acc;
+        }
+    }
+    put(exp, bits(total));
+    free(a);
+    free(b);
+}
+
+static void gen_bsearch(FILE *in, FILE *exp, long n, long q) {
+    uint64_t *a = xcalloc(n, sizeof(uint64_t));
+    uint64_t v = 0;
+    put(in, n);
+    for (long i = 0; i < n; i++) {
+        v += 1 + rng_next() % 16;
+        put(in, a[i] = v);
+    }
+
+    // About half the targets are present
+    uint64_t hits = 0, index_sum = 0;
+    put(in, q);
+    for (long i = 0; i < q; i++) {
+        uint64_t t = (rng_next() & 1) ? a[rng_next() % n] : rng_next() % (v + 16);
+        put(in, t);
+        uint64_t *found = bsearch(&t, a, n, sizeof(uint64_t), cmp_u64);
+        if (found) {
+            hits++;
+            index_sum += (uint64_t)(found - a);
+        }
+    }
+    put(exp, hits);
+    put(exp, index_sum);
+    free(a);
+}
+
+static void gen_sort(FILE *in, FILE *exp, long n) {
+    uint64_t *a = xcalloc(n, sizeof(uint64_t));
+    put(in, n);
+    for (long i = 0; i < n; i++) put(in, a[i] = rng_next() >> 1);
+    qsort(a, n, sizeof(uint64_t), cmp_u64);
+
+    uint64_t sum = 0;
+    for (long i = 0; i < n; i++) sum += a[i] * (uint64_t)(i + 1);
+    put(exp, sum);
+    free(a);
+}
+
+static void gen_memcpy(FILE *in, FILE *exp, long n, long reps) {
+    n = (n + 3) & ~3L;
+    put(in, n);
+    put(in, reps);
+
+    // Every copy is of the same fill pattern, so only the pattern matters
+    uint64_t sum = 0, v = 0;
+    for (long i = 0; i < n; i++) {
+        sum += v * (uint64_t)(i + 1);
+        v += 0x9E3779B97F4A7C15ULL;
+    }
+    put(exp, sum);
+}
+
+static void gen_saxpy(FILE *in, FILE *exp, long n, long reps) {
+    double *x = xcalloc(n, sizeof(double));
+    double *y = xcalloc(n, sizeof(double));
+    double a = 0.5;
+    put(in, n);
+    put(in, reps);
+    put(in, bits(a));
+    for (long i = 0; i < n; i++) put(in, bits(x[i] = small_double()));
+    for (long i = 0; i < n; i++) put(in, bits(y[i] = small_double()));
+
+    for (long r = 0; r < reps; r++) {
+        for (long i = 0; i < n; i++) y[i] = a * x[i] + y[i];
+    }
+    double total = 0.0;
+    for (long i = 0; i < n; i++) total += y[i];
+    put(exp, bits(total));
+    free(x);
+    free(y);
+}
+
+static void gen_fib(FILE *in, FILE *exp, long n) {
+    uint64_t a = 0, b = 1;
+    for (long i = 0; i < n; i++) {
+        uint64_t t = a + b;
+        a = b;
+        b = t;
+    }
+    put(in, n);
+    put(exp, a);
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+        "Usage: %s [-s seed] [-e expected_output] <workload> <size>...\n"
+        "  matmul N | bsearch N Q | sort N | memcpy N R | saxpy N R | fib_rec N\n",
+        prog);
+    exit(1);
+}
+
+int main(int argc, char **argv) {
+    uint64_t seed = 1;
+    const char *expected = NULL;
+
+    int c;
+    while ((c = getopt(argc, argv, "s:e:")) != -1) {
+        switch (c) {
+            case 's': seed = strtoull(optarg, NULL, 0); break;
+            case 'e': expected = optarg; break;
+            default: usage(argv[0]);
+        }
+    }
+    if (optind >= argc) usage(argv[0]);
+    rng_state = seed ? seed : 1;
+
+    const char *name = argv[optind];
+    int nargs = argc - optind - 1;
+    long s1 = nargs > 0 ? atol(argv[optind + 1]) : 0;
+    long s2 = nargs > 1 ? atol(argv[optind + 2]) : 0;
+    if (nargs < 1 || s1 < 1 || s2 < 0) usage(argv[0]);
+
+    FILE *exp = fopen(expected ? expected : "/dev/null", "w");
+    if (!exp) {
+        fprintf(stderr, "Error: Cannot open output file\n");
+        return 1;
+    }
+
+    if (strcmp(name, "matmul") == 0 && nargs == 1) gen_matmul(stdout, exp, s1);
+    else if (strcmp(name, "bsearch") == 0 && nargs == 2) gen_bsearch(stdout, exp, s1, s2);
+    else if (strcmp(name, "sort") == 0 && nargs == 1) gen_sort(stdout, exp, s1);
+    else if (strcmp(name, "memcpy") == 0 && nargs == 2) gen_memcpy(stdout, exp, s1, s2);
+    else if (strcmp(name, "saxpy") == 0 && nargs == 2) gen_saxpy(stdout, exp, s1, s2);
+    else if (strcmp(name, "fib_rec") == 0 && nargs == 1) gen_fib(stdout, exp, s1);
+    else usage(argv[0]);
+
+    if (fclose(exp) != 0 || fflush(stdout) != 0) {
+        fprintf(stderr, "Error: Write failed\n");
+        return 1;
+    }
+    return 0;
+}
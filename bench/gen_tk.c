@@ -0,0 +1,155 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+
+// gen_tk: write a large, assemblable .tk file for benchmarking hw5-asm.
+// Output is deterministic for a given seed so baselines stay comparable.
+
+typedef struct {
+    long lines;        // total source lines (code + data + directives)
+    int label_pct;     // code lines that are label definitions, in percent (at most 50)
+    int ld_pct;        // code lines that are ld, in percent
+    int push_pct;      // code lines that are push, in percent
+    int pop_pct;       // code lines that are pop, in percent
+    long data_words;   // lines in the .data section
+    uint64_t seed;
+} GenConfig;
+
+static uint64_t rng_state;
+
+static uint64_t rng_next(void) {
+    // xorshift64*
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+static int rng_below(int n) {
+    return (int)(rng_next() % (uint64_t)n);
+}
+
+static int reg(void) {
+    // r31 is the stack pointer; keep it out of generated code
+    return rng_below(31);
+}
+
+// ld operand: a label, a small literal, or a wide constant that needs a long expansion
+static void emit_ld(FILE *out, long labels) {
+    int kind = rng_below(4);
+    if (kind < 2 && labels > 0) {
+        fprintf(out, "\tld r%d, :L%ld\n", reg(), (long)(rng_next() % (uint64_t)labels));
+    } else if (kind == 2) {
+        fprintf(out, "\tld r%d, %d\n", reg(), rng_below(4096));
+    } else {
+        fprintf(out, "\tld r%d, %llu\n", reg(), (unsigned long long)(rng_next() >> rng_below(64)));
+    }
+}
+
+static void emit_plain(FILE *out) {
+    static const char *rrr[] = { "add", "sub", "mul", "div", "and", "or", "xor", "shftr", "shftl", "addf", "mulf" };
+    static const char *ri[] = { "addi", "subi", "shftli", "shftri" };
+
+    switch (rng_below(8)) {
+        case 0: case 1: case 2:
+            fprintf(out, "\t%s r%d, r%d, r%d\n", rrr[rng_below(11)], reg(), reg(), reg());
+            break;
+        case 3: case 4:
+            fprintf(out, "\t%s r%d, %d\n", ri[rng_below(4)], reg(), rng_below(64));
+            break;
+        case 5:
+            fprintf(out, "\tmov r%d, r%d\n", reg(), reg());
+            break;
+        case 6:
+            if (rng_below(2)) fprintf(out, "\tmov r%d, (r%d)(%d)\n", reg(), reg(), rng_below(256) * 8);
+            else fprintf(out, "\tmov (r%d)(%d), r%d\n", reg(), rng_below(256) * 8, reg());
+            break;
+        default:
+            if (rng_below(2)) fprintf(out, "\tbrgt r%d, r%d, r%d\n", reg(), reg(), reg());
+            else fprintf(out, "\tbrnz r%d, r%d\n", reg(), reg());
+            break;
+    }
+}
+
+static void generate(FILE *out, const GenConfig *cfg) {
+    // one line each for .code and, when there is data, .data
+    long code_lines = cfg->lines - cfg->data_words - (cfg->data_words > 0 ? 2 : 1);
+    if (code_lines < 2) code_lines = 2;
+
+    // Decide label count up front so ld can reference labels defined later in the file
+    long labels = code_lines * cfg->label_pct / 100;
+    long next_label = 0;
+
+    fprintf(out, ".code\n");
+    for (long i = 0; i < code_lines - 1; i++) {
+        long remaining = code_lines - 1 - i;
+        bool force = (labels - next_label) * 2 >= remaining;
+        if (next_label < labels && (force || (long)(rng_next() % 100) < cfg->label_pct)) {
+            fprintf(out, ":L%ld\n", next_label++);
+            i++;
+            if (i >= code_lines - 1) break;
+        }
+        int pick = rng_below(100);
+        if (pick < cfg->ld_pct) emit_ld(out, labels);
+        else if (pick < cfg->ld_pct + cfg->push_pct) fprintf(out, "\tpush r%d\n", reg());
+        else if (pick < cfg->ld_pct + cfg->push_pct + cfg->pop_pct) fprintf(out, "\tpop r%d\n", reg());
+        else emit_plain(out);
+    }
+    fprintf(out, "\thalt\n");
+
+    if (cfg->data_words > 0) {
+        fprintf(out, ".data\n");
+        for (long i = 0; i < cfg->data_words; i++) {
+            fprintf(out, "\t%llu\n", (unsigned long long)(rng_next() >> rng_below(64)));
+        }
+    }
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+        "Usage: %s [-n lines] [-l label%%] [-L ld%%] [-p push%%] [-P pop%%] [-d data_words] [-s seed] [output.tk]\n",
+        prog);
+    exit(1);
+}
+
+int main(int argc, char **argv) {
+    GenConfig cfg = { 100000, 5, 15, 5, 5, 1000, 1 };
+
+    int c;
+    while ((c = getopt(argc, argv, "n:l:L:p:P:d:s:")) != -1) {
+        switch (c) {
+            case 'n': cfg.lines = atol(optarg); break;
+            case 'l': cfg.label_pct = atoi(optarg); break;
+            case 'L': cfg.ld_pct = atoi(optarg); break;
+            case 'p': cfg.push_pct = atoi(optarg); break;
+            case 'P': cfg.pop_pct = atoi(optarg); break;
+            case 'd': cfg.data_words = atol(optarg); break;
+            case 's': cfg.seed = strtoull(optarg, NULL, 0); break;
+            default: usage(argv[0]);
+        }
+    }
+    if (cfg.lines <= 0 || cfg.data_words < 0 || cfg.label_pct < 0 || cfg.label_pct > 50 ||
+        cfg.ld_pct < 0 || cfg.push_pct < 0 || cfg.pop_pct < 0 ||
+        cfg.ld_pct + cfg.push_pct + cfg.pop_pct > 100) {
+        usage(argv[0]);
+    }
+    rng_state = cfg.seed ? cfg.seed : 1;
+
+    FILE *out = stdout;
+    if (optind < argc) {
+        out = fopen(argv[optind], "w");
+        if (!out) {
+            fprintf(stderr, "Error: Cannot open output file\n");
+            return 1;
+        }
+    }
+    generate(out, &cfg);
+    if (out != stdout && fclose(out) != 0) {
+        fprintf(stderr, "Error: Write failed\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,306 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <unistd.h>
+
+#define main hw5_sim_main
+#include "simulator.c"
+#undef main
+
+// op_bench: time each opcode handler on a tight stream of that one opcode and
+// report ns/instruction per engine, as the mean of repeated timed samples
+// (after warm-up runs) with a 95% confidence interval.
+//
+// A stream is BLOCK instructions of one opcode, spread over a few registers.
+// Sources hold values that keep every handler on its normal path: nonzero
+// divisors, in-range addresses, untaken conditional branches. Ops whose stream
+// cannot run straight through guest memory (br, call, ret, halt) are timed on
+// the engines that take instructions one at a time only.
+//
+// The unknown-opcode row is the cost of dispatch alone; subtract it to see
+// what a handler itself costs. A new execution engine goes in the engines
+// table and is timed on every stream it can run.
+
+#define BLOCK 4096
+#define MAX_RUNS 200
+#define DATA_BASE TINKER_DATA_BEGIN
+
+// Register roles in every stream
+enum {
+    R_INT = 1,      // r1..r4: small integers
+    R_FLOAT = 5,    // r5..r8: doubles
+    R_FOUR = 9,     // 4, a brr offset to the next instruction
+    R_DEST = 10,    // r10..r17: destinations
+    R_DATA = 20,    // base of the data area
+    R_ZERO = 21,    // 0, so brnz is not taken
+    R_CODE = 22,    // a code address for br/call
+};
+
+typedef struct {
+    const char *name;
+    int op;
+    bool straight;   // the stream can run from guest memory, one instruction after another
+    uint32_t (*make)(int op, int i);
+} OpCase;
+
+static uint32_t encode(int op, int rd, int rs, int rt, uint32_t lit) {
+    return ((uint32_t)(op & 0x1F) << 27) | ((rd & 0x1F) << 22) | ((rs & 0x1F) << 17) | ((rt & 0x1F) << 12) | (lit & 0xFFF);
+}
+
+static uint32_t make_rrr_int(int op, int i) {
+    return encode(op, R_DEST + i % 8, R_INT + i % 4, R_INT + (i + 1) % 4, 0);
+}
+static uint32_t make_rrr_float(int op, int i) {
+    return encode(op, R_DEST + i % 8, R_FLOAT + i % 4, R_FLOAT + (i + 1) % 4, 0);
+}
+static uint32_t make_rd_lit(int op, int i) {
+    return encode(op, R_DEST + i % 8, 0, 0, 1 + i % 7);
+}
+static uint32_t make_rr(int op, int i) {
+    return encode(op, R_DEST + i % 8, R_INT + i % 4, 0, 0);
+}
+static uint32_t make_load(int op, int i) {
+    return encode(op, R_DEST + i % 8, R_DATA, 0, (i % 64) * 8);
+}
+static uint32_t make_store(int op, int i) {
+    return encode(op, R_DATA, R_INT + i % 4, 0, (i % 64) * 8);
+}
+static uint32_t make_brr_l(int op, int i) {
+    (void)i;
+    return encode(op, 0, 0, 0, 4);
+}
+static uint32_t make_brr_r(int op, int i) {
+    (void)i;
+    return encode(op, R_FOUR, 0, 0, 0);
+}
+static uint32_t make_untaken(int op, int i) {
+    // brnz on zero, brgt with rs < rt
+    return encode(op, R_CODE, R_ZERO, R_INT + i % 4, 0);
+}
+static uint32_t make_code_target(int op, int i) {
+    (void)i;
+    return encode(op, R_CODE, 0, 0, 0);
+}
+static uint32_t make_halt(int op, int i) {
+    (void)i;
+    return encode(op, 0, 0, 0, 0);
+}
+
+static const OpCase op_cases[] = {
+    { "and", OP_AND, true, make_rrr_int },
+    { "or", OP_OR, true, make_rrr_int },
+    { "xor", OP_XOR, true, make_rrr_int },
+    { "not", OP_NOT, true, make_rr },
+    { "shftr", OP_SHFTR, true, make_rrr_int },
+    { "shftri", OP_SHFTRI, true, make_rd_lit },
+    { "shftl", OP_SHFTL, true, make_rrr_int },
+    { "shftli", OP_SHFTLI, true, make_rd_lit },
+    { "br", OP_BR, false, make_code_target },
+    { "brr_r", OP_BRR_R, true, make_brr_r },
+    { "brr_l", OP_BRR_L, true, make_brr_l },
+    { "brnz", OP_BRNZ, true, make_untaken },
+    { "call", OP_CALL, false, make_code_target },
+    { "return", OP_RET, false, make_halt },
+    { "brgt", OP_BRGT, true, make_untaken },
+    { "halt", OP_PRIV, false, make_halt },
+    { "mov_ml", OP_MOV_ML, true, make_load },
+    { "mov_rr", OP_MOV_RR, true, make_rr },
+    { "mov_l", OP_MOV_L, true, make_rd_lit },
+    { "mov_sm", OP_MOV_SM, true, make_store },
+    { "addf", OP_ADDF, true, make_rrr_float },
+    { "subf", OP_SUBF, true, make_rrr_float },
+    { "mulf", OP_MULF, true, make_rrr_float },
+    { "divf", OP_DIVF, true, make_rrr_float },
+    { "add", OP_ADD, true, make_rrr_int },
+    { "addi", OP_ADDI, true, make_rd_lit },
+    { "sub", OP_SUB, true, make_rrr_int },
+    { "subi", OP_SUBI, true, make_rd_lit },
+    { "mul", OP_MUL, true, make_rrr_int },
+    { "div", OP_DIV, true, make_rrr_int },
+    { "unknown", 0x1e, true, make_rrr_int },   // the first opcode execute() does not define
+};
+
+static uint32_t stream[BLOCK];
+
+// Machine state every sample starts from
+static void prepare_machine(void) {
+    reset();
+    for (int i = 0; i < 4; i++) {
+        registers[R_INT + i] = 3 + i;
+        double d = 1.25 + i;
+        memcpy(&registers[R_FLOAT + i], &d, 8);
+    }
+    registers[R_FOUR] = 4;
+    registers[R_DATA] = DATA_BASE;
+    registers[R_ZERO] = 0;
+    registers[R_CODE] = TINKER_CODE_BEGIN;
+}
+
+// Engines: load a stream, then run it `reps` times
+
+static void execute_run(int reps) {
+    for (int r = 0; r < reps; r++) {
+        for (int i = 0; i < BLOCK; i++) {
+            program_counter = TINKER_CODE_BEGIN + 4 * (uint64_t)(i + 1);
+            execute(stream[i]);
+        }
+    }
+}
+
+static void memory_load(void) {
+    memcpy(&memory[TINKER_CODE_BEGIN], stream, sizeof(stream));
+    uint32_t halt = encode(OP_PRIV, 0, 0, 0, 0);
+    memcpy(&memory[TINKER_CODE_BEGIN + sizeof(stream)], &halt, 4);
+}
+
+static void run_run(int reps) {
+    for (int r = 0; r < reps; r++) {
+        program_counter = TINKER_CODE_BEGIN;
+        halt_program = false;
+        run();
+    }
+}
+
+typedef struct {
+    const char *name;
+    bool needs_straight;          // can only run streams that run from guest memory
+    void (*load)(void);
+    void (*run)(int reps);
+} Engine;
+
+static const Engine engines[] = {
+    { "execute", false, NULL, execute_run },
+    { "run", true, memory_load, run_run },
+};
+
+#define ENGINE_COUNT (int)(sizeof(engines) / sizeof(engines[0]))
+#define OP_COUNT (int)(sizeof(op_cases) / sizeof(op_cases[0]))
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double sample(const Engine *e, int reps) {
+    prepare_machine();
+    double t0 = now_sec();
+    e->run(reps);
+    return now_sec() - t0;
+}
+
+// Two-sided 95% Student t for n - 1 degrees of freedom
+static double t95(int n) {
+    static const double table[] = {
+        0, 12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+        2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+        2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042,
+    };
+    int df = n - 1;
+    if (df < 1) return 0;
+    if (df <= 30) return table[df];
+    return df <= 60 ? 2.000 : 1.960;
+}
+
+typedef struct {
+    double mean, ci, min;
+} Stats;
+
+// ns/instruction over `runs` samples of `reps` passes, after `warmup` untimed samples
+static Stats measure(const Engine *e, int reps, int warmup, int runs) {
+    static double ns[MAX_RUNS];
+    for (int i = 0; i < warmup; i++) sample(e, reps);
+    double instrs = (double)reps * BLOCK;
+    Stats s = { 0, 0, 0 };
+    for (int i = 0; i < runs; i++) {
+        ns[i] = sample(e, reps) * 1e9 / instrs;
+        s.mean += ns[i];
+        if (i == 0 || ns[i] < s.min) s.min = ns[i];
+    }
+    s.mean /= runs;
+    double var = 0;
+    for (int i = 0; i < runs; i++) var += (ns[i] - s.mean) * (ns[i] - s.mean);
+    if (runs > 1) s.ci = t95(runs) * sqrt(var / (runs - 1)) / sqrt(runs);
+    return s;
+}
+
+// Passes per sample so one sample lasts at least min_ms
+static int calibrate(const Engine *e, double min_ms) {
+    int reps = 1;
+    while (reps < (1 << 20)) {
+        if (sample(e, reps) * 1e3 >= min_ms) break;
+        reps *= 2;
+    }
+    return reps;
+}
+
+static bool selected(const char *name, char **names, int count) {
+    if (count == 0) return true;
+    for (int i = 0; i < count; i++) {
+        if (strcmp(names[i], name) == 0) return true;
+    }
+    return false;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+        "Usage: %s [-w warmup] [-r runs] [-t min_sample_ms] [-e engine] [-j results.json] [op...]\n",
+        prog);
+    exit(1);
+}
+
+int main(int argc, char **argv) {
+    int warmup = 3, runs = 20;
+    double min_ms = 5.0;
+    const char *engine_name = NULL, *json_path = NULL;
+
+    int c;
+    while ((c = getopt(argc, argv, "w:r:t:e:j:")) != -1) {
+        switch (c) {
+            case 'w': warmup = atoi(optarg); break;
+            case 'r': runs = atoi(optarg); break;
+            case 't': min_ms = atof(optarg); break;
+            case 'e': engine_name = optarg; break;
+            case 'j': json_path = optarg; break;
+            default: usage(argv[0]);
+        }
+    }
+    if (warmup < 0 || runs < 2 || runs > MAX_RUNS || min_ms <= 0) usage(argv[0]);
+
+    FILE *json = NULL;
+    if (json_path && !(json = fopen(json_path, "w"))) {
+        fprintf(stderr, "Error: Cannot open %s\n", json_path);
+        return 1;
+    }
+
+    printf("%-8s %-8s %10s %8s %10s %8s\n", "op", "engine", "ns/instr", "+-95%", "min", "samples");
+    for (int o = 0; o < OP_COUNT; o++) {
+        const OpCase *oc = &op_cases[o];
+        if (!selected(oc->name, argv + optind, argc - optind)) continue;
+        for (int i = 0; i < BLOCK; i++) stream[i] = oc->make(oc->op, i);
+
+        for (int k = 0; k < ENGINE_COUNT; k++) {
+            const Engine *e = &engines[k];
+            if (engine_name && strcmp(engine_name, e->name) != 0) continue;
+            if (e->needs_straight && !oc->straight) continue;
+            if (e->load) {
+                prepare_machine();
+                e->load();
+            }
+            int reps = calibrate(e, min_ms);
+            Stats s = measure(e, reps, warmup, runs);
+            printf("%-8s %-8s %10.3f %8.3f %10.3f %8d\n", oc->name, e->name, s.mean, s.ci, s.min, runs);
+            if (json) {
+                fprintf(json, "{\"op\": \"%s\", \"engine\": \"%s\", \"ns_per_instr\": %.4f, \"ci95\": %.4f, \"min\": %.4f, \"samples\": %d, \"instructions_per_sample\": %lld}\n",
+                        oc->name, e->name, s.mean, s.ci, s.min, runs, (long long)reps * BLOCK);
+            }
+        }
+    }
+    if (json && fclose(json) != 0) {
+        fprintf(stderr, "Error: Write failed\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,358 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#define main hw5_sim_main
+#include "simulator.c"
+#undef main
+
+// sim_bench: run each guest workload of a suite file and report instructions
+// executed, MIPS, wall time and peak RSS of hw5-sim; write the results as JSON
+// and optionally compare against a baseline written by an earlier run, or save
+// the results into one.
+//
+// Suite lines look like:  <name> <source.tk> <guest memory> <gen_input args...>
+//
+// Each workload is assembled with -v2 -m <guest memory>, its input (and the
+// output a correct run prints) comes from gen_input. MIPS is measured in-process
+// with this file's copy of fetch/execute; wall time and RSS come from running
+// hw5-sim itself, whose output must match the expected output.
+
+#define MAX_BENCH 64
+#define MAX_GEN_ARGS 8
+#define NAME_LEN 64
+#define LINE_LEN 512
+
+typedef struct {
+    char name[NAME_LEN];
+    char source[256];
+    char mem[32];
+    char *gen_args[MAX_GEN_ARGS + 1];
+} Workload;
+
+typedef struct {
+    char name[NAME_LEN];
+    uint64_t instructions;
+    double seconds;      // best in-process run
+    double mips;
+    double wall;         // best hw5-sim run, load included
+    long rss_kb;         // peak RSS of the hw5-sim process
+} BenchResult;
+
+static const char *asm_path = "./hw5-asm";
+static const char *sim_path = "./hw5-sim";
+static const char *gen_path = "./gen_input";
+static const char *workload_dir = "bench/workloads";
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Run argv as a child with stdin/stdout redirected to files (NULL: inherit).
+// Returns wall time; fails the benchmark on a nonzero exit.
+static double run_child(char **argv, const char *in, const char *out, long *rss_kb) {
+    double t0 = now_sec();
+    pid_t pid = fork();
+    if (pid < 0) error_exit("fork failed");
+    if (pid == 0) {
+        if (in) {
+            int fd = open(in, O_RDONLY);
+            if (fd < 0 || dup2(fd, STDIN_FILENO) < 0) _exit(127);
+            close(fd);
+        }
+        if (out) {
+            int fd = open(out, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (fd < 0 || dup2(fd, STDOUT_FILENO) < 0) _exit(127);
+            close(fd);
+        }
+        execv(argv[0], argv);
+        _exit(127);
+    }
+    int status;
+    struct rusage ru;
+    if (wait4(pid, &status, 0, &ru) < 0) error_exit("wait failed");
+    double elapsed = now_sec() - t0;
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "Error: %s failed\n", argv[0]);
+        exit(1);
+    }
+    if (rss_kb) *rss_kb = ru.ru_maxrss;
+    return elapsed;
+}
+
+static bool same_file(const char *a, const char *b) {
+    FILE *fa = fopen(a, "rb"), *fb = fopen(b, "rb");
+    bool same = fa && fb;
+    while (same) {
+        int ca = getc(fa), cb = getc(fb);
+        if (ca != cb) same = false;
+        if (ca == EOF) break;
+    }
+    if (fa) fclose(fa);
+    if (fb) fclose(fb);
+    return same;
+}
+
+// The run loop, counting instructions
+static uint64_t run_counted(void) {
+    uint64_t n = 0;
+    while (!halt_program) {
+        execute(fetch());
+        n++;
+    }
+    return n;
+}
+
+// One in-process run from a clean machine, guest output discarded
+static double run_in_process(const char *tko, const char *in, uint64_t *instructions) {
+    if (!freopen(in, "r", stdin)) error_exit("Cannot open input file");
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO);
+    int null_fd = open("/dev/null", O_WRONLY);
+    if (saved < 0 || null_fd < 0) error_exit("Cannot redirect output");
+    dup2(null_fd, STDOUT_FILENO);
+    close(null_fd);
+
+    memset(memory, 0, mem_size);
+    reset();
+    read_binary(tko);
+    double t0 = now_sec();
+    *instructions = run_counted();
+    double elapsed = now_sec() - t0;
+
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+    return elapsed;
+}
+
+static void bench_workload(const Workload *w, int runs, BenchResult *res) {
+    snprintf(res->name, sizeof(res->name), "%.63s", w->name);
+
+    char source[512], tko[128], in[128], expected[128], out[128];
+    snprintf(source, sizeof(source), "%.255s/%.255s", workload_dir, w->source);
+    snprintf(tko, sizeof(tko), "%.63s.tko", w->name);
+    snprintf(in, sizeof(in), "%.63s.in", w->name);
+    snprintf(expected, sizeof(expected), "%.63s.expected", w->name);
+    snprintf(out, sizeof(out), "%.63s.out", w->name);
+
+    char *asm_argv[] = { (char *)asm_path, "-v2", "-m", (char *)w->mem, source, tko, NULL };
+    run_child(asm_argv, NULL, NULL, NULL);
+
+    char *gen_argv[MAX_GEN_ARGS + 4] = { (char *)gen_path, "-e", expected };
+    int g = 3;
+    for (int i = 0; w->gen_args[i]; i++) gen_argv[g++] = w->gen_args[i];
+    gen_argv[g] = NULL;
+    run_child(gen_argv, NULL, in, NULL);
+
+    // Best of N: the minimum is the least noisy estimate of the real cost
+    double best = 1e30, best_wall = 1e30;
+    res->rss_kb = 0;
+    for (int r = 0; r < runs; r++) {
+        double t = run_in_process(tko, in, &res->instructions);
+        if (t < best) best = t;
+
+        char *sim_argv[] = { (char *)sim_path, tko, NULL };
+        long rss;
+        double wall = run_child(sim_argv, in, out, &rss);
+        if (wall < best_wall) best_wall = wall;
+        if (rss > res->rss_kb) res->rss_kb = rss;
+        if (!same_file(out, expected)) {
+            fprintf(stderr, "Error: %s printed the wrong output\n", w->name);
+            exit(1);
+        }
+    }
+    remove(tko);
+    remove(in);
+    remove(expected);
+    remove(out);
+
+    res->seconds = best;
+    res->mips = res->instructions / best / 1e6;
+    res->wall = best_wall;
+}
+
+static int load_suite(const char *path, Workload *ws, int max) {
+    FILE *f = fopen(path, "r");
+    if (!f) error_exit("Cannot open suite file");
+    int n = 0;
+    char line[LINE_LEN];
+    while (n < max && fgets(line, sizeof(line), f)) {
+        if (line[0] == '#') continue;
+        Workload *w = &ws[n];
+        int pos;
+        if (sscanf(line, "%63s %255s %31s %n", w->name, w->source, w->mem, &pos) != 3) continue;
+        int g = 0;
+        for (char *tok = strtok(line + pos, " \t\n"); tok && g < MAX_GEN_ARGS; tok = strtok(NULL, " \t\n")) {
+            w->gen_args[g++] = strdup(tok);
+        }
+        w->gen_args[g] = NULL;
+        if (g == 0) error_exit("Suite entry has no gen_input arguments");
+        n++;
+    }
+    fclose(f);
+    return n;
+}
+
+static bool selected(const char *name, char **names, int count) {
+    if (count == 0) return true;
+    for (int i = 0; i < count; i++) {
+        if (strcmp(names[i], name) == 0) return true;
+    }
+    return false;
+}
+
+// One workload per line, so load_baseline can read the file back with sscanf
+static void write_json(const char *path, const BenchResult *res, int n) {
+    FILE *f = fopen(path, "w");
+    if (!f) error_exit("Cannot open JSON output file");
+    fprintf(f, "{\n  \"workloads\": [\n");
+    for (int i = 0; i < n; i++) {
+        fprintf(f, "    {\"name\": \"%s\", \"instructions\": %" PRIu64 ", \"seconds\": %.6f, "
+                   "\"mips\": %.2f, \"wall_seconds\": %.6f, \"rss_kb\": %ld}%s\n",
+                res[i].name, res[i].instructions, res[i].seconds, res[i].mips, res[i].wall, res[i].rss_kb,
+                i + 1 < n ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+    fclose(f);
+}
+
+static int load_baseline(const char *path, BenchResult *base, int max) {
+    FILE *f = fopen(path, "r");
+    if (!f) return 0;
+    int n = 0;
+    char line[LINE_LEN];
+    while (n < max && fgets(line, sizeof(line), f)) {
+        char *p = strstr(line, "{\"name\"");
+        if (!p) continue;
+        BenchResult *b = &base[n];
+        if (sscanf(p, "{\"name\": \"%63[^\"]\", \"instructions\": %" SCNu64 ", \"seconds\": %lf, "
+                      "\"mips\": %lf, \"wall_seconds\": %lf, \"rss_kb\": %ld",
+                   b->name, &b->instructions, &b->seconds, &b->mips, &b->wall, &b->rss_kb) == 6) {
+            n++;
+        }
+    }
+    fclose(f);
+    return n;
+}
+
+// Replace the entries of the baseline at path that were re-run and add new ones,
+// keeping the rest, so saving a subset of the suite loses no recorded baseline
+static void save_baseline(const char *path, const BenchResult *res, int n) {
+    BenchResult base[MAX_BENCH];
+    int nbase = load_baseline(path, base, MAX_BENCH);
+    for (int i = 0; i < n; i++) {
+        int j = 0;
+        while (j < nbase && strcmp(base[j].name, res[i].name) != 0) j++;
+        if (j == nbase) {
+            if (nbase == MAX_BENCH) error_exit("Too many baseline entries");
+            nbase++;
+        }
+        base[j] = res[i];
+    }
+    write_json(path, base, nbase);
+}
+
+static int compare(const BenchResult *res, int n, const BenchResult *base, int nbase, double tol) {
+    int regressions = 0;
+    for (int i = 0; i < n; i++) {
+        const BenchResult *b = NULL;
+        for (int j = 0; j < nbase; j++) {
+            if (strcmp(base[j].name, res[i].name) == 0) b = &base[j];
+        }
+        if (!b) {
+            printf("NOTE %s has no baseline entry\n", res[i].name);
+            continue;
+        }
+        // Instruction counts are exact; a change means the workload or the assembler changed
+        if (res[i].instructions != b->instructions) {
+            printf("NOTE %s instructions: %" PRIu64 " vs baseline %" PRIu64 "\n",
+                   res[i].name, res[i].instructions, b->instructions);
+        }
+        if (res[i].mips < b->mips * (1.0 - tol)) {
+            printf("REGRESSION %s mips: %.1f vs baseline %.1f (%.1f%% slower)\n",
+                   res[i].name, res[i].mips, b->mips, 100.0 * (1.0 - res[i].mips / b->mips));
+            regressions++;
+        }
+        if (res[i].wall > b->wall * (1.0 + tol)) {
+            printf("REGRESSION %s wall: %.3fs vs baseline %.3fs\n", res[i].name, res[i].wall, b->wall);
+            regressions++;
+        }
+        if (res[i].rss_kb > b->rss_kb * (1.0 + tol)) {
+            printf("REGRESSION %s rss: %ld KiB vs baseline %ld KiB\n", res[i].name, res[i].rss_kb, b->rss_kb);
+            regressions++;
+        }
+    }
+    return regressions;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+        "Usage: %s [-a hw5-asm] [-S hw5-sim] [-g gen_input] [-w workload_dir] [-r runs]\n"
+        "          [-b baseline.json] [-s baseline.json] [-j results.json] [-t tolerance%%] <suite> [name...]\n",
+        prog);
+    exit(1);
+}
+
+int main(int argc, char **argv) {
+    const char *baseline = NULL;
+    const char *json = NULL;
+    const char *save = NULL;
+    int runs = 3;
+    double tol = 0.10;
+
+    int c;
+    while ((c = getopt(argc, argv, "a:S:g:w:r:b:s:j:t:")) != -1) {
+        switch (c) {
+            case 'a': asm_path = optarg; break;
+            case 'S': sim_path = optarg; break;
+            case 'g': gen_path = optarg; break;
+            case 'w': workload_dir = optarg; break;
+            case 'r': runs = atoi(optarg); break;
+            case 'b': baseline = optarg; break;
+            case 's': save = optarg; break;
+            case 'j': json = optarg; break;
+            case 't': tol = atof(optarg) / 100.0; break;
+            default: usage(argv[0]);
+        }
+    }
+    if (optind >= argc || runs < 1) usage(argv[0]);
+
+    Workload suite[MAX_BENCH];
+    int nsuite = load_suite(argv[optind], suite, MAX_BENCH);
+
+    BenchResult results[MAX_BENCH];
+    int n = 0;
+    printf("%-16s %14s %10s %10s %10s %10s\n", "workload", "instructions", "seconds", "MIPS", "wall s", "rss KiB");
+    for (int i = 0; i < nsuite; i++) {
+        if (!selected(suite[i].name, argv + optind + 1, argc - optind - 1)) continue;
+        bench_workload(&suite[i], runs, &results[n]);
+        BenchResult *r = &results[n++];
+        printf("%-16s %14" PRIu64 " %10.3f %10.1f %10.3f %10ld\n",
+               r->name, r->instructions, r->seconds, r->mips, r->wall, r->rss_kb);
+        fflush(stdout);
+    }
+
+    int status = 0;
+    if (baseline) {
+        BenchResult base[MAX_BENCH];
+        int nbase = load_baseline(baseline, base, MAX_BENCH);
+        if (nbase == 0) {
+            printf("NOTE no baseline entries in %s\n", baseline);
+        } else if (compare(results, n, base, nbase, tol) > 0) {
+            status = 1;
+        } else {
+            printf("No regressions against %s (tolerance %.0f%%)\n", baseline, tol * 100.0);
+        }
+    }
+    if (json) write_json(json, results, n);
+    if (save) save_baseline(save, results, n);
+    return status;
+}
@@ -1,2 +1,4 @@
-gcc -o hw5-sim ./src/simulator.c ./src/symbol_table.c -I./include -lm
-gcc -o hw5-asm ./src/assembler.c ./src/symbol_table.c -I./include -lm
\ No newline at end of file
+gcc -o hw5-sim ./src/simulator.c ./src/symbol_table.c ./src/tko_codec.c -I./include -lm
+gcc -o hw5-asm ./src/assembler.c ./src/assemble.c ./src/optimizer.c ./src/symbol_table.c ./src/tko_codec.c -I./include -lm
+gcc -o hw5-ld ./src/linker.c ./src/symbol_table.c -I./include -lm
+gcc -o hw5-aot ./src/aot.c ./src/symbol_table.c ./src/tko_codec.c -I./include -lm
@@ -0,0 +1,54 @@
+#!/bin/bash
+# hw5-sim against hw5-aot translations on the guest workloads of bench/sim_suite.txt.
+# Run from the repository root:  bash build/aot_bench.sh [name...]
+# Each workload is assembled, translated and compiled once; the table shows the
+# best of RUNS wall times (default 3) for each, and both must print the expected output.
+# CFLAGS is passed to every build of the tools (default: none, matching build.sh);
+# AOT_CFLAGS to the translated programs (default: -O2).
+
+set -e
+ROOT=$(pwd)
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+RUNS=${RUNS:-3}
+AOT_CFLAGS=${AOT_CFLAGS:--O2}
+
+gcc $CFLAGS -o "$WORK/gen_input" ./bench/gen_input.c
+gcc $CFLAGS -o "$WORK/hw5-sim" ./src/simulator.c ./src/symbol_table.c ./src/tko_codec.c -I./include -lm
+gcc $CFLAGS -o "$WORK/hw5-asm" ./src/assembler.c ./src/assemble.c ./src/optimizer.c ./src/symbol_table.c ./src/tko_codec.c -I./include -lm
+gcc $CFLAGS -o "$WORK/hw5-aot" ./src/aot.c ./src/symbol_table.c ./src/tko_codec.c -I./include -lm
+
+# Best wall time of RUNS runs of "$@" < $IN > $OUT, in seconds
+best_time() {
+    local best=""
+    for i in $(seq $RUNS); do
+        local t0 t1 t
+        t0=$(date +%s.%N)
+        "$@" < "$IN" > "$OUT"
+        t1=$(date +%s.%N)
+        t=$(awk -v a="$t0" -v b="$t1" 'BEGIN { print b - a }')
+        if [ -z "$best" ] || awk -v t="$t" -v b="$best" 'BEGIN { exit !(t < b) }'; then best=$t; fi
+    done
+    echo "$best"
+}
+
+printf "%-12s %10s %10s %8s\n" "workload" "hw5-sim s" "aot s" "speedup"
+while read -r name source mem args; do
+    [[ -z "$name" || "$name" == \#* ]] && continue
+    if [ $# -gt 0 ] && [[ ! " $* " == *" $name "* ]]; then continue; fi
+    cd "$WORK"
+    ./hw5-asm -v2 -m "$mem" "$ROOT/bench/workloads/$source" "$name.tko" > /dev/null
+    ./gen_input -e "$name.expected" $args > "$name.in"
+    ./hw5-aot "$name.tko" "$name.c"
+    gcc $AOT_CFLAGS -o "$name.aot" "$name.c" "$ROOT/src/symbol_table.c" "$ROOT/src/tko_codec.c" -I"$ROOT/src" -I"$ROOT/include" -lm
+
+    IN="$name.in"
+    OUT="$name.sim.out"
+    sim=$(best_time ./hw5-sim "$name.tko")
+    cmp -s "$OUT" "$name.expected" || { echo "$name: hw5-sim output differs"; exit 1; }
+    OUT="$name.aot.out"
+    aot=$(best_time "./$name.aot")
+    cmp -s "$OUT" "$name.expected" || { echo "$name: translated output differs"; exit 1; }
+    printf "%-12s %10.3f %10.3f %7.1fx\n" "$name" "$sim" "$aot" "$(awk -v a="$sim" -v b="$aot" 'BEGIN { print a / b }')"
+    cd "$ROOT"
+done < bench/sim_suite.txt
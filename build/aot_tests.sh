@@ -0,0 +1,80 @@
+ASM="./hw5-asm"
+SIM="./hw5-sim"
+AOT="./hw5-aot"
+CC="gcc -O1 -I./src -I./include"
+RUNTIME="./src/symbol_table.c ./src/tko_codec.c -lm"
+
+TMP_DIR="aot_tmp"
+
+PASS=0
+FAIL=0
+
+mkdir -p $TMP_DIR
+
+# A store over the next two instructions: hw5-sim runs the new code, and so must
+# the translation, by handing the rest of the run to the interpreter
+printf '%b\n' ".code\n\tld r29, 1\n\tld r2, :patch\n\tld r3, 14429533209454706693\n\tmov (r2)(0), r3" \
+    ":patch\n\taddi r1, 1\n\taddi r1, 1\n\tout r29, r1\n\thalt" > $TMP_DIR/smc.tk
+# A jump into the middle of a block
+printf '%b\n' ".code\n\tld r29, 1\n\tld r1, 7\n\tld r2, :target\n\tld r3, 4\n\tadd r2, r2, r3\n\tbr r2" \
+    ":target\n\taddi r1, 1\n\tout r29, r1\n\thalt" > $TMP_DIR/mid.tk
+printf '%b\n' ".code\n\tld r29, 1\n\tin r1, r0\n\tclr r2\n\tdiv r3, r1, r2\n\thalt" > $TMP_DIR/div.tk
+printf '%b\n' ".code\n\tld r29, 1\n\tld r1, 65536\n\tclr r5\n\tld r3, 3\n\tinw r1, r5, r3\n\tld r4, 65600\n\tld r3, 24\n\tmemcpy r4, r1, r3\n\tld r3, 3\n\toutw r29, r4, r3\n\thalt" > $TMP_DIR/bulk.tk
+
+# Translate, compile and run source_file on input_data; output and exit status
+# must match hw5-sim's on the same .tko
+run_aot_test() {
+    local name="$1"
+    local source_file="$2"
+    local input_data="$3"
+    local flags="$4"
+
+    rm -f $TMP_DIR/prog.tko $TMP_DIR/prog.c $TMP_DIR/prog
+    $ASM $flags "$source_file" $TMP_DIR/prog.tko > /dev/null 2>&1
+    $AOT $TMP_DIR/prog.tko $TMP_DIR/prog.c > /dev/null 2>&1
+    $CC -o $TMP_DIR/prog $TMP_DIR/prog.c $RUNTIME > /dev/null 2>&1
+
+    if [ ! -x "$TMP_DIR/prog" ]; then
+        echo "FAIL: $name (Translation or compilation failed)"
+        ((FAIL++))
+        return
+    fi
+
+    local expected actual expected_status actual_status
+    expected=$(echo "$input_data" | $SIM $TMP_DIR/prog.tko 2>&1)
+    expected_status=$?
+    actual=$(echo "$input_data" | $TMP_DIR/prog 2>&1)
+    actual_status=$?
+
+    if [ "$actual" == "$expected" ] && [ "$actual_status" == "$expected_status" ]; then
+        echo "PASS: $name"
+        ((PASS++))
+    else
+        echo "FAIL: $name"
+        echo "   Expected : status $expected_status, $(echo $expected | xargs)"
+        echo "   Got      : status $actual_status, $(echo $actual | xargs)"
+        ((FAIL++))
+    fi
+}
+
+echo "Starting AOT Tests"
+
+run_aot_test "Fibo N=10" fibonacci.tk "10"
+run_aot_test "Fibo bad input" fibonacci.tk "abc"
+run_aot_test "BS Found -v2" binary_search.tk "5 10 20 30 40 50 30" "-v2"
+run_aot_test "BS Not Found -O" binary_search.tk "5 10 20 30 40 50 99" "-O"
+run_aot_test "3x3 Identity -z" matrix_multiplication.tk \
+    "3 4607182418800017408 4624633867356078080 4613937818241073152 4616189618054758400 13856381001095905280 4617315517961592832 4619567317775278080 4617315517961592832 4621256167635542016 4607182418800017408 0 0 0 4607182418800017408 0 0 0 4607182418800017408" "-z"
+run_aot_test "Self-modifying code" $TMP_DIR/smc.tk ""
+run_aot_test "Jump into a block" $TMP_DIR/mid.tk ""
+run_aot_test "Divide by zero" $TMP_DIR/div.tk "5"
+run_aot_test "Bulk priv services" $TMP_DIR/bulk.tk "4 5 6"
+
+rm -rf $TMP_DIR
+
+echo "Results"
+echo "Total: $((PASS + FAIL))"
+echo "Passed: $PASS"
+echo "Failed: $FAIL"
+
+exit $FAIL
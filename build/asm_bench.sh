@@ -0,0 +1,26 @@
+#!/bin/bash
+# Assembler throughput benchmark. Run from the repository root.
+#   bash build/asm_bench.sh           compare against bench/asm_baseline.txt
+#   bash build/asm_bench.sh --save    record a new baseline on this machine
+# CFLAGS is passed to every build (default: none, matching build.sh).
+
+set -e
+ROOT=$(pwd)
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+gcc $CFLAGS -o "$WORK/gen_tk" ./bench/gen_tk.c
+gcc $CFLAGS -o "$WORK/asm_bench" ./bench/asm_bench.c ./src/optimizer.c ./src/symbol_table.c ./src/tko_codec.c -I./src -I./include -lm
+gcc $CFLAGS -o "$WORK/hw5-asm" ./src/assembler.c ./src/assemble.c ./src/optimizer.c ./src/symbol_table.c ./src/tko_codec.c -I./include -lm
+
+cd "$WORK"
+./gen_tk -n 200000 mixed.tk
+./gen_tk -n 200000 -l 25 -L 40 -p 2 -P 2 -d 100 labels.tk
+./gen_tk -n 200000 -l 1 -L 5 -p 20 -P 20 -d 100000 data.tk
+
+BASELINE="$ROOT/bench/asm_baseline.txt"
+if [ "$1" == "--save" ]; then
+    ./asm_bench -a ./hw5-asm -s "$BASELINE" mixed.tk labels.tk data.tk
+else
+    ./asm_bench -a ./hw5-asm -b "$BASELINE" mixed.tk labels.tk data.tk
+fi
@@ -11,10 +11,11 @@ test_valid() {
     local name="$1"
     local input_code="$2"
     local expected_inter="$3"
+    local flags="$4"
 
     printf "%b\n" "$input_code" > $TMP_TK
     
-    $ASM $TMP_TK $TMP_TKO > /dev/null 2>&1
+    $ASM $flags $TMP_TK $TMP_TKO > /dev/null 2>&1
 
     if [ ! -f "$INTER" ]; then
         echo "FAIL: $name (intermediate.tk not generated)"
@@ -44,10 +45,11 @@ test_error() {
     local name="$1"
     local input_code="$2"
     local expected_err="$3"
+    local flags="$4"
 
     printf "%b\n" "$input_code" > $TMP_TK
     
-    local output=$($ASM $TMP_TK $TMP_TKO 2>&1)
+    local output=$($ASM $flags $TMP_TK $TMP_TKO 2>&1)
     
     if [[ "$output" == *"$expected_err"* ]]; then
         echo "PASS [ERR CATCH]: $name"
@@ -118,20 +120,83 @@ test_valid "IN"   ".code\n\tin r1, r2"    "priv r1, r2, r0, 3"
 test_valid "OUT"  ".code\n\tout r1, r2"   "priv r1, r2, r0, 4"
 test_valid "PUSH" ".code\n\tpush r1"      "mov (r31)(-8), r1;subi r31, 8"
 test_valid "POP"  ".code\n\tpop r1"       "mov r1, (r31)(0);addi r31, 8"
+test_valid "INW"  ".code\n\tinw r1, r2, r3"  "priv r1, r2, r3, 5"
+test_valid "OUTW" ".code\n\toutw r1, r2, r3" "priv r1, r2, r3, 6"
+test_valid "OUTS" ".code\n\touts r1, r2, r3" "priv r1, r2, r3, 7"
+test_valid "MAPSIZE" ".code\n\tmapsize r1, r2" "priv r1, r2, r0, 8"
+test_valid "MEMCPY" ".code\n\tmemcpy r1, r2, r3" "priv r1, r2, r3, 9"
+test_valid "MEMSET" ".code\n\tmemset r1, r2, r3" "priv r1, r2, r3, 10"
+test_valid "MEMCMP" ".code\n\tmemcmp r1, r2, r3" "priv r1, r2, r3, 11"
 
 # LD Macro: Breaking down 64-bit maximum (18446744073709551615 = all 1s)
 # Each 12 bit chunk is 4095, last 4 bits is 15.
 test_valid "LD_MAX" ".code\n\tld r1, 18446744073709551615" \
 "xor r1, r1, r1;addi r1, 4095;shftli r1, 12;addi r1, 4095;shftli r1, 12;addi r1, 4095;shftli r1, 12;addi r1, 4095;shftli r1, 12;addi r1, 4095;shftli r1, 4;addi r1, 15"
 
+# LD relaxation: small values use the shortest sequence
+test_valid "LD_ZERO"  ".code\n\tld r1, 0"     "xor r1, r1, r1"
+test_valid "LD_SMALL" ".code\n\tld r1, 4095"  "xor r1, r1, r1;addi r1, 4095"
+test_valid "LD_SHIFT" ".code\n\tld r1, 65536" "xor r1, r1, r1;addi r1, 2048;shftli r1, 5"
+# Label settles at 0x200c once the ld is 12 bytes: 0x200c = 2051 << 2
+test_valid "LD_LABEL" ".code\n\tld r1, :lbl\n:lbl\n\thalt" "xor r1, r1, r1;addi r1, 2051;shftli r1, 2;priv r0, r0, r0, 0"
+
 # PC relative
 echo -e "\nPC relative"
-# Forward: PC=0x2000, target=0x2004. (0x2004 - 0x2004)/4 = 0
-test_valid "BRR_FWD_LBL" ".code\n\tbrr :lbl\n:lbl" "brr 0"
+# Forward: PC=0x2000, target=0x2004. Offset is in bytes from the brr: 0x2004 - 0x2000 = 4
+test_valid "BRR_FWD_LBL" ".code\n\tbrr :lbl\n:lbl" "brr 4"
+
+# Optimizer (-O)
+echo -e "\nOptimizer"
+test_valid "OPT_BR_TO_BRR" ".code\n\tld r1, :lbl\n\tbr r1\n\taddi r2, 1\n:lbl\n\thalt" "brr 8;addi r2, 1;priv r0, r0, r0, 0" "-O"
+test_valid "OPT_LIVE_LD"   ".code\n\tld r1, :lbl\n\tbr r1\n:lbl\n\tout r1, r1" "xor r1, r1, r1;addi r1, 2052;shftli r1, 2;brr 4;priv r1, r1, r0, 4" "-O"
+test_valid "OPT_COND_KEPT" ".code\n\tld r1, :lbl\n\tbrgt r1, r2, r3\n:lbl\n\thalt" "xor r1, r1, r1;addi r1, 2052;shftli r1, 2;brgt r1, r2, r3;priv r0, r0, r0, 0" "-O"
+
+# Profile-guided layout (-P): the hot latch falls into the loop test, which moves to the bottom
+ROTATE_SRC=".code\n\tld r5, :body\n:head\n\tbrnz r5, r1\n\thalt\n:body\n\tsubi r1, 1\n\tbrr :head"
+printf 'pc 0x200c 4\npc 0x2014 3\npc 0x2018 3\nedge 0x200c 0x2014 3\nedge 0x2018 0x200c 3\n' > profile_hot_tmp.txt
+printf 'pc 0x200c 4\n' > profile_cold_tmp.txt
+printf 'edge 0x200c 0x2004 1\n' > profile_bad_tmp.txt
+printf 'pc 8192\n' > profile_syntax_tmp.txt
+test_valid "LAYOUT_ROTATE" "$ROTATE_SRC" "xor r5, r5, r5;addi r5, 2052;shftli r5, 2;brr 8;subi r1, 1;brnz r5, r1;priv r0, r0, r0, 0" "-P profile_hot_tmp.txt"
+test_valid "LAYOUT_COLD" "$ROTATE_SRC" "xor r5, r5, r5;addi r5, 2053;shftli r5, 2;brnz r5, r1;priv r0, r0, r0, 0;subi r1, 1;brr -12" "-P profile_cold_tmp.txt"
+test_error "Profile Mismatch" "$ROTATE_SRC" "Profile does not match program" "-P profile_bad_tmp.txt"
+test_error "Profile Syntax" "$ROTATE_SRC" "Invalid profile" "-P profile_syntax_tmp.txt"
+test_error "Profile Missing" "$ROTATE_SRC" "Cannot open profile file" "-P no_such_profile.txt"
+rm -f profile_hot_tmp.txt profile_cold_tmp.txt profile_bad_tmp.txt profile_syntax_tmp.txt
 
 # Data
 echo -e "\nData"
 test_valid "DATA_SEGMENT" ".data\n\t12345\n\t67890\n.code\n\thalt" "12345;67890;priv r0, r0, r0, 0"
+test_valid "DATA_ZERO"  ".data\n\t1\n\t.zero 16\n:after\n\t2\n.code\n\tld r1, :after" "1;.zero 16;2;xor r1, r1, r1;addi r1, 2048;shftli r1, 5;addi r1, 24"
+test_valid "DATA_SPACE" ".data\n\t.space 8\n.code\n\thalt" ".zero 8;priv r0, r0, r0, 0"
+test_valid "DATA_FILL"  ".data\n\t.fill 3, 7\n\t.fill 2, 0\n.code\n\thalt" ".fill 3, 7;.zero 16;priv r0, r0, r0, 0"
+printf 'abcdefghij' > incbin_tmp.bin
+test_valid "INCBIN"       ".data\n\t.incbin \"incbin_tmp.bin\"\n.code\n\thalt" ".incbin \"./incbin_tmp.bin\", 0, 10;priv r0, r0, r0, 0"
+test_valid "INCBIN_RANGE" ".data\n\t.incbin \"incbin_tmp.bin\", 2, 3\n:after\n\t1\n.code\n\tld r1, :after" ".incbin \"./incbin_tmp.bin\", 2, 3;1;xor r1, r1, r1;addi r1, 2048;shftli r1, 5;addi r1, 8"
+test_error "Incbin Missing"   ".data\n\t.incbin \"no_such_file.bin\""      "Cannot open .incbin file"
+test_error "Incbin Range"     ".data\n\t.incbin \"incbin_tmp.bin\", 4, 7"  "Invalid .incbin length"
+test_error "Incbin Syntax"    ".data\n\t.incbin incbin_tmp.bin"            ".incbin takes"
+test_error "Incbin Zero Length" ".data\n\t1\n\t.incbin \"incbin_tmp.bin\", 2, 0" "Invalid .incbin length"
+test_error "Incbin At End"    ".data\n\t.incbin \"incbin_tmp.bin\", 10"   "Invalid .incbin length"
+printf '' > incbin_empty_tmp.bin
+test_error "Incbin Empty File" ".code\n\thalt\n.data\n\t.incbin \"incbin_empty_tmp.bin\"" "Invalid .incbin length" "-v2"
+rm -f incbin_tmp.bin incbin_empty_tmp.bin
+test_error "Zero Unaligned"   ".data\n\t.zero 12"  "Directive size must be a multiple of 8"
+test_error "Zero Empty"       ".data\n\t1\n\t.zero 0"  "Invalid directive size"
+test_error "Space Empty"      ".code\n\thalt\n.data\n\t.space 0"  "Invalid directive size"
+test_error "Zero Empty v2"    ".code\n\thalt\n.data\n\t.zero 0"  "Invalid directive size" "-v2"
+test_error "Fill Empty"       ".data\n\t.fill 0, 7"  "Invalid directive size"
+test_error "Fill No Value"    ".data\n\t.fill 2"   ".fill takes a count and a value"
+test_error "Inw Args"         ".code\n\tinw r1, r2"  "inw takes 3 args"
+test_error "Unknown Directive" ".data\n\t.word 2"  "Unknown data directive"
+
+# Segment layout
+echo -e "\nCategory: Segment Layout"
+test_valid "TDATA_AFTER" ".code\n\tld r1, :d\n\thalt\n.data\n:d\n\t5" "xor r1, r1, r1;addi r1, 2064;shftli r1, 2;priv r0, r0, r0, 0;5" "-Tdata=after"
+test_valid "TCODE"       ".code\n:top\n\tld r1, :top" "xor r1, r1, r1;addi r1, 2048;shftli r1, 3" "-Tcode=0x4000"
+test_error "Code Overlaps Data" ".code\n\thalt\n.data\n\t5"  "Code segment overlaps data segment" "-Tdata=0x2000"
+test_error "Guest Too Small"    ".code\n\thalt\n.data\n\t5"  "Program does not fit in guest memory" "-m 64K"
+test_error "Bad Memory Size"    ".code\n\thalt"  "Invalid memory size" "-m 100"
 
 # Bounds + Syntax
 echo -e "\nBounds + Syntax"
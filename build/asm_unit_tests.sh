@@ -1 +1 @@
-gcc -g -O0 ./tests/asm_unit_tests.c ./src/symbol_table.c -I./include -I./src -o ./build/asm_test_harness -lm
\ No newline at end of file
+gcc -g -O0 ./tests/asm_unit_tests.c ./src/optimizer.c ./src/symbol_table.c ./src/tko_codec.c -I./include -I./src -o ./build/asm_test_harness -lm -pthread
\ No newline at end of file
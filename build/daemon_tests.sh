@@ -0,0 +1,104 @@
+ASM="./hw5-asm"
+SIM="./hw5-sim"
+
+TMP_DIR="daemon_tmp"
+SOCKET="$TMP_DIR/sim.sock"
+
+PASS=0
+FAIL=0
+
+mkdir -p $TMP_DIR
+
+# Programs shared by the tests; the daemon's guest memory ends in a partial page
+$ASM fibonacci.tk $TMP_DIR/fib.tko > /dev/null 2>&1
+$ASM -v2 -z binary_search.tk $TMP_DIR/bs.tko > /dev/null 2>&1
+printf '%b\n' ".code\n\tld r29, 1\n\tld r1, :count\n\tmov r2, (r1)(0)\n\taddi r2, 1\n\tmov (r1)(0), r2\n\tout r29, r2\n\thalt\n.data\n:count\n\t0" > $TMP_DIR/count.tk
+$ASM $TMP_DIR/count.tk $TMP_DIR/count.tko > /dev/null 2>&1
+printf '%b\n' ".code\n\tld r29, 1\n\tld r1, :scratch\n\tld r5, 4096\n\tadd r1, r1, r5\n\tmov r2, (r1)(0)\n\tout r29, r2" \
+    "\tld r3, 7\n\tmov (r1)(0), r3" \
+    "\tld r4, :sub\n\tcall r4\n\thalt\n:sub\n\tout r29, r3\n\tret\n.data\n:scratch\n\t.zero 16384" > $TMP_DIR/zero.tk
+$ASM -v2 $TMP_DIR/zero.tk $TMP_DIR/zero.tko > /dev/null 2>&1
+printf '%b\n' ".code\n\tld r29, 1\n\tld r1, :buf\n\tld r2, :far\n\tmov r3, (r1)(0)\n\tout r29, r3\n\tmov r3, (r2)(0)\n\tout r29, r3" \
+    "\tld r4, 1\n\tld r5, 8\n\tmemset r1, r4, r5\n\tmemcpy r2, r1, r5\n\tmov r3, (r2)(0)\n\tout r29, r3\n\thalt" \
+    ".data\n:buf\n\t5\n\t.zero 8192\n:far\n\t0" > $TMP_DIR/fill.tk
+$ASM -v2 $TMP_DIR/fill.tk $TMP_DIR/fill.tko > /dev/null 2>&1
+printf '%b\n' ".code\n:top\n\taddi r2, 1\n\tbrr :top" > $TMP_DIR/loop.tk
+$ASM $TMP_DIR/loop.tk $TMP_DIR/loop.tko > /dev/null 2>&1
+
+$SIM -m 1001K -i 1000000 -t 5 -d $SOCKET $TMP_DIR/fib.tko > /dev/null 2>&1 &
+DAEMON=$!
+for i in $(seq 50); do
+    [ -S "$SOCKET" ] && break
+    sleep 0.1
+done
+
+run_daemon_test() {
+    local name="$1"
+    local program="$2"
+    local input_data="$3"
+    local expected_output="$4"
+    local expected_status="${5:-0}"
+
+    local actual_output
+    actual_output=$(echo "$input_data" | $SIM -c $SOCKET $program 2>&1)
+    local status=$?
+    actual_output=$(echo "$actual_output" | xargs)
+
+    # expected_output may end in * to match a prefix
+    if [[ "$actual_output" == $expected_output ]] && [ "$status" == "$expected_status" ]; then
+        echo "PASS: $name"
+        ((PASS++))
+    else
+        echo "FAIL: $name"
+        echo "   Expected : status $expected_status, $expected_output"
+        echo "   Got      : status $status, $actual_output"
+        ((FAIL++))
+    fi
+}
+
+echo "Starting Daemon Tests"
+
+run_daemon_test "Preloaded Fibo N=10" "$TMP_DIR/fib.tko" "10" "34"
+run_daemon_test "Fibo N=20" "$TMP_DIR/fib.tko" "20" "4181"
+run_daemon_test "Compressed v2" "$TMP_DIR/bs.tko" "5 10 20 30 40 50 30" "found"
+run_daemon_test "Memory restored between runs" "$TMP_DIR/count.tko" "" "1"
+run_daemon_test "Memory restored again" "$TMP_DIR/count.tko" "" "1"
+run_daemon_test "Zero page and stack restored" "$TMP_DIR/zero.tko" "" "0 7"
+run_daemon_test "Zero page and stack restored again" "$TMP_DIR/zero.tko" "" "0 7"
+run_daemon_test "memset/memcpy pages restored" "$TMP_DIR/fill.tko" "" "5 0 72340172838076673"
+run_daemon_test "memset/memcpy pages restored again" "$TMP_DIR/fill.tko" "" "5 0 72340172838076673"
+run_daemon_test "Switch back to a written image" "$TMP_DIR/count.tko" "" "1"
+run_daemon_test "Guest error" "$TMP_DIR/fib.tko" "abc" "Simulation error" 1
+run_daemon_test "Runaway guest" "$TMP_DIR/loop.tko" "" "Instruction limit exceeded instructions: 1000000 *" 124
+run_daemon_test "Serving after errors" "$TMP_DIR/fib.tko" "10" "34"
+run_daemon_test "Missing program" "$TMP_DIR/missing.tko" "" "Invalid tinker filepath" 1
+
+# A rejected load must not leave its file open in the daemon
+head -c 200 $TMP_DIR/bs.tko > $TMP_DIR/truncated.tko
+FDS_BEFORE=$(ls /proc/$DAEMON/fd | wc -l)
+for i in $(seq 200); do
+    $SIM -c $SOCKET $TMP_DIR/truncated.tko < /dev/null > /dev/null 2>&1
+done
+FDS_AFTER=$(ls /proc/$DAEMON/fd | wc -l)
+if [ "$FDS_AFTER" -le "$FDS_BEFORE" ]; then
+    echo "PASS: Truncated v2 loads release their files"
+    ((PASS++))
+else
+    echo "FAIL: Truncated v2 loads release their files"
+    echo "   Expected : at most $FDS_BEFORE open descriptors"
+    echo "   Got      : $FDS_AFTER"
+    ((FAIL++))
+fi
+run_daemon_test "Truncated v2" "$TMP_DIR/truncated.tko" "" "Invalid header" 1
+run_daemon_test "Serving after bad loads" "$TMP_DIR/fib.tko" "10" "34"
+
+kill $DAEMON 2> /dev/null
+wait $DAEMON 2> /dev/null
+rm -rf $TMP_DIR
+
+echo "Results"
+echo "Total: $((PASS + FAIL))"
+echo "Passed: $PASS"
+echo "Failed: $FAIL"
+
+exit $FAIL
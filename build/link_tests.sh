@@ -0,0 +1,88 @@
+ASM="./hw5-asm"
+LD="./hw5-ld"
+SIM="./hw5-sim"
+
+TMP_DIR="link_tmp"
+
+PASS=0
+FAIL=0
+
+mkdir -p $TMP_DIR
+
+# Module sources shared by the tests
+printf '.global double\n.global table\n.global skip_back\n.code\n:double\n\tadd r1, r1, r1\n\tret\n:skip_back\n\tbrr :after_skip\n.data\n:table\n\t5\n\t6\n' > $TMP_DIR/lib.tk
+printf '.global after_skip\n.code\n\tclr r0\n\tld r29, 1\n\tin r1, r0\n\tld r2, :double\n\tcall r2\n\tout r29, r1\n\tld r3, :table\n\tmov r4, (r3)(8)\n\tout r29, r4\n\tbrr :skip_back\n\thalt\n:after_skip\n\tout r29, r1\n\thalt\n' > $TMP_DIR/main.tk
+printf '.code\n\tld r2, :missing\n\thalt\n' > $TMP_DIR/undef.tk
+printf '.global double\n.code\n:double\n\thalt\n' > $TMP_DIR/dup.tk
+
+# Assemble once; each test only links
+for m in lib main undef dup; do
+    $ASM -c $TMP_DIR/$m.tk $TMP_DIR/$m.o > /dev/null 2>&1
+done
+
+run_link_test() {
+    local name="$1"
+    local objects="$2"
+    local input_data="$3"
+    local expected_output="$4"
+    local flags="$5"
+
+    rm -f $TMP_DIR/out.tko
+    $LD $flags -o $TMP_DIR/out.tko $objects > /dev/null 2>&1
+
+    if [ ! -f "$TMP_DIR/out.tko" ]; then
+        echo "FAIL: $name (Linker failed)"
+        ((FAIL++))
+        return
+    fi
+
+    local actual_output
+    actual_output=$(echo "$input_data" | $SIM $TMP_DIR/out.tko 2>&1 | xargs)
+
+    if [ "$actual_output" == "$expected_output" ]; then
+        echo "PASS: $name"
+        ((PASS++))
+    else
+        echo "FAIL: $name"
+        echo "   Expected : $expected_output"
+        echo "   Got      : $actual_output"
+        ((FAIL++))
+    fi
+}
+
+test_link_error() {
+    local name="$1"
+    local objects="$2"
+    local expected_err="$3"
+
+    local output=$($LD -o $TMP_DIR/err.tko $objects 2>&1)
+
+    if [[ "$output" == *"$expected_err"* ]]; then
+        echo "PASS [ERR CATCH]: $name"
+        ((PASS++))
+    else
+        echo "FAIL [ERR CATCH]: $name"
+        echo "   Expected Error: $expected_err"
+        echo "   Got Output    : $output"
+        ((FAIL++))
+    fi
+}
+
+echo "Tinker Linker Tests"
+
+# call into lib, read lib data, brr across objects both ways
+run_link_test "Two Modules" "$TMP_DIR/main.o $TMP_DIR/lib.o" "21" "42 6 42"
+run_link_test "Two Modules -Tdata=after" "$TMP_DIR/main.o $TMP_DIR/lib.o" "21" "42 6 42" "-Tdata=after"
+
+test_link_error "Undefined Symbol" "$TMP_DIR/undef.o" "Undefined symbol: missing"
+test_link_error "Duplicate Symbol" "$TMP_DIR/main.o $TMP_DIR/lib.o $TMP_DIR/dup.o" "Duplicate symbol: double"
+test_link_error "Not An Object"    "$TMP_DIR/out.tko" "Not a relocatable object"
+
+echo "----"
+echo "Tests Completed: $((PASS + FAIL))"
+echo "Passed: $PASS"
+echo "Failed: $FAIL"
+
+rm -rf $TMP_DIR
+
+exit $FAIL
@@ -0,0 +1,11 @@
+#!/bin/bash
+# Per-opcode cost of the simulator's execution engines. Run from the repository root;
+# arguments go to op_bench (-w warmup, -r runs, -t min sample ms, -e engine, -j json, op names).
+# CFLAGS is passed to the build (default: none, matching build.sh).
+
+set -e
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+gcc $CFLAGS -o "$WORK/op_bench" ./bench/op_bench.c ./src/symbol_table.c ./src/tko_codec.c -I./src -I./include -lm
+"$WORK/op_bench" "$@"
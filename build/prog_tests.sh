@@ -15,13 +15,15 @@ run_app_test() {
     local source_file="$2"
     local input_data="$3"
     local expected_output="$4"
+    local flags="$5"
+    local sim_flags="$6"
 
     if [ ! -f "$source_file" ]; then
         echo "SKIP: $name ($source_file not found)"
         return
     fi
 
-    $ASM "$source_file" "$TMP_TKO" > /dev/null 2>&1
+    $ASM $flags "$source_file" "$TMP_TKO" > /dev/null 2>&1
     
     if [ ! -f "$TMP_TKO" ]; then
         echo "FAIL: $name (Assembler failed)"
@@ -30,7 +32,7 @@ run_app_test() {
     fi
 
     local actual_output
-    actual_output=$(echo "$input_data" | $SIM "$TMP_TKO" 2>&1 | xargs)
+    actual_output=$(echo "$input_data" | $SIM $sim_flags "$TMP_TKO" 2>&1 | xargs)
     
     local expected_norm
     expected_norm=$(echo "$expected_output" | xargs)
@@ -48,6 +50,137 @@ run_app_test() {
     rm -f "$TMP_TKO"
 }
 
+# Runs that must stop with a given exit status and print the given text
+run_status_test() {
+    local name="$1"
+    local source_file="$2"
+    local sim_flags="$3"
+    local expected_status="$4"
+    local expected_text="$5"
+
+    $ASM "$source_file" "$TMP_TKO" > /dev/null 2>&1
+    local actual_output
+    actual_output=$($SIM $sim_flags "$TMP_TKO" < /dev/null 2>&1)
+    local status=$?
+
+    if [ "$status" == "$expected_status" ] && [[ "$actual_output" == *"$expected_text"* ]]; then
+        echo "PASS: $name"
+        ((PASS++))
+    else
+        echo "FAIL: $name"
+        echo "   Expected : status $expected_status, $expected_text"
+        echo "   Got      : status $status, $actual_output"
+        ((FAIL++))
+    fi
+
+    rm -f "$TMP_TKO"
+}
+
+# Profile a build, lay it out again with -P from that profile, and check the
+# laid-out program prints the same
+run_profile_test() {
+    local name="$1"
+    local source_file="$2"
+    local input_data="$3"
+    local expected_output="$4"
+    local flags="$5"
+
+    rm -f profile_tmp.txt
+    $ASM $flags "$source_file" "$TMP_TKO" > /dev/null 2>&1
+    echo "$input_data" | $SIM -p profile_tmp.txt "$TMP_TKO" > /dev/null 2>&1
+    rm -f "$TMP_TKO"
+    if [ ! -f profile_tmp.txt ]; then
+        echo "FAIL: $name (no profile written)"
+        ((FAIL++))
+        return
+    fi
+    run_app_test "$name" "$source_file" "$input_data" "$expected_output" "$flags -P profile_tmp.txt"
+    rm -f profile_tmp.txt
+}
+
+# Assemble each source as a stage and run them all as one --pipeline; the
+# per-stage stats on stderr are not compared
+run_pipeline_test() {
+    local name="$1"
+    local mode="$2"
+    local input_data="$3"
+    local expected_output="$4"
+    local expected_status="$5"
+    shift 5
+
+    local stages=()
+    for source_file in "$@"; do
+        local stage="stage${#stages[@]}_tmp.tko"
+        $ASM "$source_file" "$stage" > /dev/null 2>&1
+        stages+=("$stage")
+    done
+    local actual_output
+    actual_output=$(echo "$input_data" | $SIM -q 16 --pipeline "$mode" "${stages[@]}" 2> /dev/null)
+    local status=$?
+    actual_output=$(echo "$actual_output" | xargs)
+
+    if [ "$status" == "$expected_status" ] && [ "$actual_output" == "$(echo "$expected_output" | xargs)" ]; then
+        echo "PASS: $name"
+        ((PASS++))
+    else
+        echo "FAIL: $name"
+        echo "   Expected : status $expected_status, $expected_output"
+        echo "   Got      : status $status, $actual_output"
+        ((FAIL++))
+    fi
+    rm -f "${stages[@]}"
+}
+
+# A guest that loops until -t stops it, asked for its counters with SIGUSR1
+# while it runs; they go to stderr, and -S leaves them in a stats file
+run_stats_test() {
+    local name="$1"
+    local source_file="$2"
+
+    $ASM "$source_file" "$TMP_TKO" > /dev/null 2>&1
+    rm -f stats_tmp.bin
+    $SIM -t 1 -s 0 -S stats_tmp.bin "$TMP_TKO" > /dev/null 2> stats_tmp.txt &
+    local pid=$!
+    sleep 0.3
+    kill -USR1 $pid
+    wait $pid
+    local status=$?
+
+    if [ "$status" == 124 ] && grep -q "^branch: [1-9]" stats_tmp.txt && [ "$(head -c 8 stats_tmp.bin)" == "TKTSTATS" ]; then
+        echo "PASS: $name"
+        ((PASS++))
+    else
+        echo "FAIL: $name"
+        echo "   Got      : status $status, $(cat stats_tmp.txt | xargs)"
+        ((FAIL++))
+    fi
+    rm -f "$TMP_TKO" stats_tmp.bin stats_tmp.txt
+}
+
+# -t also stops a guest blocked on input that never comes
+run_blocked_test() {
+    local name="$1"
+    local source_file="$2"
+    local sim_flags="$3"
+
+    $ASM "$source_file" "$TMP_TKO" > /dev/null 2>&1
+    local actual_output
+    actual_output=$( (sleep 1; echo 5) | $SIM -t 0.1 $sim_flags "$TMP_TKO" 2>&1)
+    local status=$?
+
+    if [ "$status" == 124 ] && [[ "$actual_output" == "Time limit exceeded"* ]]; then
+        echo "PASS: $name"
+        ((PASS++))
+    else
+        echo "FAIL: $name"
+        echo "   Expected : status 124, Time limit exceeded"
+        echo "   Got      : status $status, $actual_output"
+        ((FAIL++))
+    fi
+
+    rm -f "$TMP_TKO"
+}
+
 echo "Starting Application Tests"
 
 ## Fibonacci
@@ -66,6 +199,140 @@ run_app_test "3x3 Identity" "$MATMUL_FILE" \
     "3 4607182418800017408 4624633867356078080 4613937818241073152 4616189618054758400 13856381001095905280 4617315517961592832 4619567317775278080 4617315517961592832 4621256167635542016 4607182418800017408 0 0 0 4607182418800017408 0 0 0 4607182418800017408" \
     "4607182418800017408 4624633867356078080 4613937818241073152 4616189618054758400 13856381001095905280 4617315517961592832 4619567317775278080 4617315517961592832 4621256167635542016"
 
+## Optimized (-O) builds must behave the same
+run_app_test "Fibo N=10 -O" "$FIBO_FILE" "10" "34" "-O"
+run_app_test "BS Found Mid -O" "$BSEARCH_FILE" "5 10 20 30 40 50 30" "found" "-O"
+run_app_test "BS Not Found -O" "$BSEARCH_FILE" "5 10 20 30 40 50 99" "not found" "-O"
+run_app_test "3x3 Identity -O" "$MATMUL_FILE" \
+    "3 4607182418800017408 4624633867356078080 4613937818241073152 4616189618054758400 13856381001095905280 4617315517961592832 4619567317775278080 4617315517961592832 4621256167635542016 4607182418800017408 0 0 0 4607182418800017408 0 0 0 4607182418800017408" \
+    "4607182418800017408 4624633867356078080 4613937818241073152 4616189618054758400 13856381001095905280 4617315517961592832 4619567317775278080 4617315517961592832 4621256167635542016" "-O"
+
+## v2 (-v2) executables must behave the same
+run_app_test "Fibo N=10 -v2" "$FIBO_FILE" "10" "34" "-v2"
+run_app_test "BS Found Mid -v2" "$BSEARCH_FILE" "5 10 20 30 40 50 30" "found" "-v2"
+run_app_test "BS Not Found -O -v2" "$BSEARCH_FILE" "5 10 20 30 40 50 99" "not found" "-O -v2"
+run_app_test "3x3 Identity -v2" "$MATMUL_FILE" \
+    "3 4607182418800017408 4624633867356078080 4613937818241073152 4616189618054758400 13856381001095905280 4617315517961592832 4619567317775278080 4617315517961592832 4621256167635542016 4607182418800017408 0 0 0 4607182418800017408 0 0 0 4607182418800017408" \
+    "4607182418800017408 4624633867356078080 4613937818241073152 4616189618054758400 13856381001095905280 4617315517961592832 4619567317775278080 4617315517961592832 4621256167635542016" "-v2"
+
+## Compressed (-z) executables must behave the same
+run_app_test "Fibo N=10 -z" "$FIBO_FILE" "10" "34" "-z"
+run_app_test "BS Found Mid -z" "$BSEARCH_FILE" "5 10 20 30 40 50 30" "found" "-z"
+run_app_test "3x3 Identity -z" "$MATMUL_FILE" \
+    "3 4607182418800017408 4624633867356078080 4613937818241073152 4616189618054758400 13856381001095905280 4617315517961592832 4619567317775278080 4617315517961592832 4621256167635542016 4607182418800017408 0 0 0 4607182418800017408 0 0 0 4607182418800017408" \
+    "4607182418800017408 4624633867356078080 4613937818241073152 4616189618054758400 13856381001095905280 4617315517961592832 4619567317775278080 4617315517961592832 4621256167635542016" "-z"
+
+## Profile-guided layout (-P) must behave the same
+run_profile_test "Fibo N=10 -P" "$FIBO_FILE" "10" "34"
+run_profile_test "Fibo N=1 -O -P" "$FIBO_FILE" "1" "0" "-O"
+run_profile_test "BS Found Mid -P" "$BSEARCH_FILE" "5 10 20 30 40 50 30" "found"
+run_profile_test "BS Not Found -O -P -v2" "$BSEARCH_FILE" "5 10 20 30 40 50 99" "not found" "-O -v2"
+run_profile_test "3x3 Identity -O -P" "$MATMUL_FILE" \
+    "3 4607182418800017408 4624633867356078080 4613937818241073152 4616189618054758400 13856381001095905280 4617315517961592832 4619567317775278080 4617315517961592832 4621256167635542016 4607182418800017408 0 0 0 4607182418800017408 0 0 0 4607182418800017408" \
+    "4607182418800017408 4624633867356078080 4613937818241073152 4616189618054758400 13856381001095905280 4617315517961592832 4619567317775278080 4617315517961592832 4621256167635542016" "-O"
+ROTATE_FILE="rotate_tmp.tk"
+printf '%b\n' ".code\n\tclr r0\n\tld r29, 1\n\tin r1, r0\n\tclr r2\n\tld r5, :body\n:head\n\tbrnz r5, r1\n\tout r29, r2" \
+    "\thalt\n:body\n\tadd r2, r2, r1\n\tsubi r1, 1\n\tbrr :head" > "$ROTATE_FILE"
+run_profile_test "Rotated loop -P" "$ROTATE_FILE" "100" "5050"
+run_profile_test "Rotated loop, cold -P" "$ROTATE_FILE" "0" "0"
+rm -f "$ROTATE_FILE"
+run_status_test "Profile with -d" "$FIBO_FILE" "-p profile_tmp.txt -d sock_tmp" 1 "Profiling is not available in daemon mode"
+
+## .fill/.zero data, with the zero run as bss in v2
+DIRECTIVES_FILE="directives_tmp.tk"
+printf '%b\n' ".code\n\tld r29, 1\n\tld r1, :table\n\tmov r2, (r1)(0)\n\tmov r3, (r1)(16)\n\tadd r2, r2, r3" \
+    "\tld r4, :scratch\n\tmov r5, (r4)(2040)\n\tadd r2, r2, r5\n\tmov (r4)(8), r2\n\tmov r6, (r4)(8)" \
+    "\tld r7, :tail\n\tmov r8, (r7)(0)\n\tadd r6, r6, r8\n\tout r29, r6\n\thalt" \
+    ".data\n:table\n\t.fill 3, 7\n:scratch\n\t.zero 4096\n:tail\n\t9" > "$DIRECTIVES_FILE"
+run_app_test "Fill/Zero" "$DIRECTIVES_FILE" "" "23"
+run_app_test "Fill/Zero -v2" "$DIRECTIVES_FILE" "" "23" "-v2"
+run_app_test "Fill/Zero -z" "$DIRECTIVES_FILE" "" "23" "-z"
+
+## .incbin: raw words from a file, padded to 8 bytes, with labels after it still right
+INCBIN_FILE="incbin_tmp.tk"
+printf '\x2a\x00\x00\x00\x00\x00\x00\x00\x07' > incbin_tmp.bin
+printf '%b\n' ".code\n\tld r29, 1\n\tld r1, :blob\n\tmov r2, (r1)(0)\n\tmov r3, (r1)(8)\n\tld r4, :after\n\tmov r5, (r4)(0)" \
+    "\tout r29, r2\n\tout r29, r3\n\tout r29, r5\n\thalt\n.data\n:blob\n\t.incbin \"incbin_tmp.bin\"\n:after\n\t9" > "$INCBIN_FILE"
+run_app_test "Incbin" "$INCBIN_FILE" "" "42 7 9"
+run_app_test "Incbin -z" "$INCBIN_FILE" "" "42 7 9" "-z"
+rm -f "$DIRECTIVES_FILE" "$INCBIN_FILE" incbin_tmp.bin
+
+## Segment layout: data past the default 512 KiB needs a bigger guest (-m); v2 records it, v1 needs hw5-sim -m
+LAYOUT_FILE="layout_tmp.tk"
+printf '%b\n' ".code\n\tld r29, 1\n\tld r1, :far\n\tmov r2, (r1)(0)\n\tmov (r1)(8), r2\n\tmov r3, (r1)(8)" \
+    "\tadd r2, r2, r3\n\tout r29, r2\n\thalt\n.data\n:far\n\t21\n\t.zero 8" > "$LAYOUT_FILE"
+run_app_test "Layout -Tdata=after" "$LAYOUT_FILE" "" "42" "-Tdata=after"
+run_app_test "Layout far data, sim -m" "$LAYOUT_FILE" "" "42" "-Tdata=0x100000 -m 2M" "-m 2M"
+run_app_test "Layout far data -v2 -m" "$LAYOUT_FILE" "" "42" "-v2 -Tdata=0x100000 -m 2M"
+run_app_test "Layout far data, small guest" "$LAYOUT_FILE" "" "Invalid tinker filepath" "-Tdata=0x100000 -m 2M"
+rm -f "$LAYOUT_FILE"
+
+## Raw binary I/O: -b feeds port 3 little-endian words from a file, -B writes port 1 words raw
+printf '\x01\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x40\x00\x00\x00\x00\x00\x00\x08\x40' > raw_in_tmp.bin
+printf '\x02\x00\x00' > raw_short_tmp.bin
+RAW_OUT_FILE="raw_out_tmp.tk"
+printf '%b\n' ".code\n\tld r29, 1\n\tld r1, 8315180351701344626\n\tout r29, r1\n\thalt" > "$RAW_OUT_FILE"
+run_app_test "1x1 raw input" "$MATMUL_FILE" "" "4618441417868443648" "" "-b raw_in_tmp.bin"
+run_app_test "Raw input too short" "$MATMUL_FILE" "" "Simulation error" "" "-b raw_short_tmp.bin"
+run_app_test "Raw output" "$RAW_OUT_FILE" "" "rawbytes" "" "-B -"
+rm -f raw_in_tmp.bin raw_short_tmp.bin "$RAW_OUT_FILE"
+
+## --map: host files over guest memory; ro maps are private copies, rw maps write through
+printf '\x05\x00\x00\x00\x00\x00\x00\x00\x07\x00\x00\x00\x00\x00\x00\x00\x09' > map_tmp.bin
+printf '\x05\x00\x00\x00\x00\x00\x00\x00\x07\x00\x00\x00\x00\x00\x00\x00\x09' > map_rw_tmp.bin
+MAP_FILE="map_tmp.tk"
+printf '%b\n' ".code\n\tld r29, 1\n\tld r1, 262144\n\tmapsize r2, r1\n\tout r29, r2\n\tmov r3, (r1)(8)\n\tout r29, r3" \
+    "\tld r4, 99\n\tmov (r1)(0), r4\n\tld r5, 327680\n\tmov r6, (r5)(0)\n\tout r29, r6\n\tmapsize r7, r29\n\tout r29, r7\n\thalt" > "$MAP_FILE"
+run_app_test "Map ro" "$MAP_FILE" "" "17 7 5 0" "" "--map map_tmp.bin@256K --map map_tmp.bin@0x50000"
+run_app_test "Map rw" "$MAP_FILE" "" "17 7 99 0" "" "--map map_rw_tmp.bin@256K:rw --map map_rw_tmp.bin@0x50000:rw"
+run_app_test "Map over code" "$MAP_FILE" "" "Invalid map" "" "--map map_tmp.bin@0x2000"
+run_app_test "Map unaligned" "$MAP_FILE" "" "Invalid map" "" "--map map_tmp.bin@0x40008"
+rm -f map_tmp.bin map_rw_tmp.bin "$MAP_FILE"
+
+## Watchdog: a guest that never halts stops with status 124 at a block boundary past its budget
+LOOP_FILE="loop_tmp.tk"
+printf '%b\n' ".code\n\tld r29, 1\n\tout r29, r29\n:top\n\taddi r2, 1\n\tbrr :top" > "$LOOP_FILE"
+run_status_test "Instruction limit" "$LOOP_FILE" "-i 1000" 124 "Instruction limit exceeded"
+run_status_test "Instruction limit stats" "$LOOP_FILE" "-i 1000" 124 "instructions: 1001"
+run_status_test "Time limit" "$LOOP_FILE" "-t 0.05" 124 "Time limit exceeded"
+run_status_test "Bad instruction limit" "$LOOP_FILE" "-i 0" 1 "Invalid instruction limit"
+BLOCKED_FILE="blocked_tmp.tk"
+BLOCKED_RAW_FILE="blocked_raw_tmp.tk"
+printf '%b\n' ".code\n\tclr r1\n\tin r2, r1\n\tld r29, 1\n\tout r29, r2\n\thalt" > "$BLOCKED_FILE"
+printf '%b\n' ".code\n\tld r1, 3\n\tin r2, r1\n\tld r29, 1\n\tout r29, r2\n\thalt" > "$BLOCKED_RAW_FILE"
+run_blocked_test "Time limit blocked on input" "$BLOCKED_FILE" ""
+run_blocked_test "Time limit blocked on raw input" "$BLOCKED_RAW_FILE" "-b -"
+rm -f "$BLOCKED_FILE" "$BLOCKED_RAW_FILE"
+run_app_test "Limits not reached" "$FIBO_FILE" "10" "34" "" "-i 100000 -t 10"
+
+## Live statistics: a line on stderr at the end with -s, the full set on SIGUSR1
+run_status_test "Stats line" "$LOOP_FILE" "-i 1000 -s 10" 124 "stats: 0.0 s, 1001 instructions"
+run_status_test "Bad stats interval" "$LOOP_FILE" "-s -1" 1 "Invalid stats interval"
+run_stats_test "Stats on SIGUSR1" "$LOOP_FILE"
+rm -f "$LOOP_FILE"
+
+## Pipelines: 1..N, doubled, summed, with a 0 passed down to end each stage
+GEN_FILE="gen_tmp.tk"
+DOUBLE_FILE="double_tmp.tk"
+SUM_FILE="sum_tmp.tk"
+HEAD_FILE="head_tmp.tk"
+printf '%b\n' ".code\n\tclr r0\n\tin r1, r0\n\tld r29, 1\n\tld r20, :loop\n:loop\n\tout r29, r1\n\tsubi r1, 1\n\tbrnz r20, r1" \
+    "\tout r29, r1\n\thalt" > "$GEN_FILE"
+printf '%b\n' ".code\n\tld r0, 3\n\tld r29, 1\n\tld r20, :loop\n:loop\n\tin r1, r0\n\tadd r2, r1, r1\n\tout r29, r2\n\tbrnz r20, r1\n\thalt" > "$DOUBLE_FILE"
+printf '%b\n' ".code\n\tld r0, 3\n\tld r29, 1\n\tclr r2\n\tld r20, :loop\n:loop\n\tin r1, r0\n\tadd r2, r2, r1\n\tbrnz r20, r1" \
+    "\tout r29, r2\n\thalt" > "$SUM_FILE"
+printf '%b\n' ".code\n\tld r0, 3\n\tld r29, 1\n\tin r1, r0\n\tout r29, r1\n\thalt" > "$HEAD_FILE"
+run_pipeline_test "Pipeline cores" cores "1000" "1001000" 0 "$GEN_FILE" "$DOUBLE_FILE" "$SUM_FILE"
+run_pipeline_test "Pipeline coop" coop "1000" "1001000" 0 "$GEN_FILE" "$DOUBLE_FILE" "$SUM_FILE"
+run_pipeline_test "Pipeline one stage" coop "3" "3 2 1 0" 0 "$GEN_FILE"
+run_pipeline_test "Pipeline reader gone" cores "100000" "100000" 0 "$GEN_FILE" "$HEAD_FILE"
+run_pipeline_test "Pipeline starved" coop "5" "" 1 "$SUM_FILE" "$SUM_FILE"
+run_pipeline_test "Pipeline starved cores" cores "5" "" 1 "$SUM_FILE" "$SUM_FILE"
+run_status_test "Pipeline mode" "$FIBO_FILE" "--pipeline fast" 1 "Invalid pipeline mode"
+run_status_test "Pipeline queue size" "$FIBO_FILE" "-q 1000 --pipeline coop" 1 "Invalid queue size"
+run_status_test "Pipeline with -i" "$FIBO_FILE" "-i 1000 --pipeline cores" 1 "Option not available in pipeline mode"
+rm -f "$GEN_FILE" "$DOUBLE_FILE" "$SUM_FILE" "$HEAD_FILE"
+
 echo "Results"
 echo "Total: $((PASS + FAIL))"
 echo "Passed: $PASS"
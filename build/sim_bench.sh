@@ -0,0 +1,27 @@
+#!/bin/bash
+# Guest workload benchmark for hw5-sim. Run from the repository root.
+#   bash build/sim_bench.sh [name...]          compare against bench/sim_baseline.json
+#   bash build/sim_bench.sh --save [name...]   record a new baseline on this machine;
+#                                              entries for workloads not run are kept
+# Results of the last run are left in sim_bench.json.
+# CFLAGS is passed to every build (default: none, matching build.sh).
+
+set -e
+ROOT=$(pwd)
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+gcc $CFLAGS -o "$WORK/gen_input" ./bench/gen_input.c
+gcc $CFLAGS -o "$WORK/sim_bench" ./bench/sim_bench.c ./src/symbol_table.c ./src/tko_codec.c -I./src -I./include -lm
+gcc $CFLAGS -o "$WORK/hw5-sim" ./src/simulator.c ./src/symbol_table.c ./src/tko_codec.c -I./include -lm
+gcc $CFLAGS -o "$WORK/hw5-asm" ./src/assembler.c ./src/assemble.c ./src/optimizer.c ./src/symbol_table.c ./src/tko_codec.c -I./include -lm
+
+BASELINE="$ROOT/bench/sim_baseline.json"
+ARGS=(-a ./hw5-asm -S ./hw5-sim -g ./gen_input -w "$ROOT/bench/workloads" -j "$ROOT/sim_bench.json")
+cd "$WORK"
+if [ "$1" == "--save" ]; then
+    shift
+    ./sim_bench "${ARGS[@]}" -s "$BASELINE" "$ROOT/bench/sim_suite.txt" "$@"
+else
+    ./sim_bench "${ARGS[@]}" -b "$BASELINE" "$ROOT/bench/sim_suite.txt" "$@"
+fi
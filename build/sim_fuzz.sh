@@ -0,0 +1,5 @@
+# Differential fuzz of the simulator's execution paths; extra arguments go to sim_fuzz
+# (-n cases, -s seed, -l max program length, -a ./hw5-aot to add its translations,
+# -x to check the harness with a broken engine)
+gcc -g -O1 -o sim_fuzz ./tests/sim_fuzz.c ./src/symbol_table.c ./src/tko_codec.c -I./src -I./include -lm
+./sim_fuzz "$@"
@@ -89,6 +89,16 @@ run_test "CALL_RET" "
 # I/O Port
 run_test "PORT_3_ASCII" "\tld r1, 72\n\tout r28, r1" "H"
 run_test "PORT_0_IN"    "\tclr r5\n\tin r1, r5\n\tout r29, r1" "500" "500"
+run_test "INW_OUTW"     "\tld r1, 65536\n\tclr r5\n\tld r3, 3\n\tinw r1, r5, r3\n\toutw r29, r1, r3" "7 8 9" "7 8 9"
+run_test "OUTW_ASCII"   "\tld r1, 65536\n\tld r2, 72\n\tmov (r1)(0), r2\n\tld r2, 105\n\tmov (r1)(8), r2\n\tld r3, 2\n\toutw r28, r1, r3" "Hi"
+run_test "OUTS"         "\tld r1, 65536\n\tld r2, 2189666\n\tmov (r1)(0), r2\n\tld r3, 3\n\touts r28, r1, r3" "bi!"
+run_test "INW_RANGE"    "\tld r1, 65536\n\tclr r5\n\tld r3, 100000\n\tinw r1, r5, r3" "Simulation error"
+run_test "OUTS_RANGE"   "\tld r1, 65536\n\tld r3, 1000000\n\touts r28, r1, r3" "Simulation error"
+run_test "MEMCPY"       "\tld r1, 65536\n\tld r2, 72\n\tmov (r1)(0), r2\n\tld r2, 105\n\tmov (r1)(8), r2\n\tld r4, 65600\n\tld r3, 16\n\tmemcpy r4, r1, r3\n\tld r3, 2\n\toutw r28, r4, r3" "Hi"
+run_test "MEMSET"       "\tld r1, 65536\n\tld r2, 33\n\tld r3, 4\n\tmemset r1, r2, r3\n\touts r28, r1, r3" "!!!!"
+run_test "MEMCMP"       "\tld r1, 65536\n\tld r2, 65544\n\tld r3, 8\n\tld r4, 5\n\tmov (r1)(0), r4\n\tmov r5, r1\n\tmemcmp r5, r2, r3\n\tout r29, r5\n\tmov r5, r2\n\tmemcmp r5, r1, r3\n\tout r29, r5\n\tmov r5, r1\n\tmemcmp r5, r1, r3\n\tout r29, r5" "1 18446744073709551615 0"
+run_test "MEMCPY_OVERLAP" "\tld r1, 65536\n\tld r2, 65544\n\tld r3, 16\n\tmemcpy r2, r1, r3" "Simulation error"
+run_test "MEMSET_RANGE" "\tld r1, 65536\n\tld r3, 1000000\n\tmemset r1, r2, r3" "Simulation error"
 
 echo "----"
 echo "Tests Completed: $((PASS + FAIL))"
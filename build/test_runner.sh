@@ -0,0 +1,4 @@
+# The asm, sim and prog test suites in-process on every core; extra arguments go to
+# test_runner (-j workers, -q to list only failures, or the scripts to run)
+gcc -O1 -o test_runner ./tests/test_runner.c ./src/optimizer.c ./src/symbol_table.c ./src/tko_codec.c -I./src -I./include -lm
+./test_runner "$@"
@@ -0,0 +1,58 @@
+#ifndef ASSEMBLE_H
+#define ASSEMBLE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "tinker_defs.h"
+
+// The assembler as a library: source text in memory to a .tko image in memory.
+// Every call keeps its state in memory of its own and reports errors in its
+// result, never by exiting, and nothing touches the filesystem unless
+// read_file does. Calls may run concurrently on any number of threads.
+
+enum {
+    ASM_EXEC,              // v1 executable
+    ASM_EXEC_V2,           // v2 executable with symbols and a line map (hw5-asm -v2)
+    ASM_EXEC_V2_COMPRESSED, // v2 with compressed code and data (hw5-asm -z)
+    ASM_OBJECT,            // relocatable object for hw5-ld (hw5-asm -c)
+};
+
+typedef struct {
+    int format;              // ASM_EXEC etc.
+    uint64_t code_begin;     // -Tcode
+    uint64_t data_begin;     // -Tdata
+    bool data_after;         // -Tdata=after: data on the first 64-byte boundary after code
+    uint64_t mem_size;       // -m; 0 for the simulator's default
+    // .incbin "file": called with base_dir/file (or file, if absolute) to get
+    // its bytes in a malloc'd buffer; returns 0 on success. NULL makes .incbin an error.
+    int (*read_file)(void *ctx, const char *path, uint8_t **data, size_t *size);
+    void *read_file_ctx;
+    const char *base_dir;
+    // Source line of each line of src, 1-based (hw5-asm -P reorders the lines);
+    // NULL when src is the user's own text
+    const int *line_origin;
+    int line_origin_count;
+} AsmOptions;
+
+typedef struct {
+    uint8_t *image;                // the .tko file
+    size_t image_size;
+    char *listing;                 // macros expanded and labels resolved (intermediate.tk)
+    size_t listing_size;
+    struct tinker_line *lines;     // address and source line of each code statement
+    size_t line_count;
+    int error_line;                // source line of the error, 0 if it has none
+    char error[160];               // "" on success
+} AsmResult;
+
+// hw5-asm's defaults: v1, code at TINKER_CODE_BEGIN, data at TINKER_DATA_BEGIN
+void asm_default_options(AsmOptions *opts);
+
+// Assemble len bytes of src. Returns 0 and fills the image, listing and line
+// map, or returns -1 with error and error_line set. Free with asm_result_free.
+int assemble(const char *src, size_t len, const AsmOptions *opts, AsmResult *res);
+
+void asm_result_free(AsmResult *res);
+
+#endif
@@ -0,0 +1,13 @@
+#ifndef ASSEMBLER_H
+#define ASSEMBLER_H
+
+#include <stdint.h>
+#include "symbol_table.h"
+
+// Shared by the assembler passes and the optimizer
+void error_exit(const char *msg);
+void trim_line(char *line);
+int parse_register(const char *reg);
+int get_opcode(char *mnem);
+
+#endif
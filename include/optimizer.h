@@ -0,0 +1,31 @@
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include <stddef.h>
+#include "tinker_defs.h"
+
+typedef struct {
+    int jumps_rewritten;   // br rX turned into brr :label
+    int lds_removed;       // ld whose register was dead afterwards
+} OptStats;
+
+// Source-to-source -O pass: reads input .tk, writes the optimized .tk to output.
+// Returns 0 if the program was analyzed, 1 if it was copied through unchanged.
+int optimize_source(const char *input, const char *output, OptStats *stats);
+
+typedef struct {
+    int blocks_moved;      // blocks no longer at their source position
+    int jumps_removed;     // jumps that now land on the next block
+    int jumps_added;       // brr standing in for a fallthrough that moved away
+} LayoutStats;
+
+// Profile-guided -P pass: reorders the code blocks of input by the hw5-sim -p
+// profile, given the address of each statement (map) in the profiled build.
+// Code comes first in output, data after. origin[k] is the input line number
+// of output line k + 1, 0 for lines the pass made up; the caller frees it.
+// Returns 0 if the program was laid out, 1 if it was copied through unchanged.
+int layout_source(const char *input, const char *output, const char *profile,
+                  const struct tinker_line *map, size_t n_map,
+                  int **origin, int *n_origin, LayoutStats *stats);
+
+#endif
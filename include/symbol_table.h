@@ -15,13 +15,16 @@ typedef struct SymbolEntry {
 } SymbolEntry;
 
 typedef struct SymbolTable {
-    SymbolEntry* buckets[TABLE_SIZE];
+    SymbolEntry** buckets;
+    unsigned long bucket_count;  // starts at TABLE_SIZE, grows with count
+    unsigned long count;
 } SymbolTable;
 
 SymbolTable* create_table();
 unsigned long hash_label(char *str);
 int insert_label(SymbolTable* table, char* name, uint64_t addr);
 uint64_t lookup_label(SymbolTable* table, char* name);
+void clear_table(SymbolTable* table);
 void free_table(SymbolTable* table);
 
 #endif
\ No newline at end of file
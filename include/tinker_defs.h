@@ -3,6 +3,11 @@
 
 #include <stdint.h>
 
+// Default layout and guest memory; hw5-asm/hw5-ld -T and -m change them
+#define TINKER_CODE_BEGIN 0x2000
+#define TINKER_DATA_BEGIN 0x10000
+#define TINKER_DEFAULT_MEM_SIZE 524288   // 512 KiB
+
 struct tinker_file_header {
     uint64_t file_type;
     uint64_t code_seg_begin;
@@ -11,6 +16,103 @@ struct tinker_file_header {
     uint64_t data_seg_size;
 };
 
+// file_type values
+#define TINKER_EXEC   0   // loadable program
+#define TINKER_OBJECT 1   // relocatable object from hw5-asm -c, input to hw5-ld
+#define TINKER_EXEC_V2 2  // loadable program with a section table (hw5-asm -v2)
+
+// v2 executable layout:
+//   tinker_v2_header (64 bytes)
+//   tinker_section[section_count] at section_table_offset
+//   section contents, each starting on a TINKER_V2_ALIGN boundary so code and
+//   data can be mmap'd straight from the file
+// file_type is the first field of both headers, so loaders read it first and dispatch.
+#define TINKER_V2_ALIGN 64
+
+struct tinker_v2_header {
+    uint64_t file_type;              // TINKER_EXEC_V2
+    uint64_t entry;                  // address of the first instruction to execute
+    uint64_t section_count;
+    uint64_t section_table_offset;
+    uint64_t flags;                  // TINKER_V2_* bits
+    uint64_t mem_size;               // guest memory the program was laid out for, 0 for the default
+    uint64_t reserved[2];
+};
+
+// Some sections are stored compressed; their tinker_section.flags name the
+// codec (TKO_CODEC_* in tko_codec.h), size is the encoded size and mem_size
+// the decoded one
+#define TINKER_V2_COMPRESSED 0x1
+
+typedef enum {
+    TINKER_SEC_CODE = 1,     // instructions, loaded at addr
+    TINKER_SEC_DATA = 2,     // initialized data, loaded at addr
+    TINKER_SEC_BSS = 3,      // mem_size zero bytes at addr, nothing in the file
+    TINKER_SEC_SYMTAB = 4,   // tinker_symbol[], names in TINKER_SEC_STRTAB, sorted by value
+    TINKER_SEC_STRTAB = 5,   // NUL-terminated names
+    TINKER_SEC_LINES = 6     // tinker_line[], sorted by addr
+} TinkerSectionType;
+
+struct tinker_section {
+    uint32_t type;
+    uint32_t flags;          // codec when the header has TINKER_V2_COMPRESSED, else 0
+    uint64_t addr;           // guest address (0 for metadata sections)
+    uint64_t offset;         // file offset, a multiple of TINKER_V2_ALIGN
+    uint64_t size;           // bytes in the file (encoded size if compressed)
+    uint64_t mem_size;       // bytes in guest memory (0 for metadata sections)
+    uint64_t reserved;
+};
+
+// One entry per source statement in the code segment
+struct tinker_line {
+    uint64_t addr;
+    uint32_t line;           // 1-based line in the assembler's input
+    uint32_t reserved;
+};
+
+// Relocatable object layout:
+//   tinker_file_header (segment addresses are where the object was assembled)
+//   tinker_obj_header
+//   code segment, data segment
+//   tinker_symbol[sym_count], tinker_reloc[reloc_count], string table
+struct tinker_obj_header {
+    uint64_t sym_count;
+    uint64_t reloc_count;
+    uint64_t strtab_size;
+};
+
+#define TINKER_SYM_DEFINED 0x1
+#define TINKER_SYM_GLOBAL  0x2
+
+struct tinker_symbol {
+    uint32_t name;      // offset into the string table
+    uint32_t flags;
+    uint64_t value;     // address in the object's own layout (0 if undefined)
+};
+
+typedef enum {
+    TINKER_RELOC_LD = 1,     // full 12-instruction ld sequence loading the symbol address
+    TINKER_RELOC_BRR = 2     // brr with a 12-bit byte offset to the symbol
+} TinkerRelocType;
+
+struct tinker_reloc {
+    uint32_t type;
+    uint32_t symbol;    // index into the symbol table
+    uint64_t offset;    // address of the patched site in the object's own layout
+};
+
+// priv literals (sub-codes)
+#define PRIV_HALT 0x0
+#define PRIV_IN   0x3   // priv rd, rs, r0: rd = next u64 from input port rs
+#define PRIV_OUT  0x4   // priv rd, rs, r0: write rs to output port rd
+#define PRIV_INW  0x5   // priv rd, rs, rt: read rt u64s from port rs into memory at rd
+#define PRIV_OUTW 0x6   // priv rd, rs, rt: write the rt u64s at memory rs to port rd
+#define PRIV_OUTS 0x7   // priv rd, rs, rt: write the rt bytes at memory rs to port rd
+#define PRIV_MAPSIZE 0x8   // priv rd, rs, r0: rd = byte size of the file mapped over address rs, or 0
+#define PRIV_MEMCPY 0x9    // priv rd, rs, rt: copy the rt bytes at memory rs to memory rd
+#define PRIV_MEMSET 0xa    // priv rd, rs, rt: set the rt bytes at memory rd to the low byte of rs
+#define PRIV_MEMCMP 0xb    // priv rd, rs, rt: rd = 0, 1 or -1 as the rt bytes at memory rd compare with those at rs
+
 // Operation Codes
 typedef enum {
     // Logic
@@ -32,9 +134,44 @@ typedef enum {
     OP_MUL = 0x1c, OP_DIV = 0x1d,
 
     MACRO_CLR, MACRO_HALT, MACRO_IN, MACRO_OUT, MACRO_LD, MACRO_PUSH, MACRO_POP,
+    MACRO_INW, MACRO_OUTW, MACRO_OUTS, MACRO_MAPSIZE,
+    MACRO_MEMCPY, MACRO_MEMSET, MACRO_MEMCMP,
     OP_UNKNOWN
 } OperationCode;
 
+// Live statistics hw5-sim -S FILE keeps in FILE while the guest runs. The
+// simulator rewrites it in place; another process mmaps it and reads it at any
+// time. seq is odd while an update is under way: read seq, then the fields,
+// then seq again, and retry if the two differ or are odd.
+#define TINKER_STATS_MAGIC 0x5354415453544b54ULL   // "TKTSTATS"
+
+enum {
+    TINKER_CLASS_LOGIC,     // and or xor not
+    TINKER_CLASS_SHIFT,     // shftr shftri shftl shftli
+    TINKER_CLASS_BRANCH,    // br brr brnz brgt call return
+    TINKER_CLASS_PRIV,      // halt, I/O and the other services
+    TINKER_CLASS_LOAD,      // mov rd, (rs)(L)
+    TINKER_CLASS_STORE,     // mov (rd)(L), rs
+    TINKER_CLASS_MOVE,      // mov rd, rs and mov rd, L
+    TINKER_CLASS_FLOAT,     // addf subf mulf divf
+    TINKER_CLASS_INT,       // add addi sub subi mul div
+    TINKER_CLASS_OTHER,     // opcodes the machine does not define
+    TINKER_CLASS_COUNT
+};
+
+struct tinker_stats {
+    uint64_t magic;                 // TINKER_STATS_MAGIC
+    uint64_t seq;
+    uint64_t instructions;          // retired
+    uint64_t classes[TINKER_CLASS_COUNT];
+    uint64_t loads, stores;         // words: mov loads and return, mov stores and call
+    uint64_t words_in, words_out;   // through in/inw and out/outw
+    uint64_t pc;
+    uint64_t stack_depth;           // bytes below the top of guest memory, from r31
+    uint64_t elapsed_ns;
+    uint64_t stopped;               // 1 once the guest has halted or failed
+};
+
 
 
 #endif
\ No newline at end of file
@@ -0,0 +1,27 @@
+#ifndef TINKER_SIZE_H
+#define TINKER_SIZE_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <errno.h>
+
+// Command-line sizes for hw5-asm, hw5-ld and hw5-sim: 524288, 0x100000, 64K,
+// 16M or 1G. Returns 0 on success.
+static inline int tinker_parse_size(const char *s, uint64_t *out) {
+    errno = 0;
+    char *end = NULL;
+    unsigned long long v = strtoull(s, &end, 0);
+    if (errno == ERANGE || end == s || s[0] == '-') return -1;
+
+    int shift = 0;
+    if (*end == 'K' || *end == 'k') shift = 10;
+    else if (*end == 'M' || *end == 'm') shift = 20;
+    else if (*end == 'G' || *end == 'g') shift = 30;
+    if (shift) end++;
+    if (*end != '\0' || v > (UINT64_MAX >> shift)) return -1;
+
+    *out = (uint64_t)v << shift;
+    return 0;
+}
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef TKO_CODEC_H
+#define TKO_CODEC_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+// Segment encodings for compressed v2 .tko sections (tinker_section.flags).
+//
+// TKO_CODEC_LZ: byte-oriented LZ77 in LZ4's sequence layout. Each sequence is
+//   a token (literal length << 4 | match length - 4), extra length bytes for
+//   nibbles of 15, the literals, then a 2-byte little-endian match offset.
+//   The final sequence has literals only.
+// TKO_CODEC_DELTA64: u64 words as differences from the previous word
+//   (starting at 0), zigzag varints. A zero difference is written as a 0 byte
+//   followed by a varint run length, so repeated and zero words cost ~nothing.
+// TKO_CODEC_STRIDE64: as DELTA64, but each word is predicted as the previous
+//   word plus the previous step, so arithmetic progressions become zero runs.
+#define TKO_CODEC_NONE     0
+#define TKO_CODEC_LZ       1
+#define TKO_CODEC_DELTA64  2
+#define TKO_CODEC_STRIDE64 3
+
+// Compress n bytes with the given codec into a malloc'd buffer of *out_size
+// bytes. DELTA64 and STRIDE64 need n to be a multiple of 8. Returns 0, or -1
+// with *out NULL if memory ran out; it never exits.
+int tko_compress(int codec, const uint8_t *src, uint64_t n, uint8_t **out, uint64_t *out_size);
+
+// Pick the smallest of the codecs that apply to this segment. Returns the
+// codec (TKO_CODEC_NONE if nothing beats the raw bytes) and its output in *out,
+// or -1 with *out NULL if memory ran out.
+int tko_compress_best(const uint8_t *src, uint64_t n, int allow_delta, uint8_t **out, uint64_t *out_size);
+
+// Decode in_size bytes from the current position of in straight into dst,
+// which must receive exactly dst_size bytes. Reads through a small fixed
+// buffer, and LZ matches copy from dst itself, so no full-size temporary is
+// needed. Returns 0 on success, -1 on corrupt or truncated input.
+int tko_decompress(FILE *in, uint64_t in_size, int codec, uint8_t *dst, uint64_t dst_size);
+
+#endif
@@ -0,0 +1,390 @@
+#define main hw5_sim_main
+#include "simulator.c"
+#undef main
+
+// hw5-aot: translate a loadable .tko into C that, compiled with the host
+// compiler against src/simulator.c, is a standalone program that behaves as
+// `hw5-sim program.tko` does.
+//
+//   ./hw5-aot program.tko program.c
+//   gcc -O2 -o program program.c src/symbol_table.c src/tko_codec.c -Isrc -Iinclude -lm
+//
+// The program is loaded with the simulator's own loader and its memory image is
+// baked into the output. Code becomes one C function holding the 32 guest
+// registers as locals, with a label per basic block: brr to a known address is a
+// goto, and register targets (br, brr rd, brnz, brgt, call, return) go through a
+// switch over every block start. Blocks end at control transfers and start at
+// their targets, at v2 symbols and at code addresses that ld sequences build.
+//
+// Whatever the translation cannot see statically is left to the interpreter
+// linked into the program: priv runs through execute(), and a jump to an
+// address that starts no block, or a store into code, hands the registers back
+// and finishes the run in run(). Errors go through the same checks and
+// messages as hw5-sim.
+
+#define MAX_CODE_RANGES 64
+
+typedef struct {
+    uint64_t begin, size;
+} CodeRange;
+
+static CodeRange code_ranges[MAX_CODE_RANGES];
+static int code_range_count = 0;
+static uint64_t entry;
+
+// Block starts, one flag per code word
+static bool **leader_maps;
+
+static void aot_error(const char *msg) {
+    fprintf(stderr, "Error: %s\n", msg);
+    exit(1);
+}
+
+static int code_range_of(uint64_t addr) {
+    for (int i = 0; i < code_range_count; i++) {
+        if (addr >= code_ranges[i].begin && addr - code_ranges[i].begin < code_ranges[i].size) return i;
+    }
+    return -1;
+}
+
+static void mark_leader(uint64_t addr) {
+    if (addr & 3) return;
+    int k = code_range_of(addr);
+    if (k >= 0) leader_maps[k][(addr - code_ranges[k].begin) / 4] = true;
+}
+
+static bool is_leader(uint64_t addr) {
+    int k = code_range_of(addr);
+    return k >= 0 && !(addr & 3) && leader_maps[k][(addr - code_ranges[k].begin) / 4];
+}
+
+static void alloc_leader_maps(void) {
+    leader_maps = calloc(code_range_count ? code_range_count : 1, sizeof(bool *));
+    if (!leader_maps) aot_error("Out of memory");
+    for (int k = 0; k < code_range_count; k++) {
+        leader_maps[k] = calloc(code_ranges[k].size / 4 + 1, 1);
+        if (!leader_maps[k]) aot_error("Out of memory");
+    }
+}
+
+static uint32_t instr_at(uint64_t addr) {
+    uint32_t instr;
+    memcpy(&instr, &memory[addr], 4);
+    return instr;
+}
+
+// Code ranges and v2 symbols from the file headers; the contents come from read_binary
+static void read_layout(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f) aot_error("Cannot open input");
+    uint64_t file_type;
+    if (fread(&file_type, 8, 1, f) != 1) aot_error("Invalid header");
+    rewind(f);
+
+    if (file_type == TINKER_EXEC) {
+        struct tinker_file_header h;
+        if (fread(&h, sizeof(h), 1, f) != 1) aot_error("Invalid header");
+        if (h.code_seg_size) code_ranges[code_range_count++] = (CodeRange){ h.code_seg_begin, h.code_seg_size & ~3ULL };
+        alloc_leader_maps();
+        fclose(f);
+        return;
+    }
+
+    struct tinker_v2_header h;
+    if (fread(&h, sizeof(h), 1, f) != 1) aot_error("Invalid header");
+    struct tinker_section sections[64];
+    if (h.section_count > 64 || fseek(f, h.section_table_offset, SEEK_SET) != 0 ||
+        fread(sections, sizeof(struct tinker_section), h.section_count, f) != h.section_count) {
+        aot_error("Invalid header");
+    }
+    for (uint64_t i = 0; i < h.section_count; i++) {
+        if (sections[i].type == TINKER_SEC_CODE && sections[i].mem_size && code_range_count < MAX_CODE_RANGES) {
+            code_ranges[code_range_count++] = (CodeRange){ sections[i].addr, sections[i].mem_size & ~3ULL };
+        }
+    }
+    alloc_leader_maps();
+
+    // Every label is a symbol; the ones in code are likely jump targets
+    for (uint64_t i = 0; i < h.section_count; i++) {
+        if (sections[i].type != TINKER_SEC_SYMTAB) continue;
+        uint64_t n = sections[i].size / sizeof(struct tinker_symbol);
+        struct tinker_symbol *syms = malloc(sections[i].size + 1);
+        if (!syms || fseek(f, sections[i].offset, SEEK_SET) != 0 || fread(syms, sizeof(struct tinker_symbol), n, f) != n) {
+            aot_error("Invalid header");
+        }
+        for (uint64_t j = 0; j < n; j++) mark_leader(syms[j].value);
+        free(syms);
+    }
+    fclose(f);
+}
+
+// Find block starts. Besides branch targets and fall-through points, any constant
+// a register is seen to hold that lands on a code word counts: that is how ld
+// builds the addresses br, brnz, brgt and call jump to. Extra block starts only
+// cost a label, so the constants are tracked loosely, straight down the code.
+static void find_leaders(void) {
+    mark_leader(entry);
+
+    for (int k = 0; k < code_range_count; k++) {
+        bool known[32] = { false };
+        uint64_t value[32];
+        for (uint64_t addr = code_ranges[k].begin; addr < code_ranges[k].begin + code_ranges[k].size; addr += 4) {
+            uint32_t instr = instr_at(addr);
+            int op = (instr >> 27) & 0x1F;
+            int rd = (instr >> 22) & 0x1F;
+            int rs = (instr >> 17) & 0x1F;
+            int rt = (instr >> 12) & 0x1F;
+            uint32_t lit = instr & 0xFFF;
+            int32_t litS = ((int32_t)lit << 20) >> 20;
+
+            switch (op) {
+                case OP_XOR:
+                    known[rd] = (rs == rt);
+                    value[rd] = 0;
+                    break;
+                case OP_ADDI:
+                case OP_SUBI:
+                case OP_SHFTLI:
+                case OP_MOV_L:
+                    if (!known[rd]) break;
+                    if (op == OP_ADDI) value[rd] += lit;
+                    else if (op == OP_SUBI) value[rd] -= lit;
+                    else if (op == OP_SHFTLI) value[rd] = lit < 64 ? value[rd] << lit : 0;
+                    else value[rd] = (value[rd] & ~0xFFFULL) | lit;
+                    break;
+                case OP_MOV_RR:
+                    known[rd] = known[rs];
+                    value[rd] = value[rs];
+                    break;
+                case OP_BRR_L:
+                    mark_leader(addr + litS);
+                    // fall through
+                case OP_BR: case OP_BRR_R: case OP_BRNZ: case OP_CALL: case OP_RET: case OP_BRGT:
+                    mark_leader(addr + 4);
+                    break;
+                case OP_PRIV:
+                    if (lit == PRIV_IN || lit == PRIV_MAPSIZE || lit == PRIV_MEMCMP) known[rd] = false;
+                    break;
+                case OP_MOV_SM:
+                    break;
+                default:
+                    known[rd] = false;
+                    break;
+            }
+            if (known[rd]) mark_leader(value[rd]);
+        }
+    }
+}
+
+// Guest stores into translated code end the translated run
+static void emit_code_check(FILE *out, const char *addr, const char *resume) {
+    fprintf(out, "\t\tif (IN_CODE(%s)) { pc = %s; goto interp; }\n", addr, resume);
+}
+
+static void emit_instr(FILE *out, uint64_t addr) {
+    uint32_t instr = instr_at(addr);
+    int op = (instr >> 27) & 0x1F;
+    int rd = (instr >> 22) & 0x1F;
+    int rs = (instr >> 17) & 0x1F;
+    int rt = (instr >> 12) & 0x1F;
+    uint32_t lit = instr & 0xFFF;
+    int32_t litS = ((int32_t)lit << 20) >> 20;
+    uint64_t next = addr + 4;
+    char resume[32];
+    snprintf(resume, sizeof(resume), "0x%" PRIx64 "ULL", next);
+
+    fprintf(out, "\t/* %06" PRIx64 " */ ", addr);
+    switch (op) {
+        case OP_AND: fprintf(out, "r%d = r%d & r%d;\n", rd, rs, rt); break;
+        case OP_OR: fprintf(out, "r%d = r%d | r%d;\n", rd, rs, rt); break;
+        case OP_XOR: fprintf(out, "r%d = r%d ^ r%d;\n", rd, rs, rt); break;
+        case OP_NOT: fprintf(out, "r%d = ~r%d;\n", rd, rs); break;
+        // Shift counts wrap at 64, as the host shift instruction does in hw5-sim
+        case OP_SHFTR: fprintf(out, "r%d = r%d >> (r%d & 63);\n", rd, rs, rt); break;
+        case OP_SHFTRI: fprintf(out, "r%d = r%d >> %u;\n", rd, rd, lit & 63); break;
+        case OP_SHFTL: fprintf(out, "r%d = r%d << (r%d & 63);\n", rd, rs, rt); break;
+        case OP_SHFTLI: fprintf(out, "r%d = r%d << %u;\n", rd, rd, lit & 63); break;
+
+        case OP_BR: fprintf(out, "pc = r%d; goto dispatch;\n", rd); break;
+        case OP_BRR_R: fprintf(out, "pc = 0x%" PRIx64 "ULL + r%d; goto dispatch;\n", addr, rd); break;
+        case OP_BRR_L: {
+            uint64_t target = addr + litS;
+            if (is_leader(target)) fprintf(out, "goto L_%" PRIx64 ";\n", target);
+            else fprintf(out, "pc = 0x%" PRIx64 "ULL; goto dispatch;\n", target);
+            break;
+        }
+        case OP_BRNZ: fprintf(out, "if (r%d != 0) { pc = r%d; goto dispatch; }\n", rs, rd); break;
+        case OP_CALL:
+            fprintf(out, "{\n\t\tif (r31 < 8) error_exit(\"Simulation error\");\n");
+            fprintf(out, "\t\tcheck8(r31 - 8);\n");
+            fprintf(out, "\t\tuint64_t ret = %s;\n\t\tmemcpy(&memory[r31 - 8], &ret, 8);\n", resume);
+            fprintf(out, "\t\tpc = r%d;\n", rd);
+            fprintf(out, "\t\tif (IN_CODE(r31 - 8)) goto interp;\n");
+            fprintf(out, "\t\tgoto dispatch;\n\t}\n");
+            break;
+        case OP_RET:
+            fprintf(out, "check8(r31 - 8); memcpy(&pc, &memory[r31 - 8], 8); goto dispatch;\n");
+            break;
+        case OP_BRGT: fprintf(out, "if (r%d > r%d) { pc = r%d; goto dispatch; }\n", rs, rt, rd); break;
+        case OP_PRIV:
+            if (lit == PRIV_HALT) {
+                fprintf(out, "halt_program = true; return;\n");
+            } else {
+                fprintf(out, "SYNC_OUT; program_counter = %s; execute(0x%08xU); SYNC_IN;\n", resume, instr);
+                fprintf(out, "\tif (code_written()) { pc = %s; goto interp; }\n", resume);
+            }
+            break;
+
+        case OP_MOV_ML:
+            fprintf(out, "{\n\t\tint64_t a = (int64_t)r%d + %d;\n", rs, litS);
+            fprintf(out, "\t\tif (a < 0 || (uint64_t)a > mem_size - 8) error_exit(\"Simulation error\");\n");
+            fprintf(out, "\t\tmemcpy(&r%d, &memory[a], 8);\n\t}\n", rd);
+            break;
+        case OP_MOV_RR: fprintf(out, "r%d = r%d;\n", rd, rs); break;
+        case OP_MOV_L: fprintf(out, "r%d = (r%d & ~0xFFFULL) | %u;\n", rd, rd, lit); break;
+        case OP_MOV_SM:
+            fprintf(out, "{\n\t\tint64_t a = (int64_t)r%d + %d;\n", rd, litS);
+            fprintf(out, "\t\tif (a < 0) error_exit(\"Simulation error\");\n");
+            fprintf(out, "\t\tcheck8(a);\n\t\tmemcpy(&memory[a], &r%d, 8);\n", rs);
+            emit_code_check(out, "(uint64_t)a", resume);
+            fprintf(out, "\t}\n");
+            break;
+
+        case OP_ADDF: fprintf(out, "r%d = from_double(to_double(r%d) + to_double(r%d));\n", rd, rs, rt); break;
+        case OP_SUBF: fprintf(out, "r%d = from_double(to_double(r%d) - to_double(r%d));\n", rd, rs, rt); break;
+        case OP_MULF: fprintf(out, "r%d = from_double(to_double(r%d) * to_double(r%d));\n", rd, rs, rt); break;
+        case OP_DIVF:
+            fprintf(out, "if (to_double(r%d) == 0.0) error_exit(\"Simulation error\"); ", rt);
+            fprintf(out, "r%d = from_double(to_double(r%d) / to_double(r%d));\n", rd, rs, rt);
+            break;
+
+        case OP_ADD: fprintf(out, "r%d = r%d + r%d;\n", rd, rs, rt); break;
+        case OP_ADDI: fprintf(out, "r%d += %u;\n", rd, lit); break;
+        case OP_SUB: fprintf(out, "r%d = r%d - r%d;\n", rd, rs, rt); break;
+        case OP_SUBI: fprintf(out, "r%d -= %u;\n", rd, lit); break;
+        case OP_MUL: fprintf(out, "r%d = r%d * r%d;\n", rd, rs, rt); break;
+        case OP_DIV:
+            fprintf(out, "if (r%d == 0) error_exit(\"Simulation error\"); r%d = r%d / r%d;\n", rt, rd, rs, rt);
+            break;
+        default:
+            fprintf(out, "/* opcode 0x%x does nothing */\n", op);
+            break;
+    }
+}
+
+static void emit_registers(FILE *out, const char *fmt) {
+    for (int i = 0; i < 32; i++) {
+        fprintf(out, fmt, i, i);
+        fputs(i % 8 == 7 ? " \\\n" : " ", out);
+    }
+}
+
+static void emit(FILE *out, const char *source) {
+    fprintf(out, "// Generated by hw5-aot from %s; compile against src/simulator.c\n", source);
+    fprintf(out, "#define main hw5_sim_main\n#include \"simulator.c\"\n#undef main\n\n");
+
+    fprintf(out, "#define SYNC_OUT do { \\\n");
+    emit_registers(out, "registers[%d] = r%d;");
+    fprintf(out, "} while (0)\n#define SYNC_IN do { \\\n");
+    emit_registers(out, "r%d = registers[%d];");
+    fprintf(out, "} while (0)\n\n");
+
+    fprintf(out, "#define IN_CODE(a) (");
+    for (int k = 0; k < code_range_count; k++) {
+        fprintf(out, "%s(a) - 0x%" PRIx64 "ULL < 0x%" PRIx64 "ULL", k ? " || " : "", code_ranges[k].begin, code_ranges[k].size);
+    }
+    fprintf(out, "%s)\n\n", code_range_count ? "" : "false");
+
+    fprintf(out, "static inline double to_double(uint64_t u) { double d; memcpy(&d, &u, 8); return d; }\n");
+    fprintf(out, "static inline uint64_t from_double(double d) { uint64_t u; memcpy(&u, &d, 8); return u; }\n\n");
+
+    // priv services that write memory mark the pages; any in code ends translation
+    fprintf(out, "static bool code_written(void) {\n");
+    for (int k = 0; k < code_range_count; k++) {
+        fprintf(out, "\tfor (uint64_t a = 0x%" PRIx64 "ULL; a < 0x%" PRIx64 "ULL; a += 1ULL << DIRTY_PAGE_SHIFT) {\n",
+                code_ranges[k].begin & ~(uint64_t)((1 << DIRTY_PAGE_SHIFT) - 1), code_ranges[k].begin + code_ranges[k].size);
+        fprintf(out, "\t\tuint64_t page = a >> DIRTY_PAGE_SHIFT;\n");
+        fprintf(out, "\t\tif (dirty_pages[page >> 6] & (1ULL << (page & 63))) return true;\n\t}\n");
+    }
+    fprintf(out, "\treturn false;\n}\n\n");
+
+    // Nonzero pages of the loaded image
+    fprintf(out, "static const struct { uint64_t addr; uint64_t words[%d]; } image[] = {\n", IMAGE_PAGE / 8);
+    uint64_t pages = 0;
+    for (uint64_t addr = 0; addr < mem_size; addr += IMAGE_PAGE) {
+        if (page_is_zero(addr)) continue;
+        fprintf(out, "\t{ 0x%" PRIx64 "ULL, {", addr);
+        uint64_t n = page_bytes(addr) / 8;
+        for (uint64_t i = 0; i < n; i++) {
+            uint64_t w;
+            memcpy(&w, &memory[addr + 8 * i], 8);
+            if (i % 8 == 0) fputs("\n\t\t", out);
+            if (w) fprintf(out, "0x%" PRIx64 "ULL,", w);
+            else fputs("0,", out);
+        }
+        fprintf(out, " } },\n");
+        pages++;
+    }
+    if (pages == 0) fprintf(out, "\t{ 0, { 0 } },\n");
+    fprintf(out, "};\n\n");
+
+    fprintf(out, "static void guest(void) {\n");
+    fprintf(out, "\tuint64_t r0 = registers[0]");
+    for (int i = 1; i < 32; i++) fprintf(out, ", r%d = registers[%d]", i, i);
+    fprintf(out, ";\n\tuint64_t pc = program_counter;\n\tgoto dispatch;\n\n");
+
+    for (int k = 0; k < code_range_count; k++) {
+        uint64_t end = code_ranges[k].begin + code_ranges[k].size;
+        for (uint64_t addr = code_ranges[k].begin; addr < end; addr += 4) {
+            if (is_leader(addr)) fprintf(out, "L_%" PRIx64 ":\n", addr);
+            emit_instr(out, addr);
+        }
+        // Running off the end of a code range
+        fprintf(out, "\tpc = 0x%" PRIx64 "ULL; goto dispatch;\n\n", end);
+    }
+
+    fprintf(out, "dispatch:\n\tswitch (pc) {\n");
+    for (int k = 0; k < code_range_count; k++) {
+        for (uint64_t addr = code_ranges[k].begin; addr < code_ranges[k].begin + code_ranges[k].size; addr += 4) {
+            if (is_leader(addr)) fprintf(out, "\t\tcase 0x%" PRIx64 "ULL: goto L_%" PRIx64 ";\n", addr, addr);
+        }
+    }
+    fprintf(out, "\t\tdefault: goto interp;\n\t}\n\n");
+    fprintf(out, "interp:\n\tSYNC_OUT;\n\tprogram_counter = pc;\n\trun();\n}\n\n");
+
+    fprintf(out, "int main(int argc, char **argv) {\n");
+    fprintf(out, "\tif (argc > 1) {\n\t\tfprintf(stderr, \"Usage: %%s (the program and its memory are built in)\\n\", argv[0]);\n\t\treturn 1;\n\t}\n");
+    fprintf(out, "\tset_memory_size(0x%" PRIx64 "ULL);\n\treset();\n", mem_size);
+    if (pages) {
+        fprintf(out, "\tfor (size_t i = 0; i < sizeof(image) / sizeof(image[0]); i++) {\n");
+        fprintf(out, "\t\tuint64_t n = mem_size - image[i].addr < %d ? mem_size - image[i].addr : %d;\n", IMAGE_PAGE, IMAGE_PAGE);
+        fprintf(out, "\t\tmemcpy(&memory[image[i].addr], image[i].words, n);\n\t}\n");
+    }
+    fprintf(out, "\tmemory_pristine = false;\n\tclear_dirty_pages();\n");
+    fprintf(out, "\tprogram_counter = 0x%" PRIx64 "ULL;\n\tguest();\n\treturn 0;\n}\n", entry);
+}
+
+int main(int argc, char **argv) {
+    int argi = 1;
+    if (argc - argi >= 2 && strcmp(argv[argi], "-m") == 0) {
+        requested_mem_size = parse_mem_size(argv[argi + 1]);
+        argi += 2;
+    }
+    if (argc - argi != 2) {
+        fprintf(stderr, "Usage: %s [-m SIZE] <input.tko> <output.c>\n", argv[0]);
+        return 1;
+    }
+    const char *dot = strrchr(argv[argi], '.');
+    if (!dot || strcmp(dot, ".tko") != 0) aot_error("Input must be a .tko file");
+
+    read_layout(argv[argi]);
+    read_binary(argv[argi]);
+    entry = program_counter;
+    find_leaders();
+
+    FILE *out = fopen(argv[argi + 1], "w");
+    if (!out) aot_error("Cannot open output");
+    emit(out, argv[argi]);
+    if (fclose(out) != 0) aot_error("Write failed");
+    return 0;
+}
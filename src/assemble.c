@@ -0,0 +1,1681 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <setjmp.h>
+#include "tinker_defs.h"
+#include "symbol_table.h"
+#include "tko_codec.h"
+#include "assembler.h"
+#include "assemble.h"
+
+// A file .incbin named, read once through AsmOptions.read_file
+typedef struct {
+    char path[MAX_LINE];
+    uint8_t *data;
+    size_t size;
+} IncFile;
+
+// Growable bytes with a write position, standing in for the output file:
+// writes past the end leave zeros in the gap, as a seek past EOF does
+typedef struct {
+    uint8_t *data;
+    uint64_t size, cap, pos;
+} OutBuf;
+
+// The data segment as runs of initialized and zero bytes, in address order.
+// v2 files store zero runs as bss sections that take no file space.
+typedef struct {
+    uint64_t addr, size;
+    bool zero;
+    uint64_t file_offset;   // v2 only, for initialized runs
+} DataPiece;
+
+// One ld in the code segment: its operand text and the bytes reserved for it
+typedef struct {
+    char operand[MAX_LABEL];
+    int size;
+} LdSlot;
+
+// Where each source statement's expansion starts in the listing, so an error
+// pass_two finds there is reported at the source line
+typedef struct {
+    uint64_t offset;
+    int line;
+} ListingLine;
+
+// Everything one assemble() call works on. Errors longjmp to fail with the
+// message and the line being worked on, so no helper exits or returns a status.
+typedef struct {
+    AsmOptions opts;
+    jmp_buf fail;
+    int lineno;
+    char error[160];
+
+    // Segment layout (-Tcode=ADDR, -Tdata=ADDR|after) and guest memory size (-m SIZE)
+    uint64_t layout_code_begin, layout_data_begin;
+    bool layout_data_after;
+    uint64_t guest_mem_size;
+
+    // v2 executables (hw5-asm -v2): section table, symbols and a line map
+    bool v2_mode, compress_mode;
+    struct tinker_line *line_map;
+    size_t line_map_count, line_map_cap;
+
+    // Relocatable object output (hw5-asm -c)
+    bool object_mode;
+    SymbolTable *symbols;       // labels, pass_one to pass_two
+    SymbolTable *obj_globals;   // names declared with .global
+    SymbolTable *obj_index;     // symbol name -> index into obj_syms
+    struct tinker_symbol *obj_syms;
+    size_t obj_sym_count, obj_sym_cap;
+    struct tinker_reloc *obj_relocs;
+    size_t obj_reloc_count, obj_reloc_cap;
+    char *obj_strtab;
+    size_t obj_strtab_size, obj_strtab_cap;
+
+    LdSlot *ld_slots;
+    size_t ld_count, ld_cap;
+
+    DataPiece *data_pieces;
+    size_t data_piece_count, data_piece_cap;
+
+    IncFile *files;
+    size_t file_count, file_cap;
+
+    FILE *listing_file;            // open while pass_one writes it
+    char *listing;                 // pass_one's output, pass_two's input
+    size_t listing_size;
+    ListingLine *listing_lines;
+    size_t listing_line_count, listing_line_cap;
+
+    OutBuf out;
+} Asm;
+
+static void asm_fail(Asm *as, const char *msg) {
+    snprintf(as->error, sizeof(as->error), "%s", msg);
+    longjmp(as->fail, 1);
+}
+
+static void *asm_grow(Asm *as, void *p, size_t *cap, size_t min_cap, size_t elem) {
+    if (*cap) {
+        *cap *= 2;
+    } else {
+        *cap = min_cap;
+    }
+    p = realloc(p, *cap * elem);
+    if (!p) asm_fail(as, "Out of memory");
+    return p;
+}
+
+static void line_map_add(Asm *as, uint64_t addr, int lineno) {
+    if (as->line_map_count == as->line_map_cap) {
+        as->line_map = asm_grow(as, as->line_map, &as->line_map_cap, 256, sizeof(struct tinker_line));
+    }
+    struct tinker_line *l = &as->line_map[as->line_map_count++];
+    const int *origin = as->opts.line_origin;
+    l->addr = addr;
+    l->line = (uint32_t)((origin && lineno <= as->opts.line_origin_count) ? origin[lineno - 1] : lineno);
+    l->reserved = 0;
+}
+
+// The source line the user sees for line n of src
+static int source_line(const Asm *as, int n) {
+    const int *origin = as->opts.line_origin;
+    return (origin && n >= 1 && n <= as->opts.line_origin_count) ? origin[n - 1] : n;
+}
+
+static void out_reserve(Asm *as, uint64_t size) {
+    if (size <= as->out.cap) return;
+    uint64_t cap = as->out.cap ? as->out.cap : 4096;
+    while (cap < size) cap *= 2;
+    uint8_t *data = realloc(as->out.data, cap);
+    if (!data) asm_fail(as, "Out of memory");
+    memset(data + as->out.cap, 0, cap - as->out.cap);
+    as->out.data = data;
+    as->out.cap = cap;
+}
+
+static void out_seek(Asm *as, uint64_t pos) {
+    as->out.pos = pos;
+}
+
+static void out_write(Asm *as, const void *src, uint64_t n) {
+    out_reserve(as, as->out.pos + n);
+    memcpy(as->out.data + as->out.pos, src, n);
+    as->out.pos += n;
+    if (as->out.pos > as->out.size) as->out.size = as->out.pos;
+}
+
+// The next line of text[0..len) from *pos, as fgets would give it: through the
+// newline, or cap - 1 bytes of a longer line
+static bool next_line(const char *text, size_t len, size_t *pos, char *line, size_t cap) {
+    if (*pos >= len) return false;
+    size_t n = len - *pos < cap - 1 ? len - *pos : cap - 1;
+    const char *nl = memchr(text + *pos, '\n', n);
+    if (nl) n = (size_t)(nl - (text + *pos)) + 1;
+    memcpy(line, text + *pos, n);
+    line[n] = '\0';
+    *pos += n;
+    return true;
+}
+
+// Note that what pass_one writes next expands the current source line
+static void listing_mark(Asm *as, FILE *out) {
+    if (as->listing_line_count == as->listing_line_cap) {
+        as->listing_lines = asm_grow(as, as->listing_lines, &as->listing_line_cap, 256, sizeof(ListingLine));
+    }
+    as->listing_lines[as->listing_line_count].offset = (uint64_t)ftell(out);
+    as->listing_lines[as->listing_line_count].line = as->lineno;
+    as->listing_line_count++;
+}
+
+// Index of a symbol in the object, adding it as an undefined import if new
+static uint32_t obj_symbol(Asm *as, const char *name) {
+    char key[MAX_LABEL];
+    snprintf(key, sizeof(key), "%s", name);
+    uint64_t idx = lookup_label(as->obj_index, key);
+    if (idx != (uint64_t)-1) return (uint32_t)idx;
+
+    size_t len = strlen(key) + 1;
+    if (as->obj_strtab_size + len > as->obj_strtab_cap) {
+        as->obj_strtab_cap = (as->obj_strtab_cap + len) * 2;
+        as->obj_strtab = realloc(as->obj_strtab, as->obj_strtab_cap);
+        if (!as->obj_strtab) asm_fail(as, "Out of memory");
+    }
+    if (as->obj_sym_count == as->obj_sym_cap) {
+        as->obj_syms = asm_grow(as, as->obj_syms, &as->obj_sym_cap, 64, sizeof(struct tinker_symbol));
+    }
+
+    struct tinker_symbol *sym = &as->obj_syms[as->obj_sym_count];
+    sym->name = (uint32_t)as->obj_strtab_size;
+    sym->flags = TINKER_SYM_GLOBAL;
+    sym->value = 0;
+    memcpy(as->obj_strtab + as->obj_strtab_size, key, len);
+    as->obj_strtab_size += len;
+
+    insert_label(as->obj_index, key, as->obj_sym_count);
+    return (uint32_t)as->obj_sym_count++;
+}
+
+static void obj_reloc(Asm *as, uint32_t type, const char *name, uint64_t offset) {
+    if (as->obj_reloc_count == as->obj_reloc_cap) {
+        as->obj_relocs = asm_grow(as, as->obj_relocs, &as->obj_reloc_cap, 64, sizeof(struct tinker_reloc));
+    }
+    struct tinker_reloc *r = &as->obj_relocs[as->obj_reloc_count];
+    r->type = type;
+    r->symbol = obj_symbol(as, name);
+    r->offset = offset;
+    as->obj_reloc_count++;
+}
+
+// Record every label defined in this file; .global ones are visible to other objects
+static void obj_define_symbols(Asm *as, SymbolTable *t) {
+    for (unsigned long i = 0; i < t->bucket_count; i++) {
+        for (SymbolEntry *e = t->buckets[i]; e != NULL; e = e->next) {
+            uint32_t idx = obj_symbol(as, e->label_name);
+            struct tinker_symbol *sym = &as->obj_syms[idx];
+            sym->flags = TINKER_SYM_DEFINED;
+            if (lookup_label(as->obj_globals, e->label_name) != (uint64_t)-1) sym->flags |= TINKER_SYM_GLOBAL;
+            sym->value = e->address;
+        }
+    }
+    as->lineno = 0;
+    for (unsigned long i = 0; i < as->obj_globals->bucket_count; i++) {
+        for (SymbolEntry *e = as->obj_globals->buckets[i]; e != NULL; e = e->next) {
+            if (lookup_label(t, e->label_name) == (uint64_t)-1) asm_fail(as, "Global label not defined");
+        }
+    }
+}
+
+void trim_line(char *line) {
+    char *p = strchr(line, ';');
+    if (p) *p = '\0';
+
+    size_t n = strlen(line);
+    if (n == 0) return;
+
+    p = line + n - 1;
+    while (p >= line && isspace((unsigned char)*p)) {
+        *p = '\0';
+        if (p == line) break;
+        p--;
+    }
+}
+
+static int line_has_non_ws(const char *s) {
+    for (int i = 0; s[i]; i++) {
+        if (!isspace((unsigned char)s[i])) return 1;
+    }
+    return 0;
+}
+
+static void enforce_leading_space_rule(Asm *as, const char *raw_line) {
+    if (raw_line && raw_line[0] == ' ') {
+        asm_fail(as, "Leading spaces are invalid (line must start with tab for statements)");
+    }
+}
+
+static void enforce_tab_rule_if_statement(Asm *as, const char *raw_line, const char *ptr_trimmed) {
+    if (!ptr_trimmed || *ptr_trimmed == '\0') return;
+    if (strncmp(ptr_trimmed, ".code", 5) == 0) return;
+    if (strncmp(ptr_trimmed, ".data", 5) == 0) return;
+    if (*ptr_trimmed == ':') return;
+
+    if (raw_line[0] != '\t') {
+        asm_fail(as, "Statement line must begin with a tab");
+    }
+}
+
+static int is_valid_label_name(const char *s) {
+    if (!s || !*s) return 0;
+    if (!(isalpha((unsigned char)s[0]) || s[0] == '_')) return 0;
+    for (int i = 1; s[i]; i++) {
+        if (!(isalnum((unsigned char)s[i]) || s[i] == '_')) return 0;
+    }
+    return 1;
+}
+
+static void enforce_label_only(Asm *as, const char *ptr) {
+    const char *p = ptr + 1;
+
+    // skip label token
+    if (!(isalpha((unsigned char)*p) || *p == '_')) asm_fail(as, "Invalid label name");
+    p++;
+    while (isalnum((unsigned char)*p) || *p == '_') p++;
+
+    // after label, only whitespace allowed
+    while (*p) {
+        if (!isspace((unsigned char)*p)) asm_fail(as, "Label must be alone on its line");
+        p++;
+    }
+}
+
+int parse_register(const char *reg) {
+    if (!reg || reg[0] != 'r') return -1;
+    if (!isdigit((unsigned char)reg[1])) return -1;
+
+    int val = 0;
+    for (int i = 1; reg[i]; i++) {
+        if (!isdigit((unsigned char)reg[i])) return -1;
+        val = val * 10 + (reg[i] - '0');
+        if (val > 31) return -1;
+    }
+    return val;
+}
+
+int get_opcode(char *mnem) {
+    if (!strcmp(mnem, "add")) return OP_ADD;
+    if (!strcmp(mnem, "addi")) return OP_ADDI;
+    if (!strcmp(mnem, "addf")) return OP_ADDF;
+    if (!strcmp(mnem, "sub")) return OP_SUB;
+    if (!strcmp(mnem, "subi")) return OP_SUBI;
+    if (!strcmp(mnem, "subf")) return OP_SUBF;
+    if (!strcmp(mnem, "mul")) return OP_MUL;
+    if (!strcmp(mnem, "mulf")) return OP_MULF;
+    if (!strcmp(mnem, "div")) return OP_DIV;
+    if (!strcmp(mnem, "divf")) return OP_DIVF;
+    if (!strcmp(mnem, "and")) return OP_AND;
+    if (!strcmp(mnem, "or")) return OP_OR;
+    if (!strcmp(mnem, "xor")) return OP_XOR;
+    if (!strcmp(mnem, "not")) return OP_NOT;
+    if (!strcmp(mnem, "shftr")) return OP_SHFTR;
+    if (!strcmp(mnem, "shftri")) return OP_SHFTRI;
+    if (!strcmp(mnem, "shftl")) return OP_SHFTL;
+    if (!strcmp(mnem, "shftli")) return OP_SHFTLI;
+    if (!strcmp(mnem, "br")) return OP_BR;
+    if (!strcmp(mnem, "brr")) return OP_BRR_L; // check arg later
+    if (!strcmp(mnem, "brnz")) return OP_BRNZ;
+    if (!strcmp(mnem, "call")) return OP_CALL;
+    if (!strcmp(mnem, "return") || !strcmp(mnem, "ret")) return OP_RET;
+    if (!strcmp(mnem, "brgt")) return OP_BRGT;
+    if (!strcmp(mnem, "priv")) return OP_PRIV;
+    if (!strcmp(mnem, "mov")) return OP_MOV_RR;
+
+    if (!strcmp(mnem, "clr")) return MACRO_CLR;
+    if (!strcmp(mnem, "halt")) return MACRO_HALT;
+    if (!strcmp(mnem, "in")) return MACRO_IN;
+    if (!strcmp(mnem, "out")) return MACRO_OUT;
+    if (!strcmp(mnem, "ld")) return MACRO_LD;
+    if (!strcmp(mnem, "push")) return MACRO_PUSH;
+    if (!strcmp(mnem, "pop")) return MACRO_POP;
+    if (!strcmp(mnem, "inw")) return MACRO_INW;
+    if (!strcmp(mnem, "outw")) return MACRO_OUTW;
+    if (!strcmp(mnem, "outs")) return MACRO_OUTS;
+    if (!strcmp(mnem, "mapsize")) return MACRO_MAPSIZE;
+    if (!strcmp(mnem, "memcpy")) return MACRO_MEMCPY;
+    if (!strcmp(mnem, "memset")) return MACRO_MEMSET;
+    if (!strcmp(mnem, "memcmp")) return MACRO_MEMCMP;
+
+    return OP_UNKNOWN;
+}
+
+int resolve_value(char *token, SymbolTable *t, int64_t *out_val) {
+    size_t n = strlen(token);
+    while (n && isspace((unsigned char)token[n-1])) token[--n] = '\0';
+    if (n && (token[n-1] == 'u' || token[n-1] == 'U')) {
+        token[n-1] = '\0';
+        n--;
+    }
+
+    if (token[0] == ':') {
+        if (!t) return 1;
+        if (!is_valid_label_name(token + 1)) return 1;
+        int64_t addr = lookup_label(t, token + 1);
+        if (addr == -1) return 1;
+        *out_val = addr;
+        return 0;
+    }
+    char *end;
+    errno = 0;
+    *out_val = strtoll(token, &end, 0);
+    if (errno != 0) return 1;
+    if (*end != '\0') return 1;
+    return 0;
+}
+
+static int resolve_u64_decimal(char *token, SymbolTable *t, uint64_t *out) {
+    size_t n = strlen(token);
+    while (n && isspace((unsigned char)token[n-1])) token[--n] = '\0';
+
+    if (token[0] == '-') return 1;
+
+    if (token[0] == ':') {
+        if (!t) return 1;
+        if (!is_valid_label_name(token + 1)) return 1;
+        int64_t addr = lookup_label(t, token + 1);
+        if (addr == -1) return 1;
+        *out = (uint64_t)addr;
+        return 0;
+    }
+
+    char *end = NULL;
+    errno = 0;
+    unsigned long long v = strtoull(token, &end, 10);
+    if (errno == ERANGE) return 1;
+    if (!end || *end != '\0') return 1;
+    *out = (uint64_t)v;
+    return 0;
+}
+
+static int parse_int64_strict(const char *s, int64_t *out) {
+    if (!s || !*s) return 1;
+    char *end = NULL;
+    errno = 0;
+    long long v = strtoll(s, &end, 10);
+    if (errno != 0) return 1;
+    if (!end || *end != '\0') return 1;
+    *out = (int64_t)v;
+    return 0;
+}
+
+static void check_bounds_signed(Asm *as, int64_t v, int bits, const char *msg) {
+    if (bits <= 0 || bits >= 63) return;
+    int64_t max =  (1LL << (bits - 1)) - 1;
+    int64_t min = -(1LL << (bits - 1));
+    if (v < min || v > max) asm_fail(as, msg);
+}
+
+static void check_bounds_unsigned(Asm *as, int64_t v, int bits, const char *msg) {
+    if (bits <= 0 || bits >= 63) return;
+    if (v < 0) asm_fail(as, msg);
+    uint64_t max = (bits == 64) ? ~0ULL : ((1ULL << bits) - 1ULL);
+    if ((uint64_t)v > max) asm_fail(as, msg);
+}
+
+static int parse_mem_operand(const char *s, int *base_reg, int64_t *lit, SymbolTable *t);
+
+#define LD_MAX_INSTRS 12
+
+// Plan the shortest xor/addi/shftli sequence that builds L.
+// While building, the register holds L >> p; rest[p] is the fewest instructions left to reach p = 0.
+// Ties go to the widest chunk first, which keeps the classic 12/12/12/12/12/4 split for full values.
+// The sequence is: xor, addi (L >> *top) if nonzero, then for each step i a
+// shftli shifts[i] followed by addi adds[i] if nonzero. Returns the number of steps.
+static int plan_ld(uint64_t L, int *top, int shifts[LD_MAX_INSTRS], uint64_t adds[LD_MAX_INSTRS]) {
+    int rest[64], next[64];
+
+    rest[0] = 0;
+    for (int p = 1; p < 64; p++) {
+        rest[p] = 1000;
+        for (int q = 0; q < p; q++) {
+            uint64_t chunk = (L >> q) & ((1ULL << (p - q)) - 1);
+            if (chunk > 0xFFF) continue;
+            int cost = 1 + (chunk != 0) + rest[q];
+            if (cost < rest[p]) {
+                rest[p] = cost;
+                next[p] = q;
+            }
+        }
+    }
+
+    int best = 1000;
+    for (int p = 0; p < 64; p++) {
+        if ((L >> p) > 0xFFF) continue;
+        int cost = 1 + ((L >> p) != 0) + rest[p];
+        if (cost < best) {
+            best = cost;
+            *top = p;
+        }
+    }
+
+    int steps = 0;
+    for (int p = *top; p > 0; p = next[p]) {
+        int q = next[p];
+        shifts[steps] = p - q;
+        adds[steps] = (L >> q) & ((1ULL << (p - q)) - 1);
+        steps++;
+    }
+    return steps;
+}
+
+// Size in bytes of the shortest ld expansion for L
+static int ld_size(uint64_t L) {
+    int top;
+    int shifts[LD_MAX_INSTRS];
+    uint64_t adds[LD_MAX_INSTRS];
+    int steps = plan_ld(L, &top, shifts, adds);
+
+    int n = ((L >> top) != 0) ? 2 : 1;
+    for (int i = 0; i < steps; i++) n += (adds[i] != 0) ? 2 : 1;
+    return n * 4;
+}
+
+// Write the ld expansion, padded with `addi rd, 0` up to reserved bytes
+static void write_ld(FILE *out, const char *rd, uint64_t L, int reserved) {
+    int top;
+    int shifts[LD_MAX_INSTRS];
+    uint64_t adds[LD_MAX_INSTRS];
+    int steps = plan_ld(L, &top, shifts, adds);
+    int written = 4;
+
+    fprintf(out, "\txor %s, %s, %s\n", rd, rd, rd);
+    if ((L >> top) != 0) {
+        fprintf(out, "\taddi %s, %lu\n", rd, (unsigned long)(L >> top));
+        written += 4;
+    }
+    for (int i = 0; i < steps; i++) {
+        fprintf(out, "\tshftli %s, %d\n", rd, shifts[i]);
+        written += 4;
+        if (adds[i] != 0) {
+            fprintf(out, "\taddi %s, %lu\n", rd, (unsigned long)adds[i]);
+            written += 4;
+        }
+    }
+    for (; written < reserved; written += 4) {
+        fprintf(out, "\taddi %s, 0\n", rd);
+    }
+}
+
+// Fixed 12-instruction ld that hw5-ld patches in place (TINKER_RELOC_LD)
+static void write_ld_full(FILE *out, const char *rd, uint64_t L) {
+    fprintf(out, "\txor %s, %s, %s\n", rd, rd, rd);
+    fprintf(out, "\taddi %s, %lu\n", rd, (unsigned long)((L >> 52) & 0xFFF));
+
+    fprintf(out, "\tshftli %s, 12\n", rd);
+    fprintf(out, "\taddi %s, %lu\n", rd, (unsigned long)((L >> 40) & 0xFFF));
+
+    fprintf(out, "\tshftli %s, 12\n", rd);
+    fprintf(out, "\taddi %s, %lu\n", rd, (unsigned long)((L >> 28) & 0xFFF));
+
+    fprintf(out, "\tshftli %s, 12\n", rd);
+    fprintf(out, "\taddi %s, %lu\n", rd, (unsigned long)((L >> 16) & 0xFFF));
+
+    fprintf(out, "\tshftli %s, 12\n", rd);
+    fprintf(out, "\taddi %s, %lu\n", rd, (unsigned long)((L >> 4) & 0xFFF));
+
+    fprintf(out, "\tshftli %s, 4\n", rd);
+    fprintf(out, "\taddi %s, %lu\n", rd, (unsigned long)(L & 0xF));
+}
+
+// Data directives: `.zero N` and `.space N` reserve N zero bytes, `.fill N, value`
+// repeats a u64 N times, and `.incbin "file"[, offset[, length]]` copies raw bytes
+// from a file, zero-padded to a multiple of 8 so data words remain aligned.
+enum { DATA_WORD, DATA_ZERO, DATA_FILL, DATA_INCBIN };
+
+typedef struct {
+    uint64_t bytes;            // data segment bytes the statement takes
+    char value[MAX_LABEL];     // .fill value
+    char path[MAX_LINE];       // .incbin file, relative paths resolved against the source's directory
+    uint64_t offset, length;   // .incbin byte range
+} DataDirective;
+
+// `"file"[, offset[, length]]`; a missing length means "to the end of the file"
+static int parse_incbin(const char *args, char *path, uint64_t *offset, uint64_t *length, bool *has_length) {
+    while (isspace((unsigned char)*args)) args++;
+    if (*args++ != '"') return -1;
+    const char *close = strchr(args, '"');
+    if (!close || close == args || (size_t)(close - args) >= MAX_LINE) return -1;
+    memcpy(path, args, close - args);
+    path[close - args] = '\0';
+
+    *offset = 0;
+    *has_length = false;
+    char first[64], second[64], extra;
+    int n = sscanf(close + 1, " , %63[^, \t] , %63[^, \t] %c", first, second, &extra);
+    if (n <= 0) {
+        const char *rest = close + 1;
+        while (isspace((unsigned char)*rest)) rest++;
+        return *rest == '\0' ? 0 : -1;
+    }
+    if (n > 2) return -1;
+
+    int64_t v;
+    if (parse_int64_strict(first, &v) != 0 || v < 0) return -1;
+    *offset = (uint64_t)v;
+    if (n == 2) {
+        if (parse_int64_strict(second, &v) != 0 || v < 0) return -1;
+        *length = (uint64_t)v;
+        *has_length = true;
+    }
+    return 0;
+}
+
+// The bytes of an .incbin file, read on first use
+static const IncFile *incbin_file(Asm *as, const char *path) {
+    for (size_t i = 0; i < as->file_count; i++) {
+        if (strcmp(as->files[i].path, path) == 0) return &as->files[i];
+    }
+    if (!as->opts.read_file) asm_fail(as, ".incbin is not available without a file reader");
+    if (as->file_count == as->file_cap) as->files = asm_grow(as, as->files, &as->file_cap, 4, sizeof(IncFile));
+    IncFile *f = &as->files[as->file_count];
+    snprintf(f->path, sizeof(f->path), "%s", path);
+    f->data = NULL;
+    if (as->opts.read_file(as->opts.read_file_ctx, path, &f->data, &f->size) != 0) asm_fail(as, "Cannot open .incbin file");
+    as->file_count++;
+    return f;
+}
+
+static int data_directive(Asm *as, const char *ptr, DataDirective *d) {
+    char name[16], count[64];
+    if (*ptr != '.') return DATA_WORD;
+
+    if (strncmp(ptr, ".incbin", 7) == 0 && (ptr[7] == '\0' || isspace((unsigned char)ptr[7]))) {
+        char rel[MAX_LINE];
+        bool has_length;
+        if (parse_incbin(ptr + 7, rel, &d->offset, &d->length, &has_length) != 0) {
+            asm_fail(as, ".incbin takes \"file\"[, offset[, length]]");
+        }
+        const char *dir = as->opts.base_dir ? as->opts.base_dir : ".";
+        if (rel[0] == '/') snprintf(d->path, sizeof(d->path), "%s", rel);
+        else if (snprintf(d->path, sizeof(d->path), "%s/%s", dir, rel) >= (int)sizeof(d->path)) asm_fail(as, "Invalid .incbin path");
+
+        uint64_t size = incbin_file(as, d->path)->size;
+        if (d->offset > size) asm_fail(as, "Invalid .incbin offset");
+        if (!has_length) d->length = size - d->offset;
+        if (d->length == 0 || d->length > size - d->offset) asm_fail(as, "Invalid .incbin length");
+        d->bytes = (d->length + 7) & ~(uint64_t)7;
+        return DATA_INCBIN;
+    }
+
+    int n = sscanf(ptr, "%15s %63[^, \t] , %256s", name, count, d->value);
+    bool zero = strcmp(name, ".zero") == 0 || strcmp(name, ".space") == 0;
+    if (!zero && strcmp(name, ".fill") != 0) asm_fail(as, "Unknown data directive");
+    if (n != (zero ? 2 : 3)) asm_fail(as, zero ? "Directive takes a size" : ".fill takes a count and a value");
+
+    int64_t v;
+    if (parse_int64_strict(count, &v) != 0 || v <= 0) asm_fail(as, "Invalid directive size");
+    if (zero) {
+        if (v % 8 != 0) asm_fail(as, "Directive size must be a multiple of 8");
+        d->bytes = (uint64_t)v;
+        return DATA_ZERO;
+    }
+    if ((uint64_t)v > UINT64_MAX / 8) asm_fail(as, "Invalid directive size");
+    d->bytes = (uint64_t)v * 8;
+    return DATA_FILL;
+}
+
+// Zero runs shorter than this stay in the file rather than costing a section each
+#define BSS_MIN_BYTES 256
+
+static void data_piece_add(Asm *as, uint64_t addr, uint64_t size, bool zero) {
+    if (size == 0) return;
+    if (as->data_piece_count > 0) {
+        DataPiece *last = &as->data_pieces[as->data_piece_count - 1];
+        if (last->zero == zero && last->addr + last->size == addr) {
+            last->size += size;
+            return;
+        }
+    }
+    if (as->data_piece_count == as->data_piece_cap) {
+        as->data_pieces = asm_grow(as, as->data_pieces, &as->data_piece_cap, 16, sizeof(DataPiece));
+    }
+    as->data_pieces[as->data_piece_count++] = (DataPiece){ addr, size, zero, 0 };
+}
+
+// Fold short zero runs into their neighbours, leaving only runs worth a bss section
+static void merge_short_zero_pieces(Asm *as) {
+    DataPiece *pieces = as->data_pieces;
+    size_t n = 0;
+    for (size_t i = 0; i < as->data_piece_count; i++) {
+        DataPiece p = pieces[i];
+        if (p.zero && p.size < BSS_MIN_BYTES) p.zero = false;
+        if (n > 0 && pieces[n - 1].zero == p.zero && pieces[n - 1].addr + pieces[n - 1].size == p.addr) {
+            pieces[n - 1].size += p.size;
+        } else {
+            pieces[n++] = p;
+        }
+    }
+    as->data_piece_count = n;
+}
+
+// Objects are placed by hw5-ld, so only executables are checked here
+static void check_layout(Asm *as, const struct tinker_file_header *h) {
+    uint64_t mem = as->guest_mem_size ? as->guest_mem_size : TINKER_DEFAULT_MEM_SIZE;
+    as->lineno = 0;
+    if (h->code_seg_size > 0 && h->data_seg_size > 0 &&
+        h->code_seg_begin < h->data_seg_begin + h->data_seg_size &&
+        h->data_seg_begin < h->code_seg_begin + h->code_seg_size) {
+        asm_fail(as, "Code segment overlaps data segment (see -Tdata)");
+    }
+    if (h->code_seg_begin > mem || h->code_seg_size > mem - h->code_seg_begin ||
+        h->data_seg_begin > mem || h->data_seg_size > mem - h->data_seg_begin) {
+        asm_fail(as, "Program does not fit in guest memory (see -m)");
+    }
+}
+
+// Name of a `.global name` directive, or NULL if the line is something else
+static const char *global_directive(Asm *as, char *ptr) {
+    if (strncmp(ptr, ".global", 7) != 0 || !isspace((unsigned char)ptr[7])) return NULL;
+    char *name = ptr + 7;
+    while (isspace((unsigned char)*name)) name++;
+    if (!is_valid_label_name(name)) asm_fail(as, "Invalid .global label");
+    return name;
+}
+
+// Lay out src, collect its labels in t, and write the listing pass_two assembles
+static struct tinker_file_header pass_one(Asm *as, const char *src, size_t len, SymbolTable *t) {
+    struct tinker_file_header header;
+    header.file_type = as->object_mode ? TINKER_OBJECT : (as->v2_mode ? TINKER_EXEC_V2 : TINKER_EXEC);
+    header.code_seg_begin = as->layout_code_begin;
+    header.code_seg_size = 0;
+    header.data_seg_begin = as->layout_data_after ? as->layout_code_begin : as->layout_data_begin;
+    header.data_seg_size = 0;
+    size_t pos = 0;
+
+    // uint64_t addr = 0x1000;
+    uint64_t data_addr = header.data_seg_begin;
+    uint64_t code_addr = header.code_seg_begin;
+
+    bool in_code = true;
+    char line[MAX_LINE];
+
+    // ld sizes depend on label addresses and label addresses depend on ld sizes,
+    // so lay out the file repeatedly, growing each ld to fit its value until nothing changes.
+    // Sizes only ever grow, so this terminates (every ld fits in 48 bytes).
+    as->ld_count = 0;
+    bool first_scan = true;
+    bool changed = true;
+
+    while (changed) {
+        pos = 0;
+        int scan_line = 0;
+        clear_table(t);
+        data_addr = header.data_seg_begin;
+        code_addr = header.code_seg_begin;
+        in_code = true;
+        size_t ld_index = 0;
+
+        while (next_line(src, len, &pos, line, sizeof(line))) {
+            as->lineno = source_line(as, ++scan_line);
+            enforce_leading_space_rule(as, line);
+
+            char clean[MAX_LINE];
+            strcpy(clean, line);
+            trim_line(clean);
+
+            if (!line_has_non_ws(clean)) continue;
+
+            char *ptr = clean;
+            while (isspace((unsigned char)*ptr)) ptr++;
+            if (*ptr == '\0') continue;
+
+            if (strncmp(ptr, ".code", 5) == 0) { in_code = true;  continue; }
+            if (strncmp(ptr, ".data", 5) == 0) { in_code = false; continue; }
+
+            const char *global = global_directive(as, ptr);
+            if (global) {
+                if (first_scan && as->obj_globals) insert_label(as->obj_globals, (char *)global, 0);
+                continue;
+            }
+
+            if (*ptr == ':') {
+                enforce_label_only(as, ptr);
+                char label[MAX_LABEL];
+                if (sscanf(ptr+1, "%s", label) != 1) asm_fail(as, "Invalid label syntax");
+                if (!is_valid_label_name(label)) asm_fail(as, "Invalid label name");
+                // Peek Ahead
+                size_t current_position = pos;
+                char next_text[MAX_LINE];
+                uint64_t next_section_in_code = in_code;
+                while (next_line(src, len, &pos, next_text, sizeof(next_text))) {
+                    if (!line_has_non_ws(next_text)) continue;
+                    trim_line(next_text);
+                    char *next_ptr = next_text;
+                    while (isspace((unsigned char)*next_ptr)) next_ptr++;
+                    if (strncmp(next_ptr, ".code", 5) == 0) {
+                        next_section_in_code = true;
+                        continue;
+                    } else if (strncmp(next_ptr, ".data", 5) == 0) {
+                        next_section_in_code = false;
+                        continue;
+                    } else if (*next_ptr == ':') {
+                        continue;
+                    }
+                    break;
+                }
+
+                pos = current_position;
+
+                uint64_t addr = next_section_in_code ? code_addr : data_addr;
+                if (insert_label(t, label, addr) == 1) asm_fail(as, "duplicate label");
+                continue;
+            }
+
+            enforce_tab_rule_if_statement(as, line, ptr);
+
+            if (!in_code) {
+                DataDirective d;
+                data_addr += data_directive(as, ptr, &d) == DATA_WORD ? 8 : d.bytes;
+                continue;
+            }
+
+            char mnem[64];
+            sscanf(ptr, "%s", mnem);
+            int op = get_opcode(mnem);
+
+            if (op == MACRO_LD) {
+                if (first_scan) {
+                    if (as->ld_count == as->ld_cap) as->ld_slots = asm_grow(as, as->ld_slots, &as->ld_cap, 64, sizeof(LdSlot));
+                    char args[MAX_LINE], *save;
+                    strcpy(args, ptr);
+                    char *token = strtok_r(args, " ,\t\n", &save);
+                    token = strtok_r(NULL, " ,\t\n", &save);
+                    token = token ? strtok_r(NULL, " ,\t\n", &save) : NULL;
+                    LdSlot *slot = &as->ld_slots[as->ld_count++];
+                    snprintf(slot->operand, MAX_LABEL, "%s", token ? token : "");
+                    // Label lds in objects keep the full form so hw5-ld can patch them
+                    slot->size = (as->object_mode && token && token[0] == ':') ? 48 : 4;
+                }
+                code_addr += as->ld_slots[ld_index++].size;
+            }
+            else if (op == MACRO_PUSH || op == MACRO_POP) code_addr += 8;
+            else code_addr += 4;
+        }
+
+        changed = false;
+        for (size_t i = 0; i < as->ld_count; i++) {
+            char operand[MAX_LABEL];
+            uint64_t L;
+            strcpy(operand, as->ld_slots[i].operand);
+            if (resolve_u64_decimal(operand, t, &L) != 0) continue; // reported in the emit loop
+            int need = ld_size(L);
+            if (need > as->ld_slots[i].size) {
+                as->ld_slots[i].size = need;
+                changed = true;
+            }
+        }
+        // Data placed after code moves whenever code grows; it only ever moves up
+        if (as->layout_data_after) {
+            uint64_t after = (code_addr + 63) & ~(uint64_t)63;
+            if (after != header.data_seg_begin) {
+                header.data_seg_begin = after;
+                changed = true;
+            }
+        }
+        first_scan = false;
+    }
+
+    pos = 0;
+    FILE *out = as->listing_file = open_memstream(&as->listing, &as->listing_size);
+    if (!out) asm_fail(as, "Out of memory");
+
+    // addr = 0x1000;
+    code_addr = header.code_seg_begin;
+    data_addr = header.data_seg_begin;
+
+    in_code = true;
+    int last_section = -1;
+    size_t ld_index = 0;
+    int lineno = 0;
+    as->line_map_count = 0;
+    as->data_piece_count = 0;
+
+    while (next_line(src, len, &pos, line, sizeof(line))) {
+        lineno++;
+        as->lineno = source_line(as, lineno);
+        enforce_leading_space_rule(as, line);
+
+        char clean[MAX_LINE];
+        strcpy(clean, line);
+        trim_line(clean);
+
+        if (!line_has_non_ws(clean)) continue;
+
+        char *ptr = clean;
+        while (isspace((unsigned char)*ptr)) ptr++;
+        if (*ptr == '\0') continue;
+        listing_mark(as, out);
+
+        if (strncmp(ptr, ".code", 5) == 0) {
+            in_code = true;
+            if (last_section != 1) {
+                fprintf(out, ".code\n");
+                last_section = 1;
+            }
+            continue;
+        }
+        if (strncmp(ptr, ".data", 5) == 0) {
+            in_code = false;
+            if (last_section != 0) {
+                fprintf(out, ".data\n");
+                last_section = 0;
+            }
+            continue;
+        }
+
+        if (*ptr == ':') continue;
+        if (global_directive(as, ptr)) continue;
+
+        enforce_tab_rule_if_statement(as, line, ptr);
+
+        int cur = in_code ? 1 : 0;
+        if (cur != last_section) {
+            fprintf(out, in_code ? ".code\n" : ".data\n");
+            last_section = cur;
+        }
+
+        if (!in_code) {
+            uint64_t uval;
+            DataDirective d;
+            int kind = data_directive(as, ptr, &d);
+            uint64_t bytes = d.bytes;
+            if (kind == DATA_INCBIN) {
+                fprintf(out, "\t.incbin \"%s\", %llu, %llu\n", d.path, (unsigned long long)d.offset, (unsigned long long)d.length);
+                data_piece_add(as, data_addr, bytes, false);
+                data_addr += bytes;
+                continue;
+            }
+            if (kind == DATA_WORD) {
+                if (resolve_u64_decimal(ptr, t, &uval) != 0) asm_fail(as, "Invalid data value");
+                fprintf(out, "\t%llu\n", (unsigned long long)uval);
+                data_piece_add(as, data_addr, 8, false);
+                data_addr += 8;
+                continue;
+            }
+            if (kind == DATA_FILL && resolve_u64_decimal(d.value, t, &uval) != 0) asm_fail(as, "Invalid data value");
+            if (kind == DATA_ZERO || uval == 0) {
+                fprintf(out, "\t.zero %llu\n", (unsigned long long)bytes);
+                data_piece_add(as, data_addr, bytes, true);
+            } else {
+                fprintf(out, "\t.fill %llu, %llu\n", (unsigned long long)(bytes / 8), (unsigned long long)uval);
+                data_piece_add(as, data_addr, bytes, false);
+            }
+            data_addr += bytes;
+            continue;
+        }
+
+        line_map_add(as, code_addr, lineno);   // written in v2; -P also reads it
+
+        char mnem[64], args[4][64], *save;
+        int arg_count = 0;
+
+        char *token = strtok_r(ptr, " ,\t\n", &save);
+        if (!token) continue;
+        strcpy(mnem, token);
+
+        while ((token = strtok_r(NULL, " ,\t\n", &save))) {
+            if (arg_count >= 4) {
+                asm_fail(as, "Too many operants");
+            }
+            strcpy(args[arg_count++], token);
+        }
+
+        int op = get_opcode(mnem);
+        if (op == OP_UNKNOWN) asm_fail(as, "Unknown instruction");
+
+
+
+        if (op == MACRO_CLR) {
+            if (arg_count != 1) asm_fail(as, "clr takes 1 arg");
+            if (parse_register(args[0]) < 0) asm_fail(as, "clr requires a register");
+            fprintf(out, "\txor %s, %s, %s\n", args[0], args[0], args[0]);
+            code_addr += 4;
+        }
+        else if (op == MACRO_POP) {
+            if (arg_count != 1) asm_fail(as, "pop takes 1 arg");
+            if (parse_register(args[0]) < 0) asm_fail(as, "pop requires a register");
+            fprintf(out, "\tmov %s, (r31)(0)\n", args[0]);
+            fprintf(out, "\taddi r31, 8\n");
+            code_addr += 8;
+        }
+        else if (op == MACRO_PUSH) {
+            if (arg_count != 1) asm_fail(as, "push takes 1 arg");
+            if (parse_register(args[0]) < 0) asm_fail(as, "push requires a register");
+            fprintf(out, "\tmov (r31)(-8), %s\n", args[0]);
+            fprintf(out, "\tsubi r31, 8\n");
+            code_addr += 8;
+        }
+        else if (op == MACRO_HALT) {
+            if (arg_count != 0) asm_fail(as, "halt takes 0 args");
+            fprintf(out, "\tpriv r0, r0, r0, 0\n");
+            code_addr += 4;
+        }
+        else if (op == MACRO_IN) {
+            if (arg_count != 2) asm_fail(as, "in takes 2 args");
+            if (parse_register(args[0]) < 0) asm_fail(as, "in requires a register");
+            if (parse_register(args[1]) < 0) asm_fail(as, "in requires a register");
+            fprintf(out, "\tpriv %s, %s, r0, 3\n", args[0], args[1]);
+            code_addr += 4;
+        }
+        else if (op == MACRO_OUT) {
+            if (arg_count != 2) asm_fail(as, "out takes 2 args");
+            if (parse_register(args[0]) < 0) asm_fail(as, "out requires a register");
+            if (parse_register(args[1]) < 0) asm_fail(as, "out requires a register");
+            fprintf(out, "\tpriv %s, %s, r0, 4\n", args[0], args[1]);
+            code_addr += 4;
+        }
+        else if (op == MACRO_MAPSIZE) {
+            if (arg_count != 2) asm_fail(as, "mapsize takes 2 args");
+            if (parse_register(args[0]) < 0) asm_fail(as, "mapsize requires a register");
+            if (parse_register(args[1]) < 0) asm_fail(as, "mapsize requires a register");
+            fprintf(out, "\tpriv %s, %s, r0, %d\n", args[0], args[1], PRIV_MAPSIZE);
+            code_addr += 4;
+        }
+        else if (op == MACRO_INW || op == MACRO_OUTW || op == MACRO_OUTS ||
+                 op == MACRO_MEMCPY || op == MACRO_MEMSET || op == MACRO_MEMCMP) {
+            // inw addr, port, count / outw port, addr, count / outs port, addr, length
+            // memcpy dst, src, length / memset dst, byte, length / memcmp a (result), b, length
+            static const struct { int op; const char *name; int lit; } bulk[] = {
+                { MACRO_INW, "inw", PRIV_INW }, { MACRO_OUTW, "outw", PRIV_OUTW }, { MACRO_OUTS, "outs", PRIV_OUTS },
+                { MACRO_MEMCPY, "memcpy", PRIV_MEMCPY }, { MACRO_MEMSET, "memset", PRIV_MEMSET },
+                { MACRO_MEMCMP, "memcmp", PRIV_MEMCMP },
+            };
+            int k = 0;
+            while (bulk[k].op != op) k++;
+            char msg[64];
+            snprintf(msg, sizeof(msg), "%s takes 3 args", bulk[k].name);
+            if (arg_count != 3) asm_fail(as, msg);
+            snprintf(msg, sizeof(msg), "%s requires a register", bulk[k].name);
+            for (int i = 0; i < 3; i++) {
+                if (parse_register(args[i]) < 0) asm_fail(as, msg);
+            }
+            fprintf(out, "\tpriv %s, %s, %s, %d\n", args[0], args[1], args[2], bulk[k].lit);
+            code_addr += 4;
+        }
+        else if (op == MACRO_LD) {
+            if (arg_count != 2) asm_fail(as, "ld takes 2 args");
+
+            const char *rd = args[0];
+            if (parse_register(rd) < 0) asm_fail(as, "ld requires a register");
+
+            uint64_t L;
+            int reserved = as->ld_slots[ld_index++].size;
+            if (as->object_mode && args[1][0] == ':') {
+                if (!is_valid_label_name(args[1] + 1)) asm_fail(as, "Invalid literal/label in ld");
+                L = lookup_label(t, args[1] + 1);
+                if (L == (uint64_t)-1) L = 0;
+                obj_reloc(as, TINKER_RELOC_LD, args[1] + 1, code_addr);
+                write_ld_full(out, rd, L);
+            } else {
+                if (resolve_u64_decimal(args[1], t, &L) != 0) asm_fail(as, "Invalid literal/label in ld");
+                write_ld(out, rd, L, reserved);
+            }
+            code_addr += reserved;
+        }
+        else {
+            if (op == OP_BRR_L) {
+                if (arg_count != 1) asm_fail(as, "brr requires 1 arg");
+                if (args[0][0] == 'r') {
+                    if (parse_register(args[0]) < 0) asm_fail(as, "brr r requires a register");
+                    fprintf(out, "\tbrr %s\n", args[0]);
+                }
+                else {
+                    int64_t L_inst = 0;
+                    if (args[0][0] == ':') {
+                        int64_t target = lookup_label(t, args[0] + 1);
+                        if (as->object_mode) obj_reloc(as, TINKER_RELOC_BRR, args[0] + 1, code_addr);
+                        if (target == -1 && !as->object_mode) asm_fail(as, "Label not found");
+                        // brr L jumps to pc + L, L in bytes from the brr itself
+                        L_inst = (target == -1) ? 0 : target - code_addr;
+                    } else {
+                        if (parse_int64_strict(args[0], &L_inst) != 0) asm_fail(as, "Invalid brr literal");
+                    }
+                    check_bounds_signed(as, L_inst, 12, "Branch offset too large for 12 bits");
+                    fprintf(out, "\tbrr %lld\n", (long long)L_inst);
+                }
+            } 
+            else {
+                fprintf(out, "\t%s", mnem);
+                for (int i = 0; i < arg_count; i++) {
+                    if (as->object_mode && strchr(args[i], ':')) {
+                        asm_fail(as, "Label operands need ld in relocatable objects");
+                    }
+                    if (strchr(args[i], '(')) { // Memory Operand
+                        int base; int64_t disp;
+                        if (parse_mem_operand(args[i], &base, &disp, t) != 0) asm_fail(as, "Bad mem op");
+                        fprintf(out, " (r%d)(%lld)", base, (long long)disp);
+                    } else if (args[i][0] == ':' || isdigit((unsigned char)args[i][0]) || args[i][0] == '-') {
+                        int64_t val;
+                        if (resolve_value(args[i], t, &val) != 0) asm_fail(as, "Invalid val");
+                        if (op == OP_SHFTRI || op == OP_SHFTLI) {    
+                            if (val > 4095 || val < 0) {
+                                asm_fail(as, "Shift amount out of range");
+                            }
+                        }
+                        fprintf(out, " %lld", (long long)val);
+                    } else { // Register
+                        fprintf(out, " %s", args[i]);
+                    }
+                    if (i < arg_count - 1) fprintf(out, ",");
+                }
+                fprintf(out, "\n");
+            }
+            code_addr += 4;
+        }
+    }
+
+    header.code_seg_size = code_addr - header.code_seg_begin;
+    header.data_seg_size = data_addr - header.data_seg_begin;
+    as->lineno = 0;
+
+    if (as->object_mode) obj_define_symbols(as, t);
+    else check_layout(as, &header);
+
+    as->listing_file = NULL;
+    if (fclose(out) != 0) asm_fail(as, "Out of memory");
+
+    return header;
+}
+
+static int parse_mem_operand(const char *s, int *base_reg, int64_t *lit, SymbolTable *t) {
+    if (!s || s[0] != '(') return 1;
+
+    const char *p = s + 1;
+    if (*p != 'r') return 1;
+
+    char regbuf[16];
+    int ri = 0;
+    while (*p && *p != ')' && ri < (int)sizeof(regbuf)-1) regbuf[ri++] = *p++;
+    regbuf[ri] = '\0';
+    if (*p != ')') return 1;
+    int r = parse_register(regbuf);
+    if (r < 0) return 1;
+
+    p++;
+    if (*p != '(') return 1;
+    p++;
+
+    char valbuf[128];
+    int vi = 0;
+    while (*p && *p != ')' && vi < (int)sizeof(valbuf)-1) valbuf[vi++] = *p++;
+    valbuf[vi] = '\0';
+    if (*p != ')') return 1;
+    p++;
+
+    // if (t && valbuf[0] == ':') return 1;
+    if (*p != '\0') return 1;
+
+    int64_t v;
+    if (resolve_value(valbuf, t, &v) != 0) return 1;
+
+    *base_reg = r;
+    *lit = v;
+    return 0;
+}
+
+// v2 layout: header, section table, then code, each initialized data piece and
+// the metadata sections, each starting on a TINKER_V2_ALIGN boundary. Sections
+// are code, one data or bss section per data piece (a single empty data section
+// if there is no data), symbols, strings and the line map.
+static uint64_t v2_align(uint64_t off) {
+    return (off + TINKER_V2_ALIGN - 1) & ~(uint64_t)(TINKER_V2_ALIGN - 1);
+}
+
+static size_t v2_section_count(const Asm *as) {
+    return 4 + (as->data_piece_count ? as->data_piece_count : 1);
+}
+
+static uint64_t v2_code_offset(const Asm *as) {
+    return v2_align(sizeof(struct tinker_v2_header) + v2_section_count(as) * sizeof(struct tinker_section));
+}
+
+// Place each initialized piece after off; sizes[i] is what piece i occupies in the file
+static uint64_t v2_layout_data(Asm *as, uint64_t off, const uint64_t *sizes) {
+    DataPiece *data_pieces = as->data_pieces;
+    for (size_t i = 0; i < as->data_piece_count; i++) {
+        if (data_pieces[i].zero) continue;
+        off = v2_align(off);
+        data_pieces[i].file_offset = off;
+        off += sizes ? sizes[i] : data_pieces[i].size;
+    }
+    return off;
+}
+
+static int compare_symbols(const void *a, const void *b) {
+    const struct tinker_symbol *x = a, *y = b;
+    if (x->value != y->value) return x->value < y->value ? -1 : 1;
+    return x->name < y->name ? -1 : (x->name > y->name);
+}
+
+static void write_v2_tables(Asm *as, struct tinker_file_header header, SymbolTable *t) {
+    DataPiece *data_pieces = as->data_pieces;
+    // Every label, code and data alike, named through a string table that starts with ""
+    struct tinker_symbol *syms = malloc((t->count ? t->count : 1) * sizeof(struct tinker_symbol));
+    uint64_t strtab_size = 1;
+    for (unsigned long b = 0; b < t->bucket_count; b++) {
+        for (SymbolEntry *e = t->buckets[b]; e; e = e->next) strtab_size += strlen(e->label_name) + 1;
+    }
+    char *strtab = malloc(strtab_size);
+    if (!syms || !strtab) asm_fail(as, "Out of memory");
+
+    uint64_t n = 0, str_used = 1;
+    strtab[0] = '\0';
+    for (unsigned long b = 0; b < t->bucket_count; b++) {
+        for (SymbolEntry *e = t->buckets[b]; e; e = e->next) {
+            size_t len = strlen(e->label_name) + 1;
+            memcpy(strtab + str_used, e->label_name, len);
+            syms[n].name = (uint32_t)str_used;
+            syms[n].flags = TINKER_SYM_DEFINED;
+            syms[n].value = e->address;
+            str_used += len;
+            n++;
+        }
+    }
+    qsort(syms, n, sizeof(struct tinker_symbol), compare_symbols);
+
+    uint64_t code_off = v2_code_offset(as);
+    uint64_t code_size = header.code_seg_size;
+    uint32_t code_codec = TKO_CODEC_NONE;
+    size_t np = as->data_piece_count;
+    uint64_t *stored = calloc(np + 1, sizeof(uint64_t));
+    uint32_t *codec = calloc(np + 1, sizeof(uint32_t));
+    if (!stored || !codec) asm_fail(as, "Out of memory");
+    for (size_t i = 0; i < np; i++) stored[i] = data_pieces[i].zero ? 0 : data_pieces[i].size;
+
+    if (as->compress_mode) {
+        // Copy the raw segments out and re-lay the image out with whatever codec wins for each
+        uint8_t **packed = calloc(np + 1, sizeof(uint8_t *));
+        uint8_t *raw = malloc(code_size + 1);
+        if (!packed || !raw) asm_fail(as, "Out of memory");
+        memcpy(raw, as->out.data + code_off, code_size);
+        int best = tko_compress_best(raw, code_size, 0, &packed[np], &code_size);
+        if (best < 0) asm_fail(as, "Out of memory");
+        code_codec = best;
+        if (!packed[np]) packed[np] = raw;
+        else free(raw);
+
+        for (size_t i = 0; i < np; i++) {
+            DataPiece *p = &data_pieces[i];
+            if (p->zero) continue;
+            raw = malloc(p->size);
+            if (!raw) asm_fail(as, "Out of memory");
+            out_reserve(as, p->file_offset + p->size);   // a trailing hole may not be written yet
+            memcpy(raw, as->out.data + p->file_offset, p->size);
+            best = tko_compress_best(raw, p->size, 1, &packed[i], &stored[i]);
+            if (best < 0) asm_fail(as, "Out of memory");
+            codec[i] = best;
+            if (!packed[i]) packed[i] = raw;
+            else free(raw);
+        }
+
+        v2_layout_data(as, code_off + code_size, stored);
+        out_seek(as, code_off);
+        out_write(as, packed[np], code_size);
+        for (size_t i = 0; i < np; i++) {
+            if (data_pieces[i].zero) continue;
+            out_seek(as, data_pieces[i].file_offset);
+            out_write(as, packed[i], stored[i]);
+        }
+        for (size_t i = 0; i <= np; i++) free(packed[i]);
+        free(packed);
+    }
+
+    uint64_t data_end = code_off + code_size;
+    for (size_t i = 0; i < np; i++) {
+        if (!data_pieces[i].zero) data_end = data_pieces[i].file_offset + stored[i];
+    }
+    uint64_t sym_off = v2_align(data_end);
+    uint64_t str_off = v2_align(sym_off + n * sizeof(struct tinker_symbol));
+    uint64_t lines_off = v2_align(str_off + strtab_size);
+
+    size_t count = 0;
+    struct tinker_section *sec = calloc(v2_section_count(as), sizeof(struct tinker_section));
+    if (!sec) asm_fail(as, "Out of memory");
+    sec[count++] = (struct tinker_section){ TINKER_SEC_CODE, code_codec, header.code_seg_begin, code_off, code_size, header.code_seg_size, 0 };
+    if (np == 0) {
+        sec[count++] = (struct tinker_section){ TINKER_SEC_DATA, 0, header.data_seg_begin, v2_align(code_off + code_size), 0, 0, 0 };
+    }
+    for (size_t i = 0; i < np; i++) {
+        DataPiece *p = &data_pieces[i];
+        if (p->zero) sec[count++] = (struct tinker_section){ TINKER_SEC_BSS, 0, p->addr, 0, 0, p->size, 0 };
+        else sec[count++] = (struct tinker_section){ TINKER_SEC_DATA, codec[i], p->addr, p->file_offset, stored[i], p->size, 0 };
+    }
+    sec[count++] = (struct tinker_section){ TINKER_SEC_SYMTAB, 0, 0, sym_off, n * sizeof(struct tinker_symbol), 0, 0 };
+    sec[count++] = (struct tinker_section){ TINKER_SEC_STRTAB, 0, 0, str_off, strtab_size, 0, 0 };
+    sec[count++] = (struct tinker_section){ TINKER_SEC_LINES, 0, 0, lines_off, as->line_map_count * sizeof(struct tinker_line), 0, 0 };
+    free(stored);
+    free(codec);
+
+    struct tinker_v2_header v2;
+    memset(&v2, 0, sizeof(v2));
+    v2.file_type = TINKER_EXEC_V2;
+    v2.entry = header.code_seg_begin;
+    v2.section_count = count;
+    v2.section_table_offset = sizeof(struct tinker_v2_header);
+    v2.mem_size = as->guest_mem_size;
+    if (as->compress_mode) v2.flags |= TINKER_V2_COMPRESSED;
+
+    out_seek(as, 0);
+    out_write(as, &v2, sizeof(v2));
+    out_write(as, sec, sizeof(struct tinker_section) * count);
+    out_seek(as, sym_off);
+    out_write(as, syms, sizeof(struct tinker_symbol) * n);
+    out_seek(as, str_off);
+    out_write(as, strtab, strtab_size);
+    out_seek(as, lines_off);
+    out_write(as, as->line_map, sizeof(struct tinker_line) * as->line_map_count);
+
+    // Compression shrinks the image below what pass_two already wrote
+    as->out.size = lines_off + as->line_map_count * sizeof(struct tinker_line);
+
+    free(sec);
+    free(syms);
+    free(strtab);
+}
+
+static uint64_t data_file_pos(const Asm *as, bool v2, size_t piece, uint64_t addr, uint64_t seg_offset, uint64_t seg_begin) {
+    if (v2) return as->data_pieces[piece].file_offset + (addr - as->data_pieces[piece].addr);
+    return seg_offset + (addr - seg_begin);
+}
+
+// The source line whose expansion holds listing offset off
+static int listing_source_line(const Asm *as, uint64_t off) {
+    size_t lo = 0, hi = as->listing_line_count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (as->listing_lines[mid].offset <= off) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo ? as->listing_lines[lo - 1].line : 0;
+}
+
+// Assemble the listing pass_one wrote into as->out
+static void pass_two(Asm *as, SymbolTable *t, struct tinker_file_header header) {
+    DataPiece *data_pieces = as->data_pieces;
+    size_t pos = 0;
+    as->out.size = as->out.pos = 0;
+
+    // v2 headers and section tables are written once the layout is known
+    if (header.file_type != TINKER_EXEC_V2) out_write(as, &header, sizeof(struct tinker_file_header));
+
+    char line[MAX_LINE];
+    bool in_code = true;
+    // uint64_t addr = 0x1000;
+
+    uint64_t code_file_offset = sizeof(struct tinker_file_header);
+    if (header.file_type == TINKER_OBJECT) {
+        struct tinker_obj_header obj = { as->obj_sym_count, as->obj_reloc_count, as->obj_strtab_size };
+        out_write(as, &obj, sizeof(obj));
+        code_file_offset += sizeof(obj);
+    }
+    uint64_t data_seg_offset = code_file_offset + header.code_seg_size;
+    bool v2 = header.file_type == TINKER_EXEC_V2;
+    if (v2) {
+        merge_short_zero_pieces(as);
+        data_pieces = as->data_pieces;
+        code_file_offset = v2_code_offset(as);
+        v2_layout_data(as, code_file_offset + header.code_seg_size, NULL);
+    }
+    uint64_t tables_file_offset = data_seg_offset + header.data_seg_size;
+
+    // Data words go to their address's place in the file: one contiguous segment
+    // in v1 and objects, the containing initialized piece in v2
+    uint64_t data_addr = header.data_seg_begin;
+    size_t piece = 0;
+    bool tail_is_hole = false;
+
+    size_t line_start = 0;
+    while (next_line(as->listing, as->listing_size, &pos, line, sizeof(line))) {
+        as->lineno = listing_source_line(as, line_start);
+        line_start = pos;
+        char clean[MAX_LINE];
+        strcpy(clean, line);
+        trim_line(clean);
+
+        if (!line_has_non_ws(clean)) continue;
+
+        char *ptr = clean;
+        while (isspace((unsigned char)*ptr)) ptr++;
+        if (*ptr == '\0') continue;
+
+        if (strncmp(ptr, ".code", 5) == 0) { in_code = true; continue; }
+        if (strncmp(ptr, ".data", 5) == 0) { in_code = false; continue; }
+
+        if (line[0] != '\t') asm_fail(as, "Intermediate file invalid: statement missing leading tab");
+
+        if (!in_code) {
+            while (v2 && piece + 1 < as->data_piece_count && data_addr >= data_pieces[piece].addr + data_pieces[piece].size) piece++;
+
+            unsigned long long count, sv;
+            if (sscanf(ptr, ".zero %llu", &count) == 1) {
+                // Already zero: a hole in v1 files, a bss section or hole in v2
+                data_addr += count;
+                tail_is_hole = true;
+                continue;
+            }
+            if (strncmp(ptr, ".incbin", 7) == 0) {
+                char path[MAX_LINE];
+                uint64_t offset, length;
+                bool has_length;
+                if (parse_incbin(ptr + 7, path, &offset, &length, &has_length) != 0 || !has_length) {
+                    asm_fail(as, "Intermediate file invalid: bad .incbin");
+                }
+                // From the copy pass_one read; the padding up to 8 bytes is left as a hole
+                const IncFile *bin = incbin_file(as, path);
+                if (offset > bin->size || length > bin->size - offset) asm_fail(as, "Intermediate file invalid: bad .incbin");
+                out_seek(as, data_file_pos(as, v2, piece, data_addr, data_seg_offset, header.data_seg_begin));
+                out_write(as, bin->data + offset, length);
+                data_addr += (length + 7) & ~(uint64_t)7;
+                tail_is_hole = (length % 8) != 0;
+                continue;
+            }
+            if (sscanf(ptr, ".fill %llu, %llu", &count, &sv) == 2) {
+                uint64_t chunk[64];
+                for (int i = 0; i < 64; i++) chunk[i] = sv;
+                out_seek(as, data_file_pos(as, v2, piece, data_addr, data_seg_offset, header.data_seg_begin));
+                for (uint64_t left = count; left > 0; ) {
+                    uint64_t k = left < 64 ? left : 64;
+                    out_write(as, chunk, 8 * k);
+                    left -= k;
+                }
+                data_addr += count * 8;
+                tail_is_hole = false;
+                continue;
+            }
+
+            char *end = NULL;
+            errno = 0;
+            sv = strtoull(ptr, &end, 10);
+            if (errno == ERANGE) asm_fail(as, "Invalid data literal");
+            if (!end || *end != '\0') asm_fail(as, "Invalid data literal");
+            uint64_t bits = (uint64_t)sv;
+            out_seek(as, data_file_pos(as, v2, piece, data_addr, data_seg_offset, header.data_seg_begin));
+            out_write(as, &bits, 8);
+            data_addr += 8;
+            tail_is_hole = false;
+            continue;
+        }
+
+        char mnem[64], args[4][64], *save;
+        int arg_count = 0;
+        char *token = strtok_r(ptr, " ,\t\n", &save);
+        if (!token) continue;
+        strcpy(mnem, token);
+        while ((token = strtok_r(NULL, " ,\t\n", &save)) && arg_count < 4) strcpy(args[arg_count++], token);
+
+        int op = get_opcode(mnem);
+        uint32_t instr = 0;
+
+        int rd = -1, rs = -1, rt = -1;
+        int64_t lit = 0;
+
+        if (op == OP_MOV_RR) {
+            if (arg_count != 2) asm_fail(as, "mov requires 2 args");
+
+            if (strchr(args[1], '(')) {
+                op = OP_MOV_ML;
+                rd = parse_register(args[0]);
+                if (rd < 0) asm_fail(as, "Invalid rd in mov");
+                if (parse_mem_operand(args[1], &rs, &lit, NULL) != 0) asm_fail(as, "Invalid mem operand");
+            }
+            else if (strchr(args[0], '(')) {
+                op = OP_MOV_SM;
+                rs = parse_register(args[1]);
+                if (rs < 0) asm_fail(as, "Invalid rs in mov");
+                if (parse_mem_operand(args[0], &rd, &lit, NULL) != 0) asm_fail(as, "Invalid mem operand");
+            }
+            else if (args[1][0] == 'r') {
+                op = OP_MOV_RR;
+                rd = parse_register(args[0]);
+                rs = parse_register(args[1]);
+                if (rd < 0 || rs < 0) asm_fail(as, "Invalid reg in mov");
+            }
+            else {
+                op = OP_MOV_L;
+                rd = parse_register(args[0]);
+                if (rd < 0) asm_fail(as, "Invalid rd in mov");
+                if (parse_int64_strict(args[1], &lit) != 0) asm_fail(as, "Bad mov literal");
+                if (lit < 0) asm_fail(as, "mov rd, L requires unsigned");
+            }
+        }
+        else if (op == OP_BR) {
+            if (arg_count != 1) asm_fail(as, "br requires 1 arg");
+            rd = parse_register(args[0]);
+            if (rd < 0) asm_fail(as, "invalid rd");
+        }
+        else if (op == OP_BRR_L) {
+            if (arg_count != 1) asm_fail(as, "brr requires 1 arg");
+            if (args[0][0] == 'r') {
+                op = OP_BRR_R; // brr rd format 
+                rd = parse_register(args[0]);
+                if (rd < 0) asm_fail(as, "brr r requires a register");
+                lit = 0;
+                rs = 0; rt = 0;
+            } else {
+                op = OP_BRR_L; // brr L format 
+                int64_t L_count;
+                if (parse_int64_strict(args[0], &L_count) != 0) asm_fail(as, "Bad brr literal");
+                
+                // Convert instruction count to byte offset 
+                lit = L_count; 
+                rd = 0;
+                
+                // Standardize to the 12-bit field shown in the manual 
+                check_bounds_signed(as, lit, 12, "Branch offset too large for 12 bits");
+            }
+        }
+        else if (op == OP_CALL) {
+             if (arg_count != 1) asm_fail(as, "call requires 1 arg");
+             rd = parse_register(args[0]);
+             if (rd < 0) asm_fail(as, "invalid rd");
+        }
+        else if (op == OP_PRIV) {
+             if (arg_count != 4) asm_fail(as, "priv requires 4 args");
+             rd = parse_register(args[0]); if (rd < 0) asm_fail(as, "invalid rd");
+             rs = parse_register(args[1]); if (rs < 0) asm_fail(as, "invalid rs");
+             rt = parse_register(args[2]); if (rt < 0) asm_fail(as, "invalid rt");
+             if (parse_int64_strict(args[3], &lit) != 0) asm_fail(as, "bad priv literal");
+        }
+        else if (op == OP_RET) {
+            if (arg_count != 0) asm_fail(as, "return requires 0 args");
+        }
+
+        if (op == OP_UNKNOWN) {
+            asm_fail(as, "unknown op");
+        }
+        else {
+            if (op == OP_ADD || op == OP_SUB || op == OP_AND || op == OP_OR || op == OP_XOR ||
+                op == OP_SHFTR || op == OP_SHFTL || op == OP_ADDF || op == OP_SUBF ||
+                op == OP_MULF || op == OP_DIVF || op == OP_MUL || op == OP_DIV ||
+                op == OP_BRGT || op == OP_BRNZ || op == OP_NOT) {
+
+                if (op == OP_BRNZ || op == OP_NOT) {
+                    if (arg_count != 2) asm_fail(as, "not/brnz requires 2 args");
+                } else {
+                    if (arg_count != 3) asm_fail(as, "r-type requires 3 args");
+                }
+
+                rd = parse_register(args[0]); if (rd < 0) asm_fail(as, "invalid rd");
+                rs = parse_register(args[1]); if (rs < 0) asm_fail(as, "invalid rs");
+                if (op != OP_BRNZ && op != OP_NOT) {
+                    rt = parse_register(args[2]);
+                    if (rt < 0) asm_fail(as, "invalid rt");
+                }
+            }
+            else if (op == OP_ADDI || op == OP_SUBI || op == OP_SHFTRI || op == OP_SHFTLI) {
+                if (arg_count != 2) asm_fail(as, "i-type requires 2 args");
+                rd = parse_register(args[0]);
+                rs = 0; 
+                rt = 0;
+                if (rd < 0) asm_fail(as, "invalid rd");
+                if (resolve_value(args[1], t, &lit) != 0) {
+                    asm_fail(as, "Invalid literal or label in i-type");
+                }
+
+                if (lit < 0) asm_fail(as, "Unsigned literal required");
+                
+                // Bounds check
+                if ((op == OP_SHFTRI || op == OP_SHFTLI) && (lit > 4095)) {
+                    asm_fail(as, "Shift amount out of range");
+                }
+            }
+        }
+
+        if (rd == -1) rd = 0;
+        if (rs == -1) rs = 0;
+        if (rt == -1) rt = 0;
+
+        instr |= (op & 0x1F) << 27;
+        instr |= (rd & 0x1F) << 22;
+        instr |= (rs & 0x1F) << 17;
+        instr |= (rt & 0x1F) << 12;
+
+        if (op == OP_ADDI || op == OP_SUBI || op == OP_SHFTRI || op == OP_SHFTLI || 
+            op == OP_MOV_L || op == OP_PRIV || op == OP_BRR_L || 
+            op == OP_MOV_ML || op == OP_MOV_SM) {
+
+            // Determine if the specific instruction expects a signed or unsigned 12-bit value
+            if (op == OP_BRR_L || op == OP_MOV_ML || op == OP_MOV_SM) {
+                // brr L and memory offsets allow negative values 
+                check_bounds_signed(as, lit, 12, "Literal exceeds 12-bit signed range");
+            } else {
+                // addi, subi, shifts, and mov L use unsigned literals 
+                check_bounds_unsigned(as, lit, 12, "Literal exceeds 12-bit unsigned range");
+            }
+
+            // Standardize packing: Literal always goes into the bottom 12 bits
+            instr |= ((uint32_t)lit & 0xFFF); 
+        }
+
+        out_seek(as, code_file_offset);
+        out_write(as, &instr, 4);
+        code_file_offset += 4;
+        // addr += 4;
+    }
+
+    // A file that ends in a zero run must still be long enough to hold it
+    if (tail_is_hole && !(v2 && (as->data_piece_count == 0 || data_pieces[piece].zero))) {
+        uint8_t zero = 0;
+        out_seek(as, data_file_pos(as, v2, piece, data_addr - 1, data_seg_offset, header.data_seg_begin));
+        out_write(as, &zero, 1);
+    }
+    as->lineno = 0;
+
+    if (v2) write_v2_tables(as, header, t);
+
+    if (header.file_type == TINKER_OBJECT) {
+        out_seek(as, tables_file_offset);
+        out_write(as, as->obj_syms, sizeof(struct tinker_symbol) * as->obj_sym_count);
+        out_write(as, as->obj_relocs, sizeof(struct tinker_reloc) * as->obj_reloc_count);
+        out_write(as, as->obj_strtab, as->obj_strtab_size);
+    }
+}
+
+
+void asm_default_options(AsmOptions *opts) {
+    memset(opts, 0, sizeof(*opts));
+    opts->format = ASM_EXEC;
+    opts->code_begin = TINKER_CODE_BEGIN;
+    opts->data_begin = TINKER_DATA_BEGIN;
+}
+
+static void asm_free(Asm *as) {
+    if (as->listing_file) fclose(as->listing_file);
+    if (as->symbols) free_table(as->symbols);
+    if (as->obj_globals) free_table(as->obj_globals);
+    if (as->obj_index) free_table(as->obj_index);
+    for (size_t i = 0; i < as->file_count; i++) free(as->files[i].data);
+    free(as->files);
+    free(as->line_map);
+    free(as->obj_syms);
+    free(as->obj_relocs);
+    free(as->obj_strtab);
+    free(as->ld_slots);
+    free(as->data_pieces);
+    free(as->listing);
+    free(as->listing_lines);
+    free(as->out.data);
+    free(as);
+}
+
+static Asm *asm_new(const AsmOptions *opts) {
+    Asm *as = calloc(1, sizeof(Asm));
+    if (!as) return NULL;
+    as->opts = *opts;
+    as->layout_code_begin = opts->code_begin;
+    as->layout_data_begin = opts->data_begin;
+    as->layout_data_after = opts->data_after;
+    as->guest_mem_size = opts->mem_size;
+    as->v2_mode = opts->format == ASM_EXEC_V2 || opts->format == ASM_EXEC_V2_COMPRESSED;
+    as->compress_mode = opts->format == ASM_EXEC_V2_COMPRESSED;
+    as->object_mode = opts->format == ASM_OBJECT;
+    return as;
+}
+
+// The options check and tables pass_one needs; call under setjmp(as->fail)
+static void asm_start(Asm *as) {
+    const AsmOptions *opts = &as->opts;
+    if (opts->format < ASM_EXEC || opts->format > ASM_OBJECT) asm_fail(as, "Invalid output format");
+    if (opts->code_begin % 4 != 0) asm_fail(as, "Invalid code address");
+    if (opts->data_begin % 8 != 0) asm_fail(as, "Invalid data address");
+    if (opts->mem_size && (opts->mem_size < 4096 || opts->mem_size % 8 != 0)) asm_fail(as, "Invalid memory size");
+    if (as->object_mode && opts->line_origin) asm_fail(as, "Relocatable objects take the source as written");
+
+    as->symbols = create_table();
+    if (as->object_mode) {
+        as->obj_globals = create_table();
+        as->obj_index = create_table();
+    }
+}
+
+int assemble(const char *src, size_t len, const AsmOptions *opts, AsmResult *res) {
+    memset(res, 0, sizeof(*res));
+    Asm *as = asm_new(opts);
+    if (!as) {
+        snprintf(res->error, sizeof(res->error), "Out of memory");
+        return -1;
+    }
+
+    int status = -1;
+    if (setjmp(as->fail) == 0) {
+        asm_start(as);
+        struct tinker_file_header header = pass_one(as, src, len, as->symbols);
+        pass_two(as, as->symbols, header);
+
+        res->image = as->out.data;
+        res->image_size = as->out.size;
+        res->listing = as->listing;
+        res->listing_size = as->listing_size;
+        res->lines = as->line_map;
+        res->line_count = as->line_map_count;
+        as->out.data = NULL;
+        as->listing = NULL;
+        as->line_map = NULL;
+        status = 0;
+    } else {
+        snprintf(res->error, sizeof(res->error), "%s", as->error);
+        res->error_line = as->lineno;
+    }
+    asm_free(as);
+    return status;
+}
+
+void asm_result_free(AsmResult *res) {
+    free(res->image);
+    free(res->listing);
+    free(res->lines);
+    memset(res, 0, sizeof(*res));
+}
@@ -0,0 +1,231 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "tinker_defs.h"
+#include "tinker_size.h"
+#include "symbol_table.h"
+
+// hw5-ld: link relocatable objects from `hw5-asm -c` into one loadable .tko.
+// Code segments are concatenated from 0x2000 and data segments from 0x10000
+// (or as -Tcode/-Tdata say), in command-line order, so the first object's
+// first instruction is the entry point.
+
+static uint64_t link_code_begin = TINKER_CODE_BEGIN;
+static uint64_t link_data_begin = TINKER_DATA_BEGIN;
+static bool link_data_after = false;
+
+typedef struct {
+    const char *path;
+    struct tinker_file_header header;
+    struct tinker_obj_header obj;
+    uint8_t *code;
+    uint8_t *data;
+    struct tinker_symbol *syms;
+    struct tinker_reloc *relocs;
+    char *strtab;
+    uint64_t code_base;   // final address of this object's code
+    uint64_t data_base;   // final address of this object's data
+} Object;
+
+void error_exit(const char *msg) {
+    fprintf(stderr, "Error: %s\n", msg);
+    exit(1);
+}
+
+static void link_error(const char *msg, const char *detail) {
+    fprintf(stderr, "Error: %s: %s\n", msg, detail);
+    exit(1);
+}
+
+static void *read_array(FILE *f, uint64_t count, size_t elem, const char *path) {
+    if (count == 0) return NULL;
+    if (count > (uint64_t)-1 / elem) link_error("Corrupt object", path);
+    void *p = malloc(count * elem);
+    if (!p) error_exit("Out of memory");
+    if (fread(p, elem, count, f) != count) link_error("Truncated object", path);
+    return p;
+}
+
+static void read_object(Object *o, const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f) link_error("Cannot open object", path);
+
+    o->path = path;
+    if (fread(&o->header, sizeof(o->header), 1, f) != 1) link_error("Invalid header", path);
+    if (o->header.file_type != TINKER_OBJECT) link_error("Not a relocatable object (assemble with -c)", path);
+    if (fread(&o->obj, sizeof(o->obj), 1, f) != 1) link_error("Invalid object header", path);
+
+    o->code = read_array(f, o->header.code_seg_size, 1, path);
+    o->data = read_array(f, o->header.data_seg_size, 1, path);
+    o->syms = read_array(f, o->obj.sym_count, sizeof(struct tinker_symbol), path);
+    o->relocs = read_array(f, o->obj.reloc_count, sizeof(struct tinker_reloc), path);
+    o->strtab = read_array(f, o->obj.strtab_size, 1, path);
+    fclose(f);
+
+    if (o->obj.strtab_size == 0 || o->strtab[o->obj.strtab_size - 1] != '\0') {
+        if (o->obj.sym_count > 0) link_error("Corrupt string table", path);
+    }
+    for (uint64_t i = 0; i < o->obj.sym_count; i++) {
+        if (o->syms[i].name >= o->obj.strtab_size) link_error("Corrupt symbol table", path);
+    }
+}
+
+// Final address of an address in an object's own layout
+static uint64_t rebase(const Object *o, uint64_t addr) {
+    const struct tinker_file_header *h = &o->header;
+    if (addr >= h->code_seg_begin && addr <= h->code_seg_begin + h->code_seg_size) {
+        return o->code_base + (addr - h->code_seg_begin);
+    }
+    if (addr >= h->data_seg_begin && addr <= h->data_seg_begin + h->data_seg_size) {
+        return o->data_base + (addr - h->data_seg_begin);
+    }
+    link_error("Symbol outside its object's segments", o->path);
+    return 0;
+}
+
+static uint64_t symbol_address(const Object *o, uint32_t index, SymbolTable *globals) {
+    if (index >= o->obj.sym_count) link_error("Corrupt relocation", o->path);
+    const struct tinker_symbol *sym = &o->syms[index];
+    char *name = o->strtab + sym->name;
+
+    if (sym->flags & TINKER_SYM_DEFINED) return rebase(o, sym->value);
+
+    uint64_t addr = lookup_label(globals, name);
+    if (addr == (uint64_t)-1) link_error("Undefined symbol", name);
+    return addr;
+}
+
+static void patch_u32(uint8_t *code, uint64_t at, uint32_t mask, uint32_t bits) {
+    uint32_t instr;
+    memcpy(&instr, code + at, 4);
+    instr = (instr & ~mask) | (bits & mask);
+    memcpy(code + at, &instr, 4);
+}
+
+static void apply_relocs(Object *o, SymbolTable *globals) {
+    const struct tinker_file_header *h = &o->header;
+
+    for (uint64_t i = 0; i < o->obj.reloc_count; i++) {
+        const struct tinker_reloc *r = &o->relocs[i];
+        uint64_t target = symbol_address(o, r->symbol, globals);
+
+        switch (r->type) {
+            case TINKER_RELOC_LD: {
+                // xor, then addi/shftli pairs carrying bits 63..52, 51..40, 39..28, 27..16, 15..4, 3..0
+                uint64_t at = r->offset - h->code_seg_begin;
+                if (r->offset < h->code_seg_begin || at + 48 > h->code_seg_size) link_error("Corrupt relocation", o->path);
+                static const int shifts[6] = { 52, 40, 28, 16, 4, 0 };
+                for (int k = 0; k < 6; k++) {
+                    uint32_t chunk = (uint32_t)((target >> shifts[k]) & (k == 5 ? 0xF : 0xFFF));
+                    patch_u32(o->code, at + 4 + 8 * k, 0xFFF, chunk);
+                }
+                break;
+            }
+            case TINKER_RELOC_BRR: {
+                uint64_t at = r->offset - h->code_seg_begin;
+                if (r->offset < h->code_seg_begin || at + 4 > h->code_seg_size) link_error("Corrupt relocation", o->path);
+                int64_t disp = (int64_t)target - (int64_t)(o->code_base + at);
+                if (disp < -2048 || disp > 2047) link_error("Branch offset too large for 12 bits", o->strtab + o->syms[r->symbol].name);
+                patch_u32(o->code, at, 0xFFF, (uint32_t)disp);
+                break;
+            }
+            default:
+                link_error("Unknown relocation type", o->path);
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    const char *output = NULL;
+    int first = 1;
+    while (first < argc && argv[first][0] == '-') {
+        if (strcmp(argv[first], "-o") == 0 && first + 1 < argc) {
+            output = argv[++first];
+        } else if (strncmp(argv[first], "-Tcode=", 7) == 0) {
+            if (tinker_parse_size(argv[first] + 7, &link_code_begin) != 0 || link_code_begin % 4 != 0) {
+                error_exit("Invalid -Tcode address");
+            }
+        } else if (strcmp(argv[first], "-Tdata=after") == 0) {
+            link_data_after = true;
+        } else if (strncmp(argv[first], "-Tdata=", 7) == 0) {
+            if (tinker_parse_size(argv[first] + 7, &link_data_begin) != 0 || link_data_begin % 8 != 0) {
+                error_exit("Invalid -Tdata address");
+            }
+        } else {
+            break;
+        }
+        first++;
+    }
+    if (!output || first >= argc) {
+        fprintf(stderr, "Usage: %s [-Tcode=ADDR] [-Tdata=ADDR|after] -o <output.tko> <object.tko>...\n", argv[0]);
+        return 1;
+    }
+
+    int n = argc - first;
+    Object *objs = calloc(n, sizeof(Object));
+    if (!objs) error_exit("Out of memory");
+
+    // Layout
+    uint64_t code_size = 0, data_size = 0;
+    for (int i = 0; i < n; i++) {
+        read_object(&objs[i], argv[first + i]);
+        objs[i].code_base = link_code_begin + code_size;
+        code_size += objs[i].header.code_seg_size;
+    }
+    if (link_data_after) link_data_begin = (link_code_begin + code_size + 63) & ~(uint64_t)63;
+    for (int i = 0; i < n; i++) {
+        objs[i].data_base = link_data_begin + data_size;
+        data_size += objs[i].header.data_seg_size;
+    }
+    if (code_size > 0 && data_size > 0 &&
+        link_code_begin < link_data_begin + data_size && link_data_begin < link_code_begin + code_size) {
+        error_exit("Code segment overlaps data segment (see -Tdata)");
+    }
+
+    // Global symbols
+    SymbolTable *globals = create_table();
+    for (int i = 0; i < n; i++) {
+        Object *o = &objs[i];
+        for (uint64_t s = 0; s < o->obj.sym_count; s++) {
+            struct tinker_symbol *sym = &o->syms[s];
+            if ((sym->flags & (TINKER_SYM_DEFINED | TINKER_SYM_GLOBAL)) != (TINKER_SYM_DEFINED | TINKER_SYM_GLOBAL)) continue;
+            char *name = o->strtab + sym->name;
+            if (insert_label(globals, name, rebase(o, sym->value)) == 1) link_error("Duplicate symbol", name);
+        }
+    }
+
+    for (int i = 0; i < n; i++) apply_relocs(&objs[i], globals);
+
+    char out_tmp[512];
+    snprintf(out_tmp, sizeof(out_tmp), "%s.tmp", output);
+    FILE *out = fopen(out_tmp, "wb");
+    if (!out) error_exit("Cannot open output file");
+
+    struct tinker_file_header header = {
+        TINKER_EXEC, link_code_begin, code_size, link_data_begin, data_size
+    };
+    fwrite(&header, sizeof(header), 1, out);
+    for (int i = 0; i < n; i++) {
+        if (objs[i].header.code_seg_size) fwrite(objs[i].code, 1, objs[i].header.code_seg_size, out);
+    }
+    for (int i = 0; i < n; i++) {
+        if (objs[i].header.data_seg_size) fwrite(objs[i].data, 1, objs[i].header.data_seg_size, out);
+    }
+    if (fclose(out) != 0) {
+        remove(out_tmp);
+        error_exit("Write failed");
+    }
+    if (rename(out_tmp, output) != 0) error_exit("rename output failed");
+
+    for (int i = 0; i < n; i++) {
+        free(objs[i].code);
+        free(objs[i].data);
+        free(objs[i].syms);
+        free(objs[i].relocs);
+        free(objs[i].strtab);
+    }
+    free(objs);
+    free_table(globals);
+    return 0;
+}
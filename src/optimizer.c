@@ -0,0 +1,1047 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdbool.h>
+#include "tinker_defs.h"
+#include "symbol_table.h"
+#include "assembler.h"
+#include "optimizer.h"
+
+// -O mode: a source-to-source pass over the code statements of a .tk file.
+// It builds a CFG, finds br rX whose register always holds a known code label
+// (label constant propagation), rewrites those to brr :label when the offset
+// fits in 12 bits, then drops every ld whose register is dead afterwards.
+
+#define ALL_REGS 0xFFFFFFFFu
+#define REG(r) (1u << (r))
+
+#define VAL_UNDEF -2   // no path reaches here yet
+#define VAL_UNKNOWN -1 // anything; >= 0 is a label id
+
+enum { K_FALL, K_BRR, K_JUMP, K_COND, K_CALL, K_RET, K_HALT };
+
+typedef struct {
+    char raw[MAX_LINE];
+    char replace[MAX_LINE]; // rewritten text, empty if unchanged
+    bool drop;
+} SrcLine;
+
+typedef struct {
+    int line;
+    int op;
+    int rd;
+    int kind;
+    int jreg;           // register holding the jump target, -1 if none
+    int target;         // label id for ld :x / brr :x, -1 otherwise
+    uint32_t use, def;
+    int jval;           // value of jreg at the branch after propagation
+    uint64_t max_addr;  // address assuming every ld keeps its full 48 bytes
+} Instr;
+
+typedef struct {
+    char name[MAX_LABEL];
+    int instr;          // bound code instruction (n_instr for end of code), -1 for data
+    bool taken;         // address used somewhere other than a brr operand
+} Label;
+
+typedef struct {
+    int start, end;     // [start, end) in the instruction array
+    bool reached;
+    int in[32];
+    uint32_t live_in, live_out;
+} Block;
+
+typedef struct {
+    SrcLine *lines;
+    int n_lines;
+    Instr *instrs;
+    int n_instrs;
+    Label *labels;
+    int n_labels;
+    SymbolTable *names;  // label name -> label id
+    Block *blocks;
+    int n_blocks;
+    int *block_of;       // instruction -> block
+} Program;
+
+static void *grow(void *p, int count, int *cap, size_t elem) {
+    if (count < *cap) return p;
+    *cap = *cap ? *cap * 2 : 64;
+    p = realloc(p, (size_t)*cap * elem);
+    if (!p) error_exit("Out of memory");
+    return p;
+}
+
+static int find_label(Program *prog, const char *name) {
+    char buf[MAX_LABEL];
+    snprintf(buf, sizeof(buf), "%s", name);
+    uint64_t id = lookup_label(prog->names, buf);
+    return (id == (uint64_t)-1) ? -1 : (int)id;
+}
+
+// Register inside a "(rN)(L)" operand
+static int mem_base(const char *arg) {
+    char buf[16];
+    int i = 0;
+    const char *p = arg + 1;
+    while (*p && *p != ')' && i < (int)sizeof(buf) - 1) buf[i++] = *p++;
+    buf[i] = '\0';
+    return parse_register(buf);
+}
+
+// Mark every :label mentioned in a token as address-taken
+static void mark_taken(Program *prog, const char *tok) {
+    const char *c = strchr(tok, ':');
+    if (!c) return;
+    char name[MAX_LABEL];
+    int i = 0;
+    c++;
+    while ((isalnum((unsigned char)*c) || *c == '_') && i < MAX_LABEL - 1) name[i++] = *c++;
+    name[i] = '\0';
+    int id = find_label(prog, name);
+    if (id >= 0) prog->labels[id].taken = true;
+}
+
+// Fill in kind/use/def for one code statement. Returns 1 if the pass cannot reason about it.
+static int classify(Program *prog, Instr *in, char args[4][64], int argc) {
+    int r[4];
+    for (int i = 0; i < 4; i++) r[i] = (i < argc) ? parse_register(args[i]) : -1;
+
+    in->kind = K_FALL;
+    in->jreg = -1;
+    in->target = -1;
+    in->use = in->def = 0;
+    in->rd = r[0];
+
+    switch (in->op) {
+        case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV:
+        case OP_AND: case OP_OR: case OP_XOR: case OP_SHFTR: case OP_SHFTL:
+        case OP_ADDF: case OP_SUBF: case OP_MULF: case OP_DIVF:
+            if (argc != 3 || r[0] < 0 || r[1] < 0 || r[2] < 0) return 1;
+            in->def = REG(r[0]);
+            in->use = REG(r[1]) | REG(r[2]);
+            return 0;
+        case OP_NOT:
+            if (argc != 2 || r[0] < 0 || r[1] < 0) return 1;
+            in->def = REG(r[0]);
+            in->use = REG(r[1]);
+            return 0;
+        case OP_ADDI: case OP_SUBI: case OP_SHFTRI: case OP_SHFTLI:
+            if (argc != 2 || r[0] < 0) return 1;
+            in->def = in->use = REG(r[0]);
+            return 0;
+        case OP_MOV_RR:
+            if (argc != 2) return 1;
+            if (args[0][0] == '(') {
+                int base = mem_base(args[0]);
+                if (base < 0 || r[1] < 0) return 1;
+                in->use = REG(base) | REG(r[1]);
+            } else if (args[1][0] == '(') {
+                int base = mem_base(args[1]);
+                if (base < 0 || r[0] < 0) return 1;
+                in->def = REG(r[0]);
+                in->use = REG(base);
+            } else {
+                if (r[0] < 0) return 1;
+                in->def = REG(r[0]);
+                in->use = (r[1] >= 0) ? REG(r[1]) : REG(r[0]);
+            }
+            return 0;
+        case OP_BR:
+            if (argc != 1 || r[0] < 0) return 1;
+            in->kind = K_JUMP;
+            in->jreg = r[0];
+            in->use = REG(r[0]);
+            return 0;
+        case OP_BRR_L:
+            // Numeric or register brr depends on the final layout, which -O changes
+            if (argc != 1 || args[0][0] != ':') return 1;
+            in->kind = K_BRR;
+            in->target = find_label(prog, args[0] + 1);
+            return (in->target < 0 || prog->labels[in->target].instr < 0);
+        case OP_BRNZ:
+            if (argc != 2 || r[0] < 0 || r[1] < 0) return 1;
+            in->kind = K_COND;
+            in->jreg = r[0];
+            in->use = REG(r[0]) | REG(r[1]);
+            return 0;
+        case OP_BRGT:
+            if (argc != 3 || r[0] < 0 || r[1] < 0 || r[2] < 0) return 1;
+            in->kind = K_COND;
+            in->jreg = r[0];
+            in->use = REG(r[0]) | REG(r[1]) | REG(r[2]);
+            return 0;
+        case OP_CALL:
+            // The callee may read or clobber anything
+            if (argc != 1 || r[0] < 0) return 1;
+            in->kind = K_CALL;
+            in->jreg = r[0];
+            in->use = ALL_REGS;
+            return 0;
+        case OP_RET:
+            in->kind = K_RET;
+            in->use = ALL_REGS;
+            return 0;
+        case OP_PRIV: {
+            if (argc != 4 || r[0] < 0 || r[1] < 0 || r[2] < 0) return 1;
+            long lit = strtol(args[3], NULL, 10);
+            if (lit == 0) in->kind = K_HALT;
+            else if (lit == 3 || lit == PRIV_MAPSIZE) { in->def = REG(r[0]); in->use = REG(r[1]); }
+            else if (lit == 4) in->use = REG(r[0]) | REG(r[1]);
+            else if ((lit >= PRIV_INW && lit <= PRIV_OUTS) || lit == PRIV_MEMCPY || lit == PRIV_MEMSET) in->use = REG(r[0]) | REG(r[1]) | REG(r[2]);
+            else if (lit == PRIV_MEMCMP) { in->def = REG(r[0]); in->use = REG(r[0]) | REG(r[1]) | REG(r[2]); }
+            else { in->use = ALL_REGS; in->def = ALL_REGS; }
+            return 0;
+        }
+        case MACRO_CLR:
+            if (argc != 1 || r[0] < 0) return 1;
+            in->def = REG(r[0]);
+            return 0;
+        case MACRO_HALT:
+            in->kind = K_HALT;
+            return 0;
+        case MACRO_IN:
+        case MACRO_MAPSIZE:
+            if (argc != 2 || r[0] < 0 || r[1] < 0) return 1;
+            in->def = REG(r[0]);
+            in->use = REG(r[1]);
+            return 0;
+        case MACRO_OUT:
+            if (argc != 2 || r[0] < 0 || r[1] < 0) return 1;
+            in->use = REG(r[0]) | REG(r[1]);
+            return 0;
+        case MACRO_INW:
+        case MACRO_OUTW:
+        case MACRO_OUTS:
+        case MACRO_MEMCPY:
+        case MACRO_MEMSET:
+            if (argc != 3 || r[0] < 0 || r[1] < 0 || r[2] < 0) return 1;
+            in->use = REG(r[0]) | REG(r[1]) | REG(r[2]);
+            return 0;
+        case MACRO_MEMCMP:
+            if (argc != 3 || r[0] < 0 || r[1] < 0 || r[2] < 0) return 1;
+            in->def = REG(r[0]);
+            in->use = REG(r[0]) | REG(r[1]) | REG(r[2]);
+            return 0;
+        case MACRO_LD:
+            if (argc != 2 || r[0] < 0) return 1;
+            in->def = REG(r[0]);
+            if (args[1][0] == ':') {
+                int id = find_label(prog, args[1] + 1);
+                if (id >= 0 && prog->labels[id].instr >= 0) in->target = id;
+            }
+            return 0;
+        case MACRO_PUSH:
+            if (argc != 1 || r[0] < 0) return 1;
+            in->use = REG(r[0]) | REG(31);
+            in->def = REG(31);
+            return 0;
+        case MACRO_POP:
+            if (argc != 1 || r[0] < 0) return 1;
+            in->use = REG(31);
+            in->def = REG(r[0]) | REG(31);
+            return 0;
+    }
+    return 1;
+}
+
+static int instr_max_size(int op) {
+    if (op == MACRO_LD) return 48;
+    if (op == MACRO_PUSH || op == MACRO_POP) return 8;
+    return 4;
+}
+
+// Read the source, bind labels and classify code statements. Returns 1 to bail out.
+static int load_program(Program *prog, FILE *in) {
+    int line_cap = 0, instr_cap = 0, label_cap = 0;
+    int *pending = NULL, n_pending = 0, pending_cap = 0;
+    bool in_code = true;
+    char line[MAX_LINE];
+
+    // First read: lines and label binding
+    while (fgets(line, sizeof(line), in)) {
+        prog->lines = grow(prog->lines, prog->n_lines, &line_cap, sizeof(SrcLine));
+        SrcLine *sl = &prog->lines[prog->n_lines++];
+        strcpy(sl->raw, line);
+        sl->replace[0] = '\0';
+        sl->drop = false;
+
+        char clean[MAX_LINE];
+        strcpy(clean, line);
+        trim_line(clean);
+        char *ptr = clean;
+        while (isspace((unsigned char)*ptr)) ptr++;
+        if (*ptr == '\0') continue;
+
+        if (strncmp(ptr, ".code", 5) == 0) { in_code = true;  continue; }
+        if (strncmp(ptr, ".data", 5) == 0) { in_code = false; continue; }
+        if (strncmp(ptr, ".global", 7) == 0) continue;
+
+        if (*ptr == ':') {
+            char name[MAX_LABEL];
+            if (sscanf(ptr + 1, "%256s", name) != 1) return 1;
+            if (insert_label(prog->names, name, prog->n_labels) == 1) return 1;
+            prog->labels = grow(prog->labels, prog->n_labels, &label_cap, sizeof(Label));
+            Label *lb = &prog->labels[prog->n_labels];
+            snprintf(lb->name, MAX_LABEL, "%s", name);
+            lb->instr = -1;
+            lb->taken = false;
+            pending = grow(pending, n_pending, &pending_cap, sizeof(int));
+            pending[n_pending++] = prog->n_labels++;
+            continue;
+        }
+
+        for (int i = 0; i < n_pending; i++) {
+            prog->labels[pending[i]].instr = in_code ? prog->n_instrs : -1;
+        }
+        n_pending = 0;
+
+        if (!in_code) continue;
+
+        prog->instrs = grow(prog->instrs, prog->n_instrs, &instr_cap, sizeof(Instr));
+        Instr *ins = &prog->instrs[prog->n_instrs++];
+        memset(ins, 0, sizeof(*ins));
+        ins->line = prog->n_lines - 1;
+    }
+    for (int i = 0; i < n_pending; i++) {
+        prog->labels[pending[i]].instr = in_code ? prog->n_instrs : -1;
+    }
+    free(pending);
+
+    // Second read: operands, now that every label is known
+    in_code = true;
+    uint64_t addr = 0;
+    for (int l = 0, k = 0; l < prog->n_lines; l++) {
+        char clean[MAX_LINE];
+        strcpy(clean, prog->lines[l].raw);
+        trim_line(clean);
+        char *ptr = clean;
+        while (isspace((unsigned char)*ptr)) ptr++;
+        if (*ptr == '\0' || *ptr == ':') continue;
+        if (strncmp(ptr, ".code", 5) == 0) { in_code = true;  continue; }
+        if (strncmp(ptr, ".data", 5) == 0) { in_code = false; continue; }
+        if (strncmp(ptr, ".global", 7) == 0) continue;
+
+        if (!in_code) {
+            mark_taken(prog, ptr);
+            continue;
+        }
+
+        Instr *ins = &prog->instrs[k++];
+        char mnem[64], args[4][64];
+        int argc = 0;
+        char *token = strtok(ptr, " ,\t\n");
+        if (!token) return 1;
+        snprintf(mnem, sizeof(mnem), "%s", token);
+        while ((token = strtok(NULL, " ,\t\n"))) {
+            if (argc >= 4) return 1;
+            snprintf(args[argc++], 64, "%s", token);
+        }
+
+        ins->op = get_opcode(mnem);
+        if (classify(prog, ins, args, argc) != 0) return 1;
+        if (ins->op != OP_BRR_L) {
+            for (int i = 0; i < argc; i++) mark_taken(prog, args[i]);
+        }
+        ins->max_addr = addr;
+        addr += instr_max_size(ins->op);
+    }
+    return 0;
+}
+
+static void build_blocks(Program *prog) {
+    int n = prog->n_instrs;
+    bool *leader = calloc(n + 1, sizeof(bool));
+    prog->block_of = malloc((n + 1) * sizeof(int));
+    if (!leader || !prog->block_of) error_exit("Out of memory");
+
+    leader[0] = true;
+    for (int i = 0; i < prog->n_labels; i++) {
+        if (prog->labels[i].instr >= 0) leader[prog->labels[i].instr] = true;
+    }
+    for (int i = 0; i < n; i++) {
+        if (prog->instrs[i].kind != K_FALL) leader[i + 1] = true;
+    }
+
+    int cap = 0;
+    for (int i = 0; i < n; i++) {
+        if (leader[i]) {
+            prog->blocks = grow(prog->blocks, prog->n_blocks, &cap, sizeof(Block));
+            Block *b = &prog->blocks[prog->n_blocks++];
+            memset(b, 0, sizeof(*b));
+            b->start = i;
+            for (int r = 0; r < 32; r++) b->in[r] = VAL_UNDEF;
+        }
+        prog->blocks[prog->n_blocks - 1].end = i + 1;
+        prog->block_of[i] = prog->n_blocks - 1;
+    }
+    prog->block_of[n] = -1; // end of code
+    free(leader);
+}
+
+// Blocks a jump through a register holding v may reach
+static int jump_targets(Program *prog, int v, int *out) {
+    int count = 0;
+    if (v >= 0) {
+        int b = prog->block_of[prog->labels[v].instr];
+        if (b >= 0) out[count++] = b;
+    } else if (v == VAL_UNKNOWN) {
+        for (int i = 0; i < prog->n_labels; i++) {
+            if (!prog->labels[i].taken || prog->labels[i].instr < 0) continue;
+            int b = prog->block_of[prog->labels[i].instr];
+            if (b >= 0) out[count++] = b;
+        }
+    }
+    return count;
+}
+
+// Successors of a block; *after_call marks the fallthrough edge of a call
+static int successors(Program *prog, int b, int *out, int *call_return) {
+    Block *blk = &prog->blocks[b];
+    Instr *last = &prog->instrs[blk->end - 1];
+    int next = (blk->end < prog->n_instrs) ? b + 1 : -1;
+    int count = 0;
+    *call_return = -1;
+
+    switch (last->kind) {
+        case K_FALL:
+            if (next >= 0) out[count++] = next;
+            break;
+        case K_BRR: {
+            int tb = prog->block_of[prog->labels[last->target].instr];
+            if (tb >= 0) out[count++] = tb;
+            break;
+        }
+        case K_JUMP:
+            count = jump_targets(prog, last->jval, out);
+            break;
+        case K_COND:
+            count = jump_targets(prog, last->jval, out);
+            if (next >= 0) out[count++] = next;
+            break;
+        case K_CALL:
+            count = jump_targets(prog, last->jval, out);
+            if (next >= 0) *call_return = next;
+            break;
+    }
+    return count;
+}
+
+static bool meet_into(Block *b, const int *st) {
+    bool changed = !b->reached;
+    b->reached = true;
+    for (int r = 0; r < 32; r++) {
+        int v = b->in[r];
+        if (v == VAL_UNDEF) v = st[r];
+        else if (st[r] != VAL_UNDEF && st[r] != v) v = VAL_UNKNOWN;
+        if (v != b->in[r]) {
+            b->in[r] = v;
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+// Forward propagation of label constants, growing the CFG as jump targets become known
+static void propagate_constants(Program *prog) {
+    int nb = prog->n_blocks;
+    int *work = malloc((nb + 1) * sizeof(int));
+    bool *queued = calloc(nb, sizeof(bool));
+    int *succ = malloc((prog->n_labels + 2) * sizeof(int));
+    if (!work || !queued || !succ) error_exit("Out of memory");
+
+    int unknown[32];
+    for (int r = 0; r < 32; r++) unknown[r] = VAL_UNKNOWN;
+
+    int head = 0, tail = 0;
+    meet_into(&prog->blocks[0], unknown);
+    work[tail++] = 0;
+    queued[0] = true;
+
+    while (head != tail) {
+        int b = work[head];
+        head = (head + 1) % (nb + 1);
+        queued[b] = false;
+
+        Block *blk = &prog->blocks[b];
+        int st[32];
+        memcpy(st, blk->in, sizeof(st));
+
+        for (int i = blk->start; i < blk->end; i++) {
+            Instr *ins = &prog->instrs[i];
+            if (ins->jreg >= 0) ins->jval = st[ins->jreg];
+            for (int r = 0; r < 32; r++) {
+                if (ins->def & REG(r)) st[r] = VAL_UNKNOWN;
+            }
+            if (ins->op == MACRO_LD && ins->target >= 0) st[ins->rd] = ins->target;
+        }
+
+        int call_return;
+        int count = successors(prog, b, succ, &call_return);
+        for (int s = 0; s <= count; s++) {
+            int to = (s < count) ? succ[s] : call_return;
+            if (to < 0) continue;
+            if (meet_into(&prog->blocks[to], (s < count) ? st : unknown) && !queued[to]) {
+                work[tail] = to;
+                tail = (tail + 1) % (nb + 1);
+                queued[to] = true;
+            }
+        }
+    }
+
+    free(work);
+    free(queued);
+    free(succ);
+}
+
+static void rewrite_jumps(Program *prog, OptStats *stats) {
+    for (int b = 0; b < prog->n_blocks; b++) {
+        if (!prog->blocks[b].reached) continue;
+        Instr *ins = &prog->instrs[prog->blocks[b].end - 1];
+        if (ins->kind != K_JUMP || ins->jval < 0) continue;
+
+        Label *lb = &prog->labels[ins->jval];
+        uint64_t target = (lb->instr < prog->n_instrs)
+            ? prog->instrs[lb->instr].max_addr
+            : prog->instrs[prog->n_instrs - 1].max_addr + instr_max_size(prog->instrs[prog->n_instrs - 1].op);
+
+        // Sizes only shrink from here, so an offset that fits now still fits after layout
+        int64_t dist = (int64_t)target - (int64_t)ins->max_addr;
+        if (dist < -2048 || dist > 2047) continue;
+
+        snprintf(prog->lines[ins->line].replace, MAX_LINE, "\tbrr :%s\n", lb->name);
+        ins->kind = K_BRR;
+        ins->target = ins->jval;
+        ins->jreg = -1;
+        ins->use = 0;
+        stats->jumps_rewritten++;
+    }
+}
+
+static void remove_dead_lds(Program *prog, OptStats *stats) {
+    int nb = prog->n_blocks;
+    int *succ = malloc((prog->n_labels + 2) * sizeof(int));
+    if (!succ) error_exit("Out of memory");
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int b = nb - 1; b >= 0; b--) {
+            Block *blk = &prog->blocks[b];
+            Instr *last = &prog->instrs[blk->end - 1];
+            uint32_t out = 0;
+
+            if (!blk->reached || last->kind == K_RET ||
+                ((last->kind == K_JUMP || last->kind == K_COND || last->kind == K_CALL) && last->jval < 0)) {
+                out = ALL_REGS;
+            } else {
+                int call_return;
+                int count = successors(prog, b, succ, &call_return);
+                for (int s = 0; s < count; s++) out |= prog->blocks[succ[s]].live_in;
+                if (call_return >= 0) out |= prog->blocks[call_return].live_in;
+            }
+
+            uint32_t live = out;
+            for (int i = blk->end - 1; i >= blk->start; i--) {
+                Instr *ins = &prog->instrs[i];
+                live = (live & ~ins->def) | ins->use;
+            }
+            if (out != blk->live_out || live != blk->live_in) {
+                blk->live_out = out;
+                blk->live_in = live;
+                changed = true;
+            }
+        }
+    }
+
+    for (int b = 0; b < nb; b++) {
+        Block *blk = &prog->blocks[b];
+        if (!blk->reached) continue;
+        uint32_t live = blk->live_out;
+        for (int i = blk->end - 1; i >= blk->start; i--) {
+            Instr *ins = &prog->instrs[i];
+            if (ins->op == MACRO_LD && !(live & ins->def)) {
+                prog->lines[ins->line].drop = true;
+                stats->lds_removed++;
+                continue;
+            }
+            live = (live & ~ins->def) | ins->use;
+        }
+    }
+    free(succ);
+}
+
+int optimize_source(const char *input, const char *output, OptStats *stats) {
+    FILE *in = fopen(input, "r");
+    if (!in) error_exit("Cannot open input file");
+
+    Program prog;
+    memset(&prog, 0, sizeof(prog));
+    prog.names = create_table();
+    memset(stats, 0, sizeof(*stats));
+
+    int bail = load_program(&prog, in);
+    fclose(in);
+
+    if (!bail && prog.n_instrs > 0) {
+        build_blocks(&prog);
+        propagate_constants(&prog);
+        rewrite_jumps(&prog, stats);
+        remove_dead_lds(&prog, stats);
+    }
+
+    FILE *out = fopen(output, "w");
+    if (!out) error_exit("Cannot open optimizer output file");
+    for (int l = 0; l < prog.n_lines; l++) {
+        SrcLine *sl = &prog.lines[l];
+        if (bail) fputs(sl->raw, out);
+        else if (sl->drop) fputs("\n", out);   // keep line numbers for the v2 line map
+        else fputs(sl->replace[0] ? sl->replace : sl->raw, out);
+    }
+    fclose(out);
+
+    free(prog.lines);
+    free(prog.instrs);
+    free(prog.labels);
+    free(prog.blocks);
+    free(prog.block_of);
+    free_table(prog.names);
+    return bail;
+}
+
+// -P mode: profile-guided block layout. A hw5-sim -p profile of the program,
+// assembled as it is here without -P, gives how often each statement ran and
+// how often each branch went where. Blocks are chained greedily along their
+// heaviest edges (Pettis-Hansen), so hot code falls through: a block whose
+// jump target ends up right after it loses the jump, and one whose fallthrough
+// is placed elsewhere gains a brr. A loop whose latch jumps back to a header
+// that branches into the body is rotated this way, leaving the test at the
+// bottom. A header that branches out of the loop cannot be: Tinker has no
+// inverted brgt/brnz, so it keeps its place. Cold chains go last.
+
+typedef struct {
+    int from, to;       // statement indexes
+    uint64_t count;
+} ProfEdge;
+
+typedef struct {
+    int from, to;       // blocks
+    uint64_t weight;
+    int rank;           // 0: call return, must stay; 1: fallthrough; 2: jump
+} LayoutEdge;
+
+typedef struct {
+    int *order;         // blocks in their new order
+    int *brr_to;        // block an appended brr continues to, -1 if none
+    bool *drop;         // the closing jump lands on the next block and goes
+    char (*new_label)[MAX_LABEL];  // label made up for a brr target with none
+} Layout;
+
+static int compare_prof_edges(const void *a, const void *b) {
+    const ProfEdge *x = a, *y = b;
+    if (x->from != y->from) return x->from - y->from;
+    return x->to - y->to;
+}
+
+static int compare_layout_edges(const void *a, const void *b) {
+    const LayoutEdge *x = a, *y = b;
+    if ((x->rank == 0) != (y->rank == 0)) return x->rank == 0 ? -1 : 1;
+    if (x->weight != y->weight) return x->weight > y->weight ? -1 : 1;
+    if (x->rank != y->rank) return x->rank - y->rank;
+    return x->from - y->from;
+}
+
+// Statement at (or, unless exact, containing) pc; -1 if none
+static int stmt_at(const uint64_t *addr, int n, uint64_t end, uint64_t pc, bool exact) {
+    if (pc < addr[0] || pc >= end) return -1;
+    int lo = 0, hi = n - 1;
+    while (lo < hi) {
+        int mid = (lo + hi + 1) / 2;
+        if (addr[mid] <= pc) lo = mid;
+        else hi = mid - 1;
+    }
+    return (exact && addr[lo] != pc) ? -1 : lo;
+}
+
+static ProfEdge *read_profile(Program *prog, const char *path, const uint64_t *addr, uint64_t *count, int *n_edges) {
+    FILE *f = fopen(path, "r");
+    if (!f) error_exit("Cannot open profile file");
+    int n = prog->n_instrs, cap = 0;
+    uint64_t end = addr[n - 1] + instr_max_size(prog->instrs[n - 1].op);
+    ProfEdge *edges = NULL;
+    char line[256];
+    *n_edges = 0;
+
+    while (fgets(line, sizeof(line), f)) {
+        unsigned long long a, b, c;
+        if (line[0] == '#' || line[0] == '\n') continue;
+        if (sscanf(line, "pc %llx %llu", &a, &c) == 2) {
+            int i = stmt_at(addr, n, end, a, true);
+            if (i >= 0) count[i] += c;   // pcs inside ld, push and pop expansions stay out
+        } else if (sscanf(line, "edge %llx %llx %llu", &a, &b, &c) == 3) {
+            int from = stmt_at(addr, n, end, a, false);
+            if (from < 0) continue;
+            int to = stmt_at(addr, n, end, b, true);
+            if (prog->instrs[from].kind == K_FALL || (to < 0 && stmt_at(addr, n, end, b, false) >= 0)) {
+                error_exit("Profile does not match program");
+            }
+            if (to < 0) continue;
+            edges = grow(edges, *n_edges, &cap, sizeof(ProfEdge));
+            edges[(*n_edges)++] = (ProfEdge){ from, to, c };
+        } else {
+            error_exit("Invalid profile");
+        }
+    }
+    fclose(f);
+    if (*n_edges) qsort(edges, *n_edges, sizeof(ProfEdge), compare_prof_edges);
+    return edges;
+}
+
+static uint64_t edge_count(const ProfEdge *edges, int n_edges, int from, int to) {
+    int lo = 0, hi = n_edges;
+    ProfEdge key = { from, to, 0 };
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (compare_prof_edges(&edges[mid], &key) < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    return (lo < n_edges && edges[lo].from == from && edges[lo].to == to) ? edges[lo].count : 0;
+}
+
+// Block a block must continue into, -1 if none, -2 if it runs off the end of the code
+static int fall_successor(Program *prog, int b) {
+    Block *blk = &prog->blocks[b];
+    int kind = prog->instrs[blk->end - 1].kind;
+    if (kind != K_FALL && kind != K_COND && kind != K_CALL) return -1;
+    return (blk->end < prog->n_instrs) ? b + 1 : -2;
+}
+
+// Block a block's closing brr, or br through a known label, always goes to; -1 if none
+static int jump_successor(Program *prog, int b) {
+    Instr *last = &prog->instrs[prog->blocks[b].end - 1];
+    int label = -1;
+    if (last->kind == K_BRR) label = last->target;
+    else if (last->kind == K_JUMP && prog->blocks[b].reached && last->jval >= 0) label = last->jval;
+    return (label >= 0) ? prog->block_of[prog->labels[label].instr] : -1;
+}
+
+static int chain_root(int *parent, int b) {
+    while (parent[b] != b) b = parent[b] = parent[parent[b]];
+    return b;
+}
+
+// Choose the new block order. Returns 1 to keep the source as it is.
+static int plan_layout(Program *prog, Layout *lay, const char *profile,
+                       const struct tinker_line *map, size_t n_map, LayoutStats *stats) {
+    int n = prog->n_instrs, nb = prog->n_blocks;
+    for (int i = 0; i < prog->n_labels; i++) {
+        if (prog->labels[i].instr == n) return 1;   // a label past the last statement would move with the data
+    }
+    for (int b = 0; b < nb; b++) {
+        if (fall_successor(prog, b) == -2) return 1;
+    }
+
+    // Statement addresses as profiled
+    int *instr_of_line = malloc(prog->n_lines * sizeof(int));
+    uint64_t *addr = malloc(n * sizeof(uint64_t));
+    bool *seen = calloc(n, sizeof(bool));
+    if (!instr_of_line || !addr || !seen) error_exit("Out of memory");
+    for (int l = 0; l < prog->n_lines; l++) instr_of_line[l] = -1;
+    for (int i = 0; i < n; i++) instr_of_line[prog->instrs[i].line] = i;
+    for (size_t k = 0; k < n_map; k++) {
+        int l = (int)map[k].line - 1;
+        int i = (l >= 0 && l < prog->n_lines) ? instr_of_line[l] : -1;
+        if (i < 0) error_exit("Profile does not match program");
+        addr[i] = map[k].addr;
+        seen[i] = true;
+    }
+    int bail = 0;
+    for (int i = 0; i < n; i++) {
+        if (!seen[i] || (i > 0 && addr[i] <= addr[i - 1])) bail = 1;
+    }
+    free(instr_of_line);
+    free(seen);
+    if (bail) {
+        free(addr);
+        return 1;
+    }
+
+    uint64_t *count = calloc(n, sizeof(uint64_t));
+    uint64_t *taken = calloc(n, sizeof(uint64_t));
+    if (!count || !taken) error_exit("Out of memory");
+    int n_edges;
+    ProfEdge *edges = read_profile(prog, profile, addr, count, &n_edges);
+    for (int e = 0; e < n_edges; e++) taken[edges[e].from] += edges[e].count;
+    free(addr);
+
+    // Candidate fallthroughs, heaviest first
+    LayoutEdge *cand = malloc(2 * nb * sizeof(LayoutEdge));
+    int *fall = malloc(nb * sizeof(int));
+    if (!cand || !fall) error_exit("Out of memory");
+    int n_cand = 0;
+    for (int b = 0; b < nb; b++) {
+        int last = prog->blocks[b].end - 1;
+        fall[b] = fall_successor(prog, b);
+        if (fall[b] >= 0) {
+            uint64_t w = count[last] > taken[last] ? count[last] - taken[last] : 0;
+            cand[n_cand++] = (LayoutEdge){ b, fall[b], w, prog->instrs[last].kind == K_CALL ? 0 : 1 };
+        }
+        int t = jump_successor(prog, b);
+        uint64_t w = (t >= 0) ? edge_count(edges, n_edges, last, prog->blocks[t].start) : 0;
+        if (t > 0 && t != b && w > 0) cand[n_cand++] = (LayoutEdge){ b, t, w, 2 };
+    }
+    qsort(cand, n_cand, sizeof(LayoutEdge), compare_layout_edges);
+
+    int *next = malloc(nb * sizeof(int));
+    int *prev = malloc(nb * sizeof(int));
+    int *parent = malloc(nb * sizeof(int));
+    bool *hot = calloc(nb, sizeof(bool));
+    bool *placed = calloc(nb, sizeof(bool));
+    if (!next || !prev || !parent || !hot || !placed) error_exit("Out of memory");
+    for (int b = 0; b < nb; b++) next[b] = prev[b] = -1, parent[b] = b;
+
+    for (int c = 0; c < n_cand && !bail; c++) {
+        int from = cand[c].from, to = cand[c].to;
+        bool ok = to != 0 && next[from] < 0 && prev[to] < 0 && chain_root(parent, from) != chain_root(parent, to);
+        if (ok) {
+            next[from] = to;
+            prev[to] = from;
+            parent[chain_root(parent, to)] = chain_root(parent, from);
+        } else if (cand[c].rank == 0) {
+            bail = 1;   // a call must return to the statement after it
+        }
+    }
+    for (int b = 0; b < nb; b++) {
+        if (count[prog->blocks[b].start] > 0) hot[chain_root(parent, b)] = true;
+    }
+
+    // Entry chain first; then the chain a placed block falls into, else the
+    // next hot chain in source order, and the cold ones last
+    int n_order = 0, cursor[2] = { 0, 0 };
+    for (int head = 0; !bail && n_order < nb; ) {
+        for (int b = head; b >= 0; b = next[b]) {
+            lay->order[n_order++] = b;
+            placed[b] = true;
+        }
+        if (n_order == nb) break;
+        int s = fall[lay->order[n_order - 1]];
+        head = (s >= 0 && !placed[s] && prev[s] < 0) ? s : -1;
+        for (int pass = 0; head < 0 && pass < 2; pass++) {
+            int *cur = &cursor[pass];
+            while (*cur < nb && (placed[*cur] || prev[*cur] >= 0 || hot[chain_root(parent, *cur)] != (pass == 0))) (*cur)++;
+            if (*cur < nb) head = *cur;
+        }
+    }
+
+    if (!bail) {
+        for (int p = 0; p < nb; p++) {
+            int b = lay->order[p];
+            int after = (p + 1 < nb) ? lay->order[p + 1] : -1;
+            lay->brr_to[b] = -1;
+            if (fall[b] >= 0 && fall[b] != after) {
+                lay->brr_to[b] = fall[b];
+                stats->jumps_added++;
+            }
+            lay->drop[b] = jump_successor(prog, b) == after && after >= 0;
+            if (lay->drop[b]) stats->jumps_removed++;
+            if (b != p) stats->blocks_moved++;
+        }
+
+        // Every brr must still reach: check against the largest size each statement can take
+        uint64_t *block_addr = malloc(nb * sizeof(uint64_t));
+        uint64_t *brr_addr = malloc(nb * sizeof(uint64_t));
+        uint64_t *last_addr = malloc(nb * sizeof(uint64_t));
+        if (!block_addr || !brr_addr || !last_addr) error_exit("Out of memory");
+        uint64_t at = 0;
+        for (int p = 0; p < nb; p++) {
+            int b = lay->order[p];
+            Block *blk = &prog->blocks[b];
+            block_addr[b] = at;
+            for (int i = blk->start; i < blk->end; i++) {
+                if (i == blk->end - 1) last_addr[b] = at;
+                if (i < blk->end - 1 || !lay->drop[b]) at += instr_max_size(prog->instrs[i].op);
+            }
+            brr_addr[b] = at;
+            if (lay->brr_to[b] >= 0) at += 4;
+        }
+        for (int b = 0; b < nb && !bail; b++) {
+            Instr *last = &prog->instrs[prog->blocks[b].end - 1];
+            int64_t dist;
+            if (last->kind == K_BRR && !lay->drop[b]) {
+                dist = (int64_t)block_addr[prog->block_of[prog->labels[last->target].instr]] - (int64_t)last_addr[b];
+                if (dist < -2048 || dist > 2047) bail = 1;
+            }
+            if (lay->brr_to[b] >= 0) {
+                dist = (int64_t)block_addr[lay->brr_to[b]] - (int64_t)brr_addr[b];
+                if (dist < -2048 || dist > 2047) bail = 1;
+            }
+        }
+        free(block_addr);
+        free(brr_addr);
+        free(last_addr);
+    }
+
+    free(count);
+    free(taken);
+    free(edges);
+    free(cand);
+    free(fall);
+    free(next);
+    free(prev);
+    free(parent);
+    free(hot);
+    free(placed);
+    return bail;
+}
+
+// Name of a label on block b's first statement, made up if it has none
+static const char *block_label(Program *prog, Layout *lay, int b) {
+    for (int i = 0; i < prog->n_labels; i++) {
+        if (prog->labels[i].instr == prog->blocks[b].start) return prog->labels[i].name;
+    }
+    if (!lay->new_label[b][0]) {
+        int k = 0;
+        do snprintf(lay->new_label[b], MAX_LABEL, k ? "__layout_%d_%d" : "__layout_%d", b, k);
+        while (find_label(prog, lay->new_label[b]) >= 0 && ++k);
+    }
+    return lay->new_label[b];
+}
+
+static void emit_line(FILE *out, const char *text, int from, int **origin, int *n_origin, int *cap) {
+    size_t len = strlen(text);
+    fputs(text, out);
+    if (len == 0 || text[len - 1] != '\n') fputc('\n', out);
+    *origin = grow(*origin, *n_origin, cap, sizeof(int));
+    (*origin)[(*n_origin)++] = from;
+}
+
+// Code first, block by block in the new order, then everything else in source order
+static void emit_layout(Program *prog, Layout *lay, FILE *out, int **origin, int *n_origin) {
+    int nl = prog->n_lines, nb = prog->n_blocks, cap = 0;
+    int *owner = malloc(nl * sizeof(int));    // block, -1 outside the code, -2 blank or comment
+    int *first = malloc(nb * sizeof(int));
+    int *next_line = malloc(nl * sizeof(int));
+    int *instr_of_line = malloc(nl * sizeof(int));
+    if (!owner || !first || !next_line || !instr_of_line) error_exit("Out of memory");
+    for (int l = 0; l < nl; l++) instr_of_line[l] = -1;
+    for (int i = 0; i < prog->n_instrs; i++) instr_of_line[prog->instrs[i].line] = i;
+
+    bool in_code = true;
+    for (int l = 0; l < nl; l++) {
+        char clean[MAX_LINE];
+        strcpy(clean, prog->lines[l].raw);
+        trim_line(clean);
+        char *ptr = clean;
+        while (isspace((unsigned char)*ptr)) ptr++;
+        owner[l] = -1;
+        if (*ptr == '\0') owner[l] = -2;
+        else if (strncmp(ptr, ".code", 5) == 0) in_code = true;
+        else if (strncmp(ptr, ".data", 5) == 0) in_code = false;
+        else if (*ptr == ':') {
+            char name[MAX_LABEL];
+            int id = (sscanf(ptr + 1, "%256s", name) == 1) ? find_label(prog, name) : -1;
+            if (id >= 0 && prog->labels[id].instr >= 0) owner[l] = prog->block_of[prog->labels[id].instr];
+        } else if (in_code && instr_of_line[l] >= 0) {
+            owner[l] = prog->block_of[instr_of_line[l]];
+        }
+    }
+    // A comment goes with whatever follows it
+    for (int l = nl - 1, follow = -1; l >= 0; l--) {
+        if (owner[l] == -2) owner[l] = follow;
+        else follow = owner[l];
+    }
+    for (int b = 0; b < nb; b++) first[b] = -1;
+    for (int l = nl - 1; l >= 0; l--) {
+        if (owner[l] < 0) continue;
+        next_line[l] = first[owner[l]];
+        first[owner[l]] = l;
+    }
+
+    *origin = NULL;
+    *n_origin = 0;
+    emit_line(out, ".code\n", 0, origin, n_origin, &cap);
+    for (int p = 0; p < nb; p++) {
+        int b = lay->order[p];
+        char text[MAX_LINE];
+        if (lay->new_label[b][0]) {
+            snprintf(text, sizeof(text), ":%s\n", lay->new_label[b]);
+            emit_line(out, text, 0, origin, n_origin, &cap);
+        }
+        int dropped = lay->drop[b] ? prog->instrs[prog->blocks[b].end - 1].line : -1;
+        for (int l = first[b]; l >= 0; l = next_line[l]) {
+            if (l != dropped) emit_line(out, prog->lines[l].raw, l + 1, origin, n_origin, &cap);
+        }
+        if (lay->brr_to[b] >= 0) {
+            snprintf(text, sizeof(text), "\tbrr :%s\n", block_label(prog, lay, lay->brr_to[b]));
+            emit_line(out, text, 0, origin, n_origin, &cap);
+        }
+    }
+    for (int l = 0; l < nl; l++) {
+        if (owner[l] == -1) emit_line(out, prog->lines[l].raw, l + 1, origin, n_origin, &cap);
+    }
+
+    free(owner);
+    free(first);
+    free(next_line);
+    free(instr_of_line);
+}
+
+int layout_source(const char *input, const char *output, const char *profile,
+                  const struct tinker_line *map, size_t n_map,
+                  int **origin, int *n_origin, LayoutStats *stats) {
+    FILE *in = fopen(input, "r");
+    if (!in) error_exit("Cannot open input file");
+
+    Program prog;
+    memset(&prog, 0, sizeof(prog));
+    prog.names = create_table();
+    memset(stats, 0, sizeof(*stats));
+    *origin = NULL;
+    *n_origin = 0;
+
+    int bail = load_program(&prog, in);
+    fclose(in);
+
+    Layout lay;
+    memset(&lay, 0, sizeof(lay));
+    if (!bail && prog.n_instrs > 0) {
+        build_blocks(&prog);
+        propagate_constants(&prog);
+        int nb = prog.n_blocks;
+        lay.order = malloc(nb * sizeof(int));
+        lay.brr_to = malloc(nb * sizeof(int));
+        lay.drop = calloc(nb, sizeof(bool));
+        lay.new_label = calloc(nb, MAX_LABEL);
+        if (!lay.order || !lay.brr_to || !lay.drop || !lay.new_label) error_exit("Out of memory");
+        bail = plan_layout(&prog, &lay, profile, map, n_map, stats);
+    } else {
+        bail = 1;
+    }
+    if (bail) memset(stats, 0, sizeof(*stats));
+
+    FILE *out = fopen(output, "w");
+    if (!out) error_exit("Cannot open layout output file");
+    if (bail) {
+        for (int l = 0; l < prog.n_lines; l++) fputs(prog.lines[l].raw, out);
+    } else {
+        // Made-up labels are named while the brrs are written, before their blocks come up
+        for (int b = 0; b < prog.n_blocks; b++) {
+            if (lay.brr_to[b] >= 0) block_label(&prog, &lay, lay.brr_to[b]);
+        }
+        emit_layout(&prog, &lay, out, origin, n_origin);
+    }
+    fclose(out);
+
+    free(lay.order);
+    free(lay.brr_to);
+    free(lay.drop);
+    free(lay.new_label);
+    free(prog.lines);
+    free(prog.instrs);
+    free(prog.labels);
+    free(prog.blocks);
+    free(prog.block_of);
+    free_table(prog.names);
+    return bail;
+}
@@ -5,35 +5,360 @@
 #include <stdbool.h>
 #include <errno.h>
 #include <inttypes.h>
+#include <signal.h>
+#include <setjmp.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
 
 #include "tinker_defs.h"
+#include "tinker_size.h"
+#include "tko_codec.h"
 
-#define MEM_SIZE 524288 // 512 * 1024
+#define MEM_SIZE TINKER_DEFAULT_MEM_SIZE // unless -m or the program asks for more
 
 // States
 uint64_t registers[32] = { [31] = MEM_SIZE };
 uint64_t program_counter = 0x2000;
-uint8_t memory[MEM_SIZE];
+static uint8_t default_memory[MEM_SIZE] __attribute__((aligned(4096)));
+uint8_t *memory = default_memory;
+uint64_t mem_size = MEM_SIZE;
 bool halt_program = false;
 
+// Guest memory size from -m; 0 means use the program's own request or the default
+static uint64_t requested_mem_size = 0;
+
+// memory is still the zero-filled image the process started with, so loading
+// bss needs no clearing; the kernel hands out zero pages as they are touched
+static bool memory_pristine = true;
+
+// Guest pages written since the last clear_dirty_pages(), one bit per
+// DIRTY_PAGE bytes. mov (rd)(L), rs and call store one aligned word, which never
+// straddles a page; the inw, memcpy and memset services mark every page they cover.
+// Code is fetched from guest memory on every instruction, so there is no decoded
+// copy for a store to invalidate.
+#define DIRTY_PAGE_SHIFT 12
+#define DIRTY_WORDS(size) ((((size) >> DIRTY_PAGE_SHIFT) + 63) / 64 + 1)
+static uint64_t default_dirty_pages[DIRTY_WORDS(MEM_SIZE)];
+static uint64_t *dirty_pages = default_dirty_pages;
+
+static inline void mark_dirty(uint64_t addr) {
+    uint64_t page = addr >> DIRTY_PAGE_SHIFT;
+    dirty_pages[page >> 6] |= 1ULL << (page & 63);
+}
+
+static void mark_dirty_range(uint64_t addr, uint64_t len) {
+    if (len == 0) return;
+    for (uint64_t page = addr >> DIRTY_PAGE_SHIFT; page <= (addr + len - 1) >> DIRTY_PAGE_SHIFT; page++) {
+        dirty_pages[page >> 6] |= 1ULL << (page & 63);
+    }
+}
+
+static void clear_dirty_pages(void) {
+    memset(dirty_pages, 0, DIRTY_WORDS(mem_size) * sizeof(uint64_t));
+}
+
+// Exit status for a guest stopped by -i or -t, as timeout(1) uses
+#define SIM_EXIT_LIMIT 124
+
+// Instruction budget (-i) and wall-clock deadline in seconds (-t); 0 means none
+static uint64_t instruction_limit = 0;
+static double time_limit = 0;
+static volatile sig_atomic_t deadline_passed = 0;
+
+// Guest stdin and stdout; NULL means the process's own. In daemon mode they are
+// the request's input and reply, and error messages go to the reply as well.
+static FILE *guest_in = NULL;
+static FILE *guest_out = NULL;
+
+// Raw binary I/O (-b, -B). With raw_in open, reads from port 3 take little-endian
+// u64s from it instead of decimal text; with raw_out set, port 1 writes 8 raw
+// bytes per word there instead of a decimal line. A regular input file is mmap'd;
+// a pipe is read in RAW_CHUNK blocks, and reads that large go straight to the guest.
+#define RAW_CHUNK (1 << 20)
+static struct {
+    bool open;
+    int fd;
+    uint8_t *map;      // the whole file, when mmap'd
+    uint8_t *buf;      // RAW_CHUNK bytes otherwise
+    size_t pos, len;   // next unread byte and end of the bytes in map or buf
+} raw_in;
+static FILE *raw_out = NULL;
+
+// Set while the daemon serves a request, so exits end the request, not the process
+static jmp_buf *request_abort = NULL;
+static int request_status;
+
+static void write_profile(void);
+static void stats_stop(void);
+
+static void sim_exit(int status) {
+    if (!request_abort) {
+        write_profile();
+        stats_stop();
+    }
+    if (request_abort) {
+        request_status = status;
+        longjmp(*request_abort, 1);
+    }
+    exit(status);
+}
+
+static FILE *error_stream(void) {
+    return guest_out ? guest_out : stderr;
+}
+
 // Error Out
 void error_exit(const char *msg) {
-    fprintf(stderr, "%s\n", msg);
-    exit(1);
+    fprintf(error_stream(), "%s\n", msg);
+    sim_exit(1);
+}
+
+// Profile (-p FILE): how often each instruction address ran and how often each
+// taken control transfer (from, to) happened, written when the guest stops.
+// hw5-asm -P reads it back to lay out basic blocks.
+static const char *profile_path = NULL;
+static uint64_t *profile_pcs = NULL;   // one count per 4-byte word of guest memory
+static struct profile_edge {
+    uint64_t from, to, count;          // count 0: empty slot
+} *profile_edges = NULL;
+static size_t profile_edge_count = 0, profile_edge_cap = 0;   // open addressing, cap a power of two
+
+static size_t profile_slot(struct profile_edge *edges, size_t cap, uint64_t from, uint64_t to) {
+    size_t i = (size_t)((from * 0x9E3779B97F4A7C15ULL) ^ (to >> 2)) & (cap - 1);
+    while (edges[i].count && (edges[i].from != from || edges[i].to != to)) i = (i + 1) & (cap - 1);
+    return i;
+}
+
+static void profile_edge(uint64_t from, uint64_t to) {
+    if (2 * (profile_edge_count + 1) > profile_edge_cap) {
+        size_t cap = profile_edge_cap ? profile_edge_cap * 2 : 1024;
+        struct profile_edge *edges = calloc(cap, sizeof(*edges));
+        if (!edges) error_exit("Out of memory");
+        for (size_t i = 0; i < profile_edge_cap; i++) {
+            if (profile_edges[i].count) edges[profile_slot(edges, cap, profile_edges[i].from, profile_edges[i].to)] = profile_edges[i];
+        }
+        free(profile_edges);
+        profile_edges = edges;
+        profile_edge_cap = cap;
+    }
+    struct profile_edge *e = &profile_edges[profile_slot(profile_edges, profile_edge_cap, from, to)];
+    if (!e->count) {
+        e->from = from;
+        e->to = to;
+        profile_edge_count++;
+    }
+    e->count++;
+}
+
+static int compare_edges(const void *a, const void *b) {
+    const struct profile_edge *x = a, *y = b;
+    if (x->from != y->from) return x->from < y->from ? -1 : 1;
+    if (x->to != y->to) return x->to < y->to ? -1 : 1;
+    return 0;
+}
+
+static void free_profile(void) {
+    free(profile_pcs);
+    free(profile_edges);
+    profile_pcs = NULL;
+    profile_edges = NULL;
+    profile_edge_count = profile_edge_cap = 0;
+}
+
+// Text, one record per line: "pc ADDR COUNT" by address, then "edge FROM TO COUNT"
+static void write_profile(void) {
+    if (!profile_path || !profile_pcs) return;
+    const char *path = profile_path;
+    profile_path = NULL;   // once, even if this exit came from inside the write
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        fprintf(error_stream(), "Cannot open profile file\n");
+        free_profile();
+        return;
+    }
+    fprintf(f, "# hw5-sim profile\n");
+    for (uint64_t i = 0; i < mem_size / 4; i++) {
+        if (profile_pcs[i]) fprintf(f, "pc 0x%" PRIx64 " %" PRIu64 "\n", i * 4, profile_pcs[i]);
+    }
+    size_t n = 0;
+    for (size_t i = 0; i < profile_edge_cap; i++) {
+        if (profile_edges[i].count) profile_edges[n++] = profile_edges[i];
+    }
+    if (n) qsort(profile_edges, n, sizeof(*profile_edges), compare_edges);
+    for (size_t i = 0; i < n; i++) {
+        fprintf(f, "edge 0x%" PRIx64 " 0x%" PRIx64 " %" PRIu64 "\n", profile_edges[i].from, profile_edges[i].to, profile_edges[i].count);
+    }
+    if (fclose(f) != 0) fprintf(error_stream(), "Cannot write profile file\n");
+    free_profile();
 }
 
 static void check8(uint64_t addr) {
-    if (addr > MEM_SIZE - 8) error_exit("Simulation error");
+    if (addr > mem_size - 8) error_exit("Simulation error");
     if (addr & 7) error_exit("Simulation error");
 }
 static void check4(uint64_t addr) {
-    if (addr > MEM_SIZE - 4) error_exit("Simulation error");
+    if (addr > mem_size - 4) error_exit("Simulation error");
     if (addr & 3) error_exit("Simulation error");
 }
+// count 8-byte words from an aligned addr, all inside guest memory
+static void check_words(uint64_t addr, uint64_t count) {
+    if (addr & 7) error_exit("Simulation error");
+    if (addr > mem_size || count > (mem_size - addr) / 8) error_exit("Simulation error");
+}
+static void check_bytes(uint64_t addr, uint64_t len) {
+    if (addr > mem_size || len > mem_size - addr) error_exit("Simulation error");
+}
+
+// Switch guest memory to size bytes before a program is loaded. Anything but the
+// default comes from an anonymous mmap: fresh zero pages, page-aligned so host
+// files can be mapped over it (--map). Returns false, leaving memory as it
+// was, if the host cannot provide size bytes.
+static bool try_set_memory_size(uint64_t size) {
+    if (size == mem_size) return true;
+    uint8_t *m = default_memory;
+    if (size != MEM_SIZE) {
+        m = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (m == MAP_FAILED) m = NULL;
+    }
+    uint64_t *d = (size == MEM_SIZE) ? default_dirty_pages : calloc(DIRTY_WORDS(size), sizeof(uint64_t));
+    if (!m || !d) {
+        if (m && m != default_memory) munmap(m, size);
+        if (d && d != default_dirty_pages) free(d);
+        return false;
+    }
+    if (memory != default_memory) munmap(memory, mem_size);
+    if (dirty_pages != default_dirty_pages) free(dirty_pages);
+    memory = m;
+    dirty_pages = d;
+    mem_size = size;
+    registers[31] = size;
+    return true;
+}
+
+void set_memory_size(uint64_t size) {
+    if (!try_set_memory_size(size)) error_exit("Invalid memory size");
+}
+
+// A multiple of 8, at least 4 KiB
+static uint64_t parse_mem_size(const char *s) {
+    uint64_t size;
+    if (tinker_parse_size(s, &size) != 0 || size < 4096 || size % 8 != 0) error_exit("Invalid memory size");
+    return size;
+}
+
+// Loadable ranges must sit inside guest memory and must not overlap each other
+static bool range_fits(uint64_t begin, uint64_t size) {
+    return begin <= mem_size && size <= mem_size - begin;
+}
+
+static bool ranges_overlap(uint64_t a, uint64_t a_size, uint64_t b, uint64_t b_size) {
+    return a_size > 0 && b_size > 0 && a < b + b_size && b < a + a_size;
+}
+
+// Guest ranges the loaded program occupies (code, data, bss), for --map to stay clear of
+#define MAX_SEGMENTS 64
+static struct { uint64_t addr, size; } segments[MAX_SEGMENTS];
+static int segment_count = 0;
+
+static void add_segment(uint64_t addr, uint64_t size) {
+    if (size > 0 && segment_count < MAX_SEGMENTS) {
+        segments[segment_count].addr = addr;
+        segments[segment_count].size = size;
+        segment_count++;
+    }
+}
+
+// Host files mapped over guest memory (--map file@addr[:ro|rw]). Each starts on a
+// page and covers whole pages; bytes past the end of the file read as zero. ro maps
+// are private copies, so guest stores never reach the file; rw maps are shared
+// and write through.
+#define MAX_MAPS 16
+#define MAP_PAGE 4096
+static struct { uint64_t addr, size, len; } maps[MAX_MAPS];   // len: size rounded up to pages
+static int map_count = 0;
+
+static void map_file(const char *spec) {
+    char path[4096], where[64];
+    const char *at = strrchr(spec, '@');
+    if (!at || at == spec || (size_t)(at - spec) >= sizeof(path) || strlen(at + 1) >= sizeof(where)) error_exit("Invalid map");
+    memcpy(path, spec, at - spec);
+    path[at - spec] = '\0';
+    strcpy(where, at + 1);
+
+    bool rw = false;
+    char *mode = strchr(where, ':');
+    if (mode) {
+        *mode++ = '\0';
+        if (strcmp(mode, "rw") == 0) rw = true;
+        else if (strcmp(mode, "ro") != 0) error_exit("Invalid map");
+    }
+    uint64_t addr;
+    if (tinker_parse_size(where, &addr) != 0 || addr % MAP_PAGE != 0) error_exit("Invalid map");
+    if (map_count == MAX_MAPS) error_exit("Too many maps");
+
+    int fd = open(path, rw ? O_RDWR : O_RDONLY);
+    if (fd < 0) error_exit("Cannot open map file");
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+        close(fd);
+        error_exit("Invalid map");
+    }
+    uint64_t size = st.st_size;
+    uint64_t len = (size + MAP_PAGE - 1) / MAP_PAGE * MAP_PAGE;
+    bool clash = !range_fits(addr, len);
+    for (int i = 0; i < segment_count && !clash; i++) clash = ranges_overlap(addr, len, segments[i].addr, segments[i].size);
+    for (int i = 0; i < map_count && !clash; i++) clash = ranges_overlap(addr, len, maps[i].addr, maps[i].len);
+    if (clash) {
+        close(fd);
+        error_exit("Invalid map");
+    }
+
+    void *m = mmap(&memory[addr], len, PROT_READ | PROT_WRITE, (rw ? MAP_SHARED : MAP_PRIVATE) | MAP_FIXED, fd, 0);
+    close(fd);
+    if (m == MAP_FAILED) error_exit("Invalid map");
+    maps[map_count].addr = addr;
+    maps[map_count].size = size;
+    maps[map_count].len = len;
+    map_count++;
+}
 
+// Put zero-filled anonymous pages back where files were mapped
+static void unmap_files(void) {
+    for (int i = 0; i < map_count; i++) {
+        mmap(&memory[maps[i].addr], maps[i].len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+    }
+    map_count = 0;
+}
+
+static uint64_t mapped_size(uint64_t addr) {
+    for (int i = 0; i < map_count; i++) {
+        if (addr >= maps[i].addr && addr - maps[i].addr < maps[i].len) return maps[i].size;
+    }
+    return 0;
+}
+
+// Once the -t deadline passes, a read returns 0 instead of blocking (the
+// SIGALRM interrupts one already blocked), and run_limited stops the guest
+// right after this priv
 static uint64_t read_u64_strict(void) {
     char buf[256];
-    if (scanf(" %255s", buf) != 1) error_exit("Simulation error");
+    FILE *in = guest_in ? guest_in : stdin;
+    if (deadline_passed) return 0;
+    if (fscanf(in, " %255s", buf) != 1) {
+        if (!deadline_passed) error_exit("Simulation error");
+        clearerr(in);
+        return 0;
+    }
     if (buf[0] == '-' || buf[0] == '+') error_exit("Simulation error");
 
     errno = 0;
@@ -46,13 +371,202 @@ static uint64_t read_u64_strict(void) {
     return (uint64_t) v;
 }
 
+static void raw_in_close(void) {
+    if (!raw_in.open) return;
+    if (raw_in.map) munmap(raw_in.map, raw_in.len);
+    free(raw_in.buf);
+    if (raw_in.fd != STDIN_FILENO) close(raw_in.fd);
+    memset(&raw_in, 0, sizeof(raw_in));
+}
+
+// path "-" is stdin
+static void raw_in_open(const char *path) {
+    raw_in_close();
+    int fd = strcmp(path, "-") == 0 ? STDIN_FILENO : open(path, O_RDONLY);
+    if (fd < 0) error_exit("Cannot open raw input");
+    raw_in.open = true;
+    raw_in.fd = fd;
+
+    struct stat st;
+    off_t start = lseek(fd, 0, SEEK_CUR);
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0 && start >= 0) {
+        void *m = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (m != MAP_FAILED) {
+            posix_madvise(m, st.st_size, POSIX_MADV_SEQUENTIAL);
+            raw_in.map = m;
+            raw_in.len = st.st_size;
+            raw_in.pos = start < st.st_size ? start : st.st_size;
+            return;
+        }
+    }
+    raw_in.buf = malloc(RAW_CHUNK);
+    if (!raw_in.buf) error_exit("Out of memory");
+}
+
+// n raw bytes into dst; running out of input is a simulation error, as in decimal mode
+static void raw_read(uint8_t *dst, uint64_t n) {
+    uint64_t take = raw_in.len - raw_in.pos < n ? raw_in.len - raw_in.pos : n;
+    memcpy(dst, (raw_in.map ? raw_in.map : raw_in.buf) + raw_in.pos, take);
+    raw_in.pos += take;
+    dst += take;
+    n -= take;
+    if (n && raw_in.map) error_exit("Simulation error");
+
+    while (n) {
+        if (deadline_passed) return;   // as in read_u64_strict
+        bool direct = n >= RAW_CHUNK;
+        ssize_t got = read(raw_in.fd, direct ? dst : raw_in.buf, direct ? n : RAW_CHUNK);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) error_exit("Simulation error");
+        if (direct) {
+            take = got;
+        } else {
+            raw_in.len = got;
+            take = (uint64_t)got < n ? (uint64_t)got : n;
+            memcpy(dst, raw_in.buf, take);
+            raw_in.pos = take;
+        }
+        dst += take;
+        n -= take;
+    }
+}
+
+static uint64_t read_u64_port(uint64_t port) {
+    if (!raw_in.open || port != 3) return read_u64_strict();
+    uint64_t v;
+    raw_read((uint8_t *)&v, 8);
+    return v;
+}
+
+// Pipeline stages (--pipeline): a stage's port-1 output goes to the next stage's
+// port-3 input through a channel, a bounded single-producer single-consumer
+// ring of raw u64s in shared memory. head and tail only grow; each side writes
+// its own and reads the other's, so neither takes a lock. Stages never format
+// or parse decimal text between them.
+struct channel {
+    _Atomic uint64_t head;      // words the reader has taken
+    char pad0[56];
+    _Atomic uint64_t tail;      // words the writer has put
+    char pad1[56];
+    _Atomic bool closed;        // the writer is done: what is queued is all there is
+    _Atomic bool reader_gone;   // the reader is done: nothing written is read
+    uint64_t cap;               // words, a power of two
+    uint64_t words[];
+};
+
+struct stage_stats {
+    uint64_t words_in, words_out;     // through channels
+    uint64_t stalls_in, stalls_out;   // waits on an empty input or a full output
+    double seconds;
+    int status;
+};
+
+static struct channel *in_channel = NULL;    // this stage's port 3 input, if it is not the first
+static struct channel *out_channel = NULL;   // this stage's port 1 output, if it is not the last
+static struct stage_stats *stage_stats = NULL;
+static uint64_t io_done = 0;     // words an in/inw/out/outw moved before it had to wait
+static int stage_blocked = 0;    // 1 waiting to read, 2 waiting to write
+
+// Up to n words; returns how many moved
+static uint64_t channel_put(struct channel *c, const uint8_t *src, uint64_t n) {
+    uint64_t tail = atomic_load_explicit(&c->tail, memory_order_relaxed);
+    uint64_t head = atomic_load_explicit(&c->head, memory_order_acquire);
+    if (n > c->cap - (tail - head)) n = c->cap - (tail - head);
+    uint64_t at = tail & (c->cap - 1), first = c->cap - at < n ? c->cap - at : n;
+    memcpy(&c->words[at], src, first * 8);
+    memcpy(&c->words[0], src + first * 8, (n - first) * 8);
+    atomic_store_explicit(&c->tail, tail + n, memory_order_release);
+    return n;
+}
+
+static uint64_t channel_get(struct channel *c, uint8_t *dst, uint64_t n) {
+    uint64_t head = atomic_load_explicit(&c->head, memory_order_relaxed);
+    uint64_t tail = atomic_load_explicit(&c->tail, memory_order_acquire);
+    if (n > tail - head) n = tail - head;
+    uint64_t at = head & (c->cap - 1), first = c->cap - at < n ? c->cap - at : n;
+    memcpy(dst, &c->words[at], first * 8);
+    memcpy(dst + first * 8, &c->words[0], (n - first) * 8);
+    atomic_store_explicit(&c->head, head + n, memory_order_release);
+    return n;
+}
+
+// Wind back to the instruction and leave run(); it runs again, from io_done on,
+// once the channel has moved
+static void stage_block(uint64_t current_pc, int waiting) {
+    program_counter = current_pc;
+    stage_blocked = waiting;
+    halt_program = true;
+    if (waiting == 1) stage_stats->stalls_in++;
+    else stage_stats->stalls_out++;
+}
+
+// count words from in_channel into dst; false if the instruction has to wait
+static bool pipe_read(uint8_t *dst, uint64_t count, uint64_t current_pc) {
+    io_done += channel_get(in_channel, dst + 8 * io_done, count - io_done);
+    if (io_done < count && atomic_load_explicit(&in_channel->closed, memory_order_acquire)) {
+        io_done += channel_get(in_channel, dst + 8 * io_done, count - io_done);
+        if (io_done < count) {
+            io_done = 0;
+            error_exit("Simulation error");   // out of input, as at the end of stdin
+        }
+    }
+    if (io_done < count) {
+        stage_block(current_pc, 1);
+        return false;
+    }
+    stage_stats->words_in += count;
+    io_done = 0;
+    return true;
+}
+
+// count words from src to out_channel; false if the instruction has to wait.
+// With the reader gone the stage ends, as a shell pipeline's writer does on SIGPIPE.
+static bool pipe_write(const uint8_t *src, uint64_t count, uint64_t current_pc) {
+    if (atomic_load_explicit(&out_channel->reader_gone, memory_order_acquire)) {
+        io_done = 0;
+        halt_program = true;
+        return false;
+    }
+    io_done += channel_put(out_channel, src + 8 * io_done, count - io_done);
+    if (io_done < count) {
+        stage_block(current_pc, 2);
+        return false;
+    }
+    stage_stats->words_out += count;
+    io_done = 0;
+    return true;
+}
 
 // Reset
 void reset() {
     halt_program = false;
     memset(registers, 0, sizeof(registers));
     program_counter = 0x2000;
-    registers[31] = MEM_SIZE;
+    registers[31] = mem_size;
+}
+
+// priv outw to port 1: one decimal line per word, formatted here and handed to
+// stdio in large writes
+static void write_words_decimal(FILE *out, uint64_t addr, uint64_t count) {
+    char buf[8192];
+    size_t used = 0;
+    for (uint64_t i = 0; i < count; i++) {
+        uint64_t v;
+        memcpy(&v, &memory[addr + 8 * i], 8);
+        char digits[20];
+        int n = 0;
+        do {
+            digits[n++] = (char)('0' + v % 10);
+            v /= 10;
+        } while (v);
+        if (used + n + 1 > sizeof(buf)) {
+            fwrite(buf, 1, used, out);
+            used = 0;
+        }
+        while (n) buf[used++] = digits[--n];
+        buf[used++] = '\n';
+    }
+    fwrite(buf, 1, used, out);
 }
 
 // Execute a single line of instruction
@@ -102,6 +616,7 @@ void execute(uint64_t instr) {
             check8(registers[31] - 8);
             uint64_t address = program_counter;
             memcpy(&memory[registers[31] - 8], &address, 8);
+            mark_dirty(registers[31] - 8);
             program_counter = registers[rd]; break;
         }
         case OP_RET: {
@@ -122,19 +637,95 @@ void execute(uint64_t instr) {
                 }
                 case 0x3: {
                     // Input Instruction
-                    uint64_t input;
-                    registers[rd] = read_u64_strict();
+                    if (in_channel && registers[rs] == 3) {
+                        uint64_t v;
+                        if (pipe_read((uint8_t *)&v, 1, current_pc)) registers[rd] = v;
+                        break;
+                    }
+                    registers[rd] = read_u64_port(registers[rs]);
                     break;
                 }
                 case 0x4:
                     // Output Instruction
                     uint64_t port = registers[rd];
-                    if (port == 1) {
-                        printf("%" PRIu64 "\n", registers[rs]);
+                    if (port == 1 && out_channel) {
+                        pipe_write((const uint8_t *)&registers[rs], 1, current_pc);
+                    } else if (port == 1 && raw_out) {
+                        fwrite(&registers[rs], 8, 1, raw_out);
+                    } else if (port == 1) {
+                        fprintf(guest_out ? guest_out : stdout, "%" PRIu64 "\n", registers[rs]);
                     } else if (port == 3) {
-                        printf("%c", (char)registers[rs]);
+                        fputc((char)registers[rs], guest_out ? guest_out : stdout);
+                    }
+                    break;
+                case PRIV_INW: {
+                    uint64_t addr = registers[rd], port = registers[rs], count = registers[rt];
+                    check_words(addr, count);
+                    mark_dirty_range(addr, count * 8);
+                    if (in_channel && port == 3) {
+                        pipe_read(&memory[addr], count, current_pc);
+                        break;
+                    }
+                    if (raw_in.open && port == 3) {
+                        raw_read(&memory[addr], count * 8);
+                        break;
                     }
+                    for (uint64_t i = 0; i < count; i++) {
+                        uint64_t v = read_u64_strict();
+                        memcpy(&memory[addr + 8 * i], &v, 8);
+                    }
+                    break;
+                }
+                case PRIV_OUTW: {
+                    uint64_t port = registers[rd], addr = registers[rs], count = registers[rt];
+                    check_words(addr, count);
+                    FILE *out = guest_out ? guest_out : stdout;
+                    if (port == 1 && out_channel) {
+                        pipe_write(&memory[addr], count, current_pc);
+                    } else if (port == 1 && raw_out) {
+                        fwrite(&memory[addr], 8, count, raw_out);
+                    } else if (port == 1) {
+                        write_words_decimal(out, addr, count);
+                    } else if (port == 3) {
+                        for (uint64_t i = 0; i < count; i++) fputc((char)memory[addr + 8 * i], out);
+                    }
+                    break;
+                }
+                case PRIV_OUTS: {
+                    uint64_t port = registers[rd], addr = registers[rs], len = registers[rt];
+                    check_bytes(addr, len);
+                    if (port == 3) fwrite(&memory[addr], 1, len, guest_out ? guest_out : stdout);
+                    break;
+                }
+                case PRIV_MAPSIZE:
+                    registers[rd] = mapped_size(registers[rs]);
+                    break;
+                case PRIV_MEMCPY: {
+                    // One range check for the whole copy. Overlapping ranges are an error, as a
+                    // word-by-word guest loop would give a direction-dependent result.
+                    uint64_t dst = registers[rd], src = registers[rs], len = registers[rt];
+                    check_bytes(dst, len);
+                    check_bytes(src, len);
+                    if (ranges_overlap(dst, len, src, len)) error_exit("Simulation error");
+                    memcpy(&memory[dst], &memory[src], len);
+                    mark_dirty_range(dst, len);
                     break;
+                }
+                case PRIV_MEMSET: {
+                    uint64_t dst = registers[rd], len = registers[rt];
+                    check_bytes(dst, len);
+                    memset(&memory[dst], (uint8_t)registers[rs], len);
+                    mark_dirty_range(dst, len);
+                    break;
+                }
+                case PRIV_MEMCMP: {
+                    uint64_t a = registers[rd], b = registers[rs], len = registers[rt];
+                    check_bytes(a, len);
+                    check_bytes(b, len);
+                    int c = memcmp(&memory[a], &memory[b], len);
+                    registers[rd] = c < 0 ? UINT64_MAX : (c > 0);
+                    break;
+                }
                 default:
                     error_exit("Simulation error");
                     break;
@@ -147,7 +738,7 @@ void execute(uint64_t instr) {
             int64_t addr_s = (int64_t)registers[rs] + (int64_t)litS;
             if (addr_s < 0) error_exit("Simulation error");
             uint64_t address = (uint64_t)addr_s;
-            if (address > MEM_SIZE - 8) error_exit("Simulation error");
+            if (address > mem_size - 8) error_exit("Simulation error");
             // check8(address);
             // if (address % 8 != 0) error_exit("Simulation error");
             memcpy(&registers[rd], &memory[address], 8); break;
@@ -163,7 +754,9 @@ void execute(uint64_t instr) {
             if (addr_s < 0) error_exit("Simulation error");
             uint64_t address = (uint64_t)addr_s;
             check8(address);
-            memcpy(&memory[address], &registers[rs], 8); break;
+            memcpy(&memory[address], &registers[rs], 8);
+            mark_dirty(address);
+            break;
         }
         // Float
         case OP_ADDF: {
@@ -225,8 +818,232 @@ uint32_t fetch() {
     return instr;
 }
 
+static void on_deadline(int sig) {
+    (void)sig;
+    deadline_passed = 1;
+}
+
+static double seconds_since(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static void disarm_deadline(void) {
+    struct itimerval off = { { 0, 0 }, { 0, 0 } };
+    setitimer(ITIMER_REAL, &off, NULL);
+}
+
+static void limit_exit(const char *msg, uint64_t instructions, uint64_t blocks, const struct timespec *start) {
+    if (time_limit > 0) disarm_deadline();
+    fflush(stdout);
+    FILE *err = error_stream();
+    fprintf(err, "%s\n", msg);
+    fprintf(err, "instructions: %" PRIu64 "\n", instructions);
+    fprintf(err, "blocks: %" PRIu64 "\n", blocks);
+    fprintf(err, "pc: 0x%" PRIx64 "\n", program_counter);
+    fprintf(err, "elapsed: %.3f s\n", seconds_since(start));
+    sim_exit(SIM_EXIT_LIMIT);
+}
+
+// Live statistics (-s SECONDS, -S FILE): run_limited counts each instruction
+// by opcode, and every STATS_POLL instructions, when a taken branch ends a
+// block, brings FILE up to date, prints the full counters if SIGUSR1 came, and
+// prints a line on stderr if SECONDS have passed. Without -s or -S, run()
+// takes the plain loop and nothing is counted.
+#define STATS_POLL (1 << 20)
+static bool stats_on = false;
+static double stats_interval = 0;      // seconds between stderr lines; 0 for none
+static struct tinker_stats *stats_map = NULL;
+static uint64_t stats_ops[32];         // instructions retired per opcode
+static uint64_t stats_words_in, stats_words_out;
+static bool stats_running = false;
+static struct timespec stats_start;
+static double stats_next_line;
+static volatile sig_atomic_t stats_dump_requested = 0;
+
+static const uint8_t stats_class_of[32] = {
+    TINKER_CLASS_LOGIC, TINKER_CLASS_LOGIC, TINKER_CLASS_LOGIC, TINKER_CLASS_LOGIC,
+    TINKER_CLASS_SHIFT, TINKER_CLASS_SHIFT, TINKER_CLASS_SHIFT, TINKER_CLASS_SHIFT,
+    TINKER_CLASS_BRANCH, TINKER_CLASS_BRANCH, TINKER_CLASS_BRANCH, TINKER_CLASS_BRANCH,
+    TINKER_CLASS_BRANCH, TINKER_CLASS_BRANCH, TINKER_CLASS_BRANCH, TINKER_CLASS_PRIV,
+    TINKER_CLASS_LOAD, TINKER_CLASS_MOVE, TINKER_CLASS_MOVE, TINKER_CLASS_STORE,
+    TINKER_CLASS_FLOAT, TINKER_CLASS_FLOAT, TINKER_CLASS_FLOAT, TINKER_CLASS_FLOAT,
+    TINKER_CLASS_INT, TINKER_CLASS_INT, TINKER_CLASS_INT, TINKER_CLASS_INT,
+    TINKER_CLASS_INT, TINKER_CLASS_INT, TINKER_CLASS_OTHER, TINKER_CLASS_OTHER,
+};
+static const char *const stats_class_names[TINKER_CLASS_COUNT] = {
+    "logic", "shift", "branch", "priv", "load", "store", "move", "float", "int", "other",
+};
+
+static void on_stats_signal(int sig) {
+    (void)sig;
+    stats_dump_requested = 1;
+}
+
+static void stats_open(const char *path) {
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) error_exit("Cannot open stats file");
+    void *m = MAP_FAILED;
+    if (ftruncate(fd, sizeof(struct tinker_stats)) == 0) {
+        m = mmap(NULL, sizeof(struct tinker_stats), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (m == MAP_FAILED) error_exit("Cannot open stats file");
+    stats_map = m;
+    stats_map->magic = TINKER_STATS_MAGIC;
+}
+
+// Words an in/out/inw/outw is about to move, read before it runs and changes rd
+static void stats_count_io(uint32_t instr) {
+    uint64_t rt = registers[(instr >> 12) & 0x1F];
+    switch (instr & 0xFFF) {
+        case PRIV_IN: stats_words_in++; break;
+        case PRIV_OUT: stats_words_out++; break;
+        case PRIV_INW: stats_words_in += rt; break;
+        case PRIV_OUTW: stats_words_out += rt; break;
+    }
+}
+
+static void stats_snapshot(struct tinker_stats *s, bool stopped) {
+    memset(s, 0, sizeof(*s));
+    for (int op = 0; op < 32; op++) {
+        s->instructions += stats_ops[op];
+        s->classes[stats_class_of[op]] += stats_ops[op];
+    }
+    s->loads = stats_ops[OP_MOV_ML] + stats_ops[OP_RET];
+    s->stores = stats_ops[OP_MOV_SM] + stats_ops[OP_CALL];
+    s->words_in = stats_words_in;
+    s->words_out = stats_words_out;
+    s->pc = program_counter;
+    s->stack_depth = registers[31] <= mem_size ? mem_size - registers[31] : 0;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    s->elapsed_ns = (uint64_t)(now.tv_sec - stats_start.tv_sec) * 1000000000ULL + now.tv_nsec - stats_start.tv_nsec;
+    s->stopped = stopped;
+}
+
+static void stats_print_line(const struct tinker_stats *s) {
+    double secs = s->elapsed_ns / 1e9;
+    fflush(stdout);
+    fprintf(error_stream(), "stats: %.1f s, %" PRIu64 " instructions (%.1f M/s), pc 0x%" PRIx64 ", stack %" PRIu64
+            ", loads %" PRIu64 ", stores %" PRIu64 ", in %" PRIu64 ", out %" PRIu64 "\n",
+            secs, s->instructions, secs > 0 ? s->instructions / secs / 1e6 : 0, s->pc, s->stack_depth,
+            s->loads, s->stores, s->words_in, s->words_out);
+}
+
+// The SIGUSR1 dump, one counter per line as limit_exit reports
+static void stats_print_full(const struct tinker_stats *s) {
+    fflush(stdout);
+    FILE *err = error_stream();
+    fprintf(err, "instructions: %" PRIu64 "\n", s->instructions);
+    for (int c = 0; c < TINKER_CLASS_COUNT; c++) fprintf(err, "%s: %" PRIu64 "\n", stats_class_names[c], s->classes[c]);
+    fprintf(err, "loads: %" PRIu64 "\nstores: %" PRIu64 "\n", s->loads, s->stores);
+    fprintf(err, "words in: %" PRIu64 "\nwords out: %" PRIu64 "\n", s->words_in, s->words_out);
+    fprintf(err, "pc: 0x%" PRIx64 "\nstack: %" PRIu64 "\n", s->pc, s->stack_depth);
+    fprintf(err, "elapsed: %.3f s\n", s->elapsed_ns / 1e9);
+}
+
+static void stats_refresh(bool stopped) {
+    struct tinker_stats s;
+    stats_snapshot(&s, stopped);
+    if (stats_map) {
+        // seq odd, the counters, seq even: a reader that sees the same even seq
+        // before and after its copy has a consistent one
+        uint64_t seq = stats_map->seq;
+        __atomic_store_n(&stats_map->seq, seq + 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        memcpy(&stats_map->instructions, &s.instructions, sizeof(s) - offsetof(struct tinker_stats, instructions));
+        __atomic_store_n(&stats_map->seq, seq + 2, __ATOMIC_RELEASE);
+    }
+    if (stats_dump_requested) {
+        stats_dump_requested = 0;
+        stats_print_full(&s);
+    }
+    if (stats_interval > 0 && (stopped || s.elapsed_ns / 1e9 >= stats_next_line)) {
+        stats_print_line(&s);
+        while (stats_next_line <= s.elapsed_ns / 1e9) stats_next_line += stats_interval;
+    }
+}
+
+// Once the guest has stopped, for good or by error: the last counters
+static void stats_stop(void) {
+    if (stats_running) {
+        stats_running = false;
+        stats_refresh(true);
+    }
+    if (stats_map) munmap(stats_map, sizeof(struct tinker_stats));
+    stats_map = NULL;
+}
+
+// run() under -i/-t/-p/-s/-S. The limits are checked only when a taken branch ends a
+// basic block, so a guest stops at most one block past its budget; only a
+// backward branch can keep a guest running, so every runaway is caught.
+// The deadline is a SIGALRM that sets a flag, not a clock read; a priv is also
+// checked, since the alarm cuts short a guest blocked on input there.
+static void run_limited(void) {
+    if (profile_path && !profile_pcs) {
+        profile_pcs = calloc(mem_size / 4, sizeof(uint64_t));
+        if (!profile_pcs) error_exit("Out of memory");
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    deadline_passed = 0;
+    if (time_limit > 0) {
+        struct itimerval timer = { { 0, 0 }, { (time_t)time_limit, (suseconds_t)((time_limit - (time_t)time_limit) * 1e6) } };
+        if (timer.it_value.tv_sec == 0 && timer.it_value.tv_usec == 0) timer.it_value.tv_usec = 1;
+        // no SA_RESTART, so the alarm also interrupts a guest blocked on input
+        struct sigaction sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = on_deadline;
+        sigemptyset(&sa.sa_mask);
+        sigaction(SIGALRM, &sa, NULL);
+        setitimer(ITIMER_REAL, &timer, NULL);
+    }
+
+    uint64_t instructions = 0, blocks = 0, stats_due = STATS_POLL;
+    if (stats_on && !stats_running) {
+        stats_running = true;
+        stats_start = start;
+        stats_next_line = stats_interval;
+    }
+    while (!halt_program) {
+        uint64_t at = program_counter;
+        uint32_t instr = fetch();
+        uint64_t next = program_counter;
+        if (profile_pcs) profile_pcs[at >> 2]++;
+        if (stats_on) {
+            stats_ops[instr >> 27]++;
+            if ((instr >> 27) == OP_PRIV) stats_count_io(instr);
+        }
+        execute(instr);
+        instructions++;
+        if (program_counter != next) {
+            blocks++;
+            if (profile_pcs) profile_edge(at, program_counter);
+            if (stats_on && instructions >= stats_due) {
+                stats_due = instructions + STATS_POLL;
+                stats_refresh(false);
+            }
+            if (instruction_limit && instructions >= instruction_limit) {
+                limit_exit("Instruction limit exceeded", instructions, blocks, &start);
+            }
+            if (deadline_passed) limit_exit("Time limit exceeded", instructions, blocks, &start);
+        } else if ((instr >> 27) == OP_PRIV && deadline_passed) {
+            limit_exit("Time limit exceeded", instructions, blocks, &start);
+        }
+    }
+
+    if (time_limit > 0) disarm_deadline();
+}
+
 // Run Loop
 void run() {
+    if (instruction_limit || time_limit > 0 || profile_path || stats_on) {
+        run_limited();
+        return;
+    }
     while (!halt_program) {
         uint32_t instr = fetch();
         execute(instr);
@@ -234,6 +1051,73 @@ void run() {
 }
 
 // Read the file
+// v2: load every code, data and bss section from the section table; metadata
+// sections (symbols, line map) are for tools and are skipped here
+// Load a v2 file; returns NULL, or the error for the caller to report once it
+// has closed file (the daemon survives errors, so nothing may leak)
+static const char *read_binary_v2(FILE *file) {
+    struct tinker_v2_header header;
+    rewind(file);
+    if (fread(&header, sizeof(header), 1, file) != 1) return "Invalid header";
+    if (header.section_count == 0 || header.section_count > 64) return "Invalid header";
+
+    struct tinker_section sections[64];
+    if (fseek(file, header.section_table_offset, SEEK_SET) != 0 ||
+        fread(sections, sizeof(struct tinker_section), header.section_count, file) != header.section_count) {
+        return "Invalid header";
+    }
+
+    // -m wins over the size the program was assembled for
+    uint64_t size = requested_mem_size ? requested_mem_size : header.mem_size;
+    if (size && !try_set_memory_size(size)) return "Invalid memory size";
+
+    bool has_code = false, entry_in_code = false;
+    for (uint64_t i = 0; i < header.section_count; i++) {
+        struct tinker_section *sec = &sections[i];
+        if (sec->type != TINKER_SEC_CODE && sec->type != TINKER_SEC_DATA && sec->type != TINKER_SEC_BSS) continue;
+        if (!range_fits(sec->addr, sec->mem_size)) return "Invalid tinker filepath";
+        for (uint64_t j = 0; j < i; j++) {
+            struct tinker_section *other = &sections[j];
+            if (other->type != TINKER_SEC_CODE && other->type != TINKER_SEC_DATA && other->type != TINKER_SEC_BSS) continue;
+            if (ranges_overlap(sec->addr, sec->mem_size, other->addr, other->mem_size)) return "Invalid tinker filepath";
+        }
+        if (sec->type == TINKER_SEC_CODE && sec->mem_size > 0) {
+            has_code = true;
+            if (header.entry >= sec->addr && header.entry - sec->addr < sec->mem_size) entry_in_code = true;
+        }
+    }
+
+    for (uint64_t i = 0; i < header.section_count; i++) {
+        struct tinker_section *sec = &sections[i];
+        if (sec->type != TINKER_SEC_CODE && sec->type != TINKER_SEC_DATA && sec->type != TINKER_SEC_BSS) continue;
+        if (sec->mem_size == 0) continue;
+        add_segment(sec->addr, sec->mem_size);
+
+        // Compressed sections decode straight into guest memory
+        if ((header.flags & TINKER_V2_COMPRESSED) && sec->flags != TKO_CODEC_NONE) {
+            if (fseek(file, sec->offset, SEEK_SET) != 0 ||
+                tko_decompress(file, sec->size, sec->flags, &memory[sec->addr], sec->mem_size) != 0) {
+                return "Invalid tinker filepath";
+            }
+            continue;
+        }
+
+        if (sec->size > sec->mem_size) return "Invalid tinker filepath";
+        if (sec->size > 0) {
+            if (fseek(file, sec->offset, SEEK_SET) != 0 ||
+                fread(&memory[sec->addr], 1, sec->size, file) != sec->size) {
+                return "Invalid tinker filepath";
+            }
+        }
+        if (!memory_pristine) memset(&memory[sec->addr + sec->size], 0, sec->mem_size - sec->size);
+    }
+
+    if (has_code && !entry_in_code) return "Invalid tinker filepath";
+    if (header.entry > mem_size - 4 || (header.entry & 3)) return "Invalid tinker filepath";
+    program_counter = header.entry;
+    return NULL;
+}
+
 void read_binary(const char* filename) {
     FILE *file = fopen(filename, "rb");
     if (!file) {
@@ -241,20 +1125,46 @@ void read_binary(const char* filename) {
     }
 
     struct tinker_file_header header;
+    segment_count = 0;
 
     if (fread(&header, sizeof(header), 1, file) != 1) {
         fclose(file);
         error_exit("Invalid header");
     }
 
+    // Relocatable objects must go through hw5-ld first
+    if (header.file_type == TINKER_OBJECT) {
+        fclose(file);
+        error_exit("Invalid tinker filepath");
+    }
+
+    if (header.file_type == TINKER_EXEC_V2) {
+        const char *err = read_binary_v2(file);
+        fclose(file);
+        memory_pristine = false;
+        if (err) error_exit(err);
+        return;
+    }
+
+    if (requested_mem_size && !try_set_memory_size(requested_mem_size)) {
+        fclose(file);
+        error_exit("Invalid memory size");
+    }
+    if (!range_fits(header.code_seg_begin, header.code_seg_size) ||
+        !range_fits(header.data_seg_begin, header.data_seg_size) ||
+        ranges_overlap(header.code_seg_begin, header.code_seg_size, header.data_seg_begin, header.data_seg_size)) {
+        fclose(file);
+        error_exit("Invalid tinker filepath");
+    }
+
+    add_segment(header.code_seg_begin, header.code_seg_size);
+    add_segment(header.data_seg_begin, header.data_seg_size);
     if (header.code_seg_size > 0) {
-        if (header.code_seg_begin + header.code_seg_size > MEM_SIZE) error_exit("Invalid tinker filepath");
         fread(&memory[header.code_seg_begin], 1, header.code_seg_size, file);
     }
 
     // 3. Load the Data Segment
     if (header.data_seg_size > 0) {
-        if (header.data_seg_begin + header.data_seg_size > MEM_SIZE) error_exit("Invalid tinker filepath");
         fread(&memory[header.data_seg_begin], 1, header.data_seg_size, file);
     }
 
@@ -263,18 +1173,672 @@ void read_binary(const char* filename) {
     // size_t n = fread(memory + 0x1000, 1, MEM_SIZE - 0x1000, file);
     // if (n == 0) error_exit("Invalid tinker filepath");
     fclose(file);
+    memory_pristine = false;
+}
+
+// Daemon (-d SOCKET): run cached images for clients on a Unix socket, so a run
+// pays neither process start-up nor loading.
+//
+// A request is a sim_request followed by name_len bytes of name and input_len
+// bytes of guest stdin. The reply is a sim_reply followed by output_len bytes
+// of what the run printed, error messages included.
+//   SIM_REQ_LOAD  name is a .tko path. The image is loaded once per file
+//                 content and the reply is its id, 16 hex digits.
+//   SIM_REQ_RUN   name is an id. The run starts from the image as loaded,
+//                 under the daemon's own -i/-t limits.
+// A connection may carry any number of requests; connections are served one at a time.
+
+#define SIM_REQ_LOAD 1
+#define SIM_REQ_RUN 2
+#define MAX_IMAGES 64
+#define MAX_REQUEST_INPUT (64u << 20)
+#define IMAGE_PAGE (1 << DIRTY_PAGE_SHIFT)
+
+struct sim_request {
+    uint32_t type;
+    uint32_t name_len;
+    uint64_t input_len;
+};
+
+struct sim_reply {
+    int32_t status;
+    uint32_t reserved;
+    uint64_t output_len;
+};
+
+// A loaded program: its nonzero pages of guest memory and where it starts
+typedef struct {
+    uint64_t id;
+    uint64_t mem_size;
+    uint64_t entry;
+    uint64_t page_count;
+    uint64_t *page_addr;
+    uint8_t *pages;
+    uint32_t *page_slot;   // per guest page: 1 + its index in pages, or 0 for a zero page
+} Image;
+
+static Image images[MAX_IMAGES];
+static int image_count = 0;
+static int image_next = 0;   // the slot a new image replaces once the cache is full
+
+// The image guest memory holds apart from the pages marked dirty, if any
+static const Image *resident_image = NULL;
+
+// FNV-1a of the file's bytes
+static uint64_t hash_file(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f) error_exit("Invalid tinker filepath");
+    uint64_t h = 0xcbf29ce484222325ULL;
+    uint8_t buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+        for (size_t i = 0; i < n; i++) h = (h ^ buf[i]) * 0x100000001b3ULL;
+    }
+    fclose(f);
+    return h;
+}
+
+// Bytes of the page at addr inside guest memory; only the last page can be short
+static uint64_t page_bytes(uint64_t addr) {
+    return mem_size - addr < IMAGE_PAGE ? mem_size - addr : IMAGE_PAGE;
+}
+
+static bool page_is_zero(uint64_t addr) {
+    uint64_t n = page_bytes(addr);
+    for (uint64_t i = 0; i < n; i += 8) {
+        uint64_t w;
+        memcpy(&w, &memory[addr + i], 8);
+        if (w) return false;
+    }
+    return true;
+}
+
+static Image *find_image(uint64_t id) {
+    for (int i = 0; i < image_count; i++) {
+        if (images[i].id == id) return &images[i];
+    }
+    return NULL;
+}
+
+static Image *load_image(const char *path) {
+    const char *dot = strrchr(path, '.');
+    if (!dot || strcmp(dot, ".tko") != 0) error_exit("Invalid tinker filepath");
+    uint64_t id = hash_file(path);
+    Image *img = find_image(id);
+    if (img) return img;
+
+    resident_image = NULL;
+    set_memory_size(requested_mem_size ? requested_mem_size : MEM_SIZE);
+    memset(memory, 0, mem_size);
+    memory_pristine = true;
+    reset();
+    read_binary(path);
+
+    uint64_t page_total = (mem_size + IMAGE_PAGE - 1) / IMAGE_PAGE;
+    uint64_t count = 0;
+    for (uint64_t a = 0; a < mem_size; a += IMAGE_PAGE) count += !page_is_zero(a);
+    uint64_t *addr = malloc((count ? count : 1) * sizeof(uint64_t));
+    uint8_t *pages = malloc((count ? count : 1) * IMAGE_PAGE);
+    uint32_t *slot = calloc(page_total, sizeof(uint32_t));
+    if (!addr || !pages || !slot) error_exit("Out of memory");
+    uint64_t k = 0;
+    for (uint64_t a = 0; a < mem_size; a += IMAGE_PAGE) {
+        if (page_is_zero(a)) continue;
+        addr[k] = a;
+        slot[a / IMAGE_PAGE] = (uint32_t)(k + 1);
+        memcpy(&pages[k * IMAGE_PAGE], &memory[a], page_bytes(a));
+        k++;
+    }
+
+    if (image_count < MAX_IMAGES) {
+        img = &images[image_count++];
+    } else {
+        img = &images[image_next];
+        image_next = (image_next + 1) % MAX_IMAGES;
+        free(img->page_addr);
+        free(img->pages);
+        free(img->page_slot);
+    }
+    *img = (Image){ id, mem_size, program_counter, count, addr, pages, slot };
+    return img;
+}
+
+// The machine exactly as the image was loaded. When memory already holds this
+// image, only the pages the last run wrote are put back, so a reset costs in
+// proportion to the writes rather than to guest memory.
+static void restore_image(const Image *img) {
+    if (img == resident_image && mem_size == img->mem_size) {
+        for (uint64_t w = 0; w < DIRTY_WORDS(mem_size); w++) {
+            for (uint64_t bits = dirty_pages[w]; bits; bits &= bits - 1) {
+                uint64_t addr = (w * 64 + (uint64_t)__builtin_ctzll(bits)) * IMAGE_PAGE;
+                uint32_t slot = img->page_slot[addr / IMAGE_PAGE];
+                if (slot) memcpy(&memory[addr], &img->pages[(slot - 1) * (uint64_t)IMAGE_PAGE], page_bytes(addr));
+                else memset(&memory[addr], 0, page_bytes(addr));
+            }
+        }
+    } else {
+        set_memory_size(img->mem_size);
+        memset(memory, 0, mem_size);
+        for (uint64_t k = 0; k < img->page_count; k++) {
+            memcpy(&memory[img->page_addr[k]], &img->pages[k * IMAGE_PAGE], page_bytes(img->page_addr[k]));
+        }
+        resident_image = img;
+    }
+    clear_dirty_pages();
+    memory_pristine = false;
+    reset();
+    program_counter = img->entry;
+}
+
+static bool read_full(int fd, void *buf, size_t n) {
+    uint8_t *p = buf;
+    while (n > 0) {
+        ssize_t got = read(fd, p, n);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) return false;
+        p += got;
+        n -= (size_t)got;
+    }
+    return true;
+}
+
+static bool write_full(int fd, const void *buf, size_t n) {
+    const uint8_t *p = buf;
+    while (n > 0) {
+        ssize_t put = write(fd, p, n);
+        if (put < 0 && errno == EINTR) continue;
+        if (put <= 0) return false;
+        p += put;
+        n -= (size_t)put;
+    }
+    return true;
+}
+
+// Serve one request; returns false if the reply could not be sent
+static bool serve_request(int fd, const struct sim_request *req, const char *name, char *input) {
+    char *output = NULL;
+    size_t output_len = 0;
+    guest_out = open_memstream(&output, &output_len);
+    guest_in = req->input_len ? fmemopen(input, req->input_len, "r") : fopen("/dev/null", "r");
+    if (!guest_out || !guest_in) error_exit("Out of memory");
+
+    jmp_buf abort_here;
+    request_status = 0;
+    request_abort = &abort_here;
+    if (setjmp(abort_here) == 0) {
+        if (req->type == SIM_REQ_LOAD) {
+            fprintf(guest_out, "%016" PRIx64, load_image(name)->id);
+        } else if (req->type == SIM_REQ_RUN) {
+            char *end;
+            uint64_t id = strtoull(name, &end, 16);
+            const Image *img = (*end == '\0') ? find_image(id) : NULL;
+            if (!img) error_exit("Unknown program");
+            restore_image(img);
+            run();
+        } else {
+            error_exit("Invalid request");
+        }
+    }
+    request_abort = NULL;
+
+    fclose(guest_in);
+    fclose(guest_out);
+    guest_in = guest_out = NULL;
+    struct sim_reply reply = { request_status, 0, output_len };
+    bool ok = write_full(fd, &reply, sizeof(reply)) && write_full(fd, output, output_len);
+    free(output);
+    return ok;
+}
+
+static int unix_socket(const char *path, struct sockaddr_un *addr) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr->sun_path)) error_exit("Invalid socket path");
+    strcpy(addr->sun_path, path);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) error_exit("Cannot create socket");
+    return fd;
+}
+
+static void serve(const char *socket_path, char **preload, int preload_count) {
+    for (int i = 0; i < preload_count; i++) {
+        printf("%016" PRIx64 " %s\n", load_image(preload[i])->id, preload[i]);
+    }
+
+    struct sockaddr_un addr;
+    int server = unix_socket(socket_path, &addr);
+    unlink(socket_path);
+    if (bind(server, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(server, 64) != 0) {
+        error_exit("Cannot listen on socket");
+    }
+    signal(SIGPIPE, SIG_IGN);
+    fflush(stdout);
+
+    for (;;) {
+        int fd = accept(server, NULL, NULL);
+        if (fd < 0) continue;
+        struct sim_request req;
+        while (read_full(fd, &req, sizeof(req))) {
+            if (req.name_len == 0 || req.name_len > 4096 || req.input_len > MAX_REQUEST_INPUT) break;
+            char name[4097];
+            char *input = malloc(req.input_len + 1);
+            if (!input) break;
+            bool ok = read_full(fd, name, req.name_len) && read_full(fd, input, req.input_len);
+            name[req.name_len] = '\0';
+            ok = ok && serve_request(fd, &req, name, input);
+            free(input);
+            if (!ok) break;
+        }
+        close(fd);
+    }
+}
+
+// Send one request; the reply's output is returned in *output
+static int client_request(int fd, uint32_t type, const char *name, const char *input, size_t input_len,
+                          char **output, uint64_t *output_len) {
+    struct sim_request req = { type, (uint32_t)strlen(name), input_len };
+    struct sim_reply reply;
+    if (!write_full(fd, &req, sizeof(req)) || !write_full(fd, name, req.name_len) ||
+        !write_full(fd, input, input_len) || !read_full(fd, &reply, sizeof(reply))) {
+        error_exit("Lost connection to daemon");
+    }
+    *output = realloc(*output, reply.output_len + 1);
+    if (!*output) error_exit("Out of memory");
+    if (!read_full(fd, *output, reply.output_len)) error_exit("Lost connection to daemon");
+    (*output)[reply.output_len] = '\0';
+    *output_len = reply.output_len;
+    return reply.status;
+}
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// Client (-c SOCKET): run a program on a daemon with this process's stdin and
+// stdout; -r N repeats the run and reports request latency on stderr
+static int client(const char *socket_path, const char *path, long repeat) {
+    struct sockaddr_un addr;
+    int fd = unix_socket(socket_path, &addr);
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) error_exit("Cannot connect to daemon");
+
+    char full_path[4096];
+    if (!realpath(path, full_path)) error_exit("Invalid tinker filepath");
+    char *output = NULL;
+    uint64_t output_len;
+    int status = client_request(fd, SIM_REQ_LOAD, full_path, "", 0, &output, &output_len);
+    if (status != 0) {
+        fwrite(output, 1, output_len, stderr);
+        return status;
+    }
+    char id[17];
+    snprintf(id, sizeof(id), "%s", output);
+
+    size_t input_len = 0, cap = 4096;
+    char *input = malloc(cap);
+    size_t n;
+    while (input && (n = fread(input + input_len, 1, cap - input_len, stdin)) > 0) {
+        input_len += n;
+        if (input_len == cap) input = realloc(input, cap *= 2);
+    }
+    if (!input) error_exit("Out of memory");
+
+    double *latency = malloc(repeat * sizeof(double));
+    if (!latency) error_exit("Out of memory");
+    for (long r = 0; r < repeat; r++) {
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        status = client_request(fd, SIM_REQ_RUN, id, input, input_len, &output, &output_len);
+        latency[r] = seconds_since(&start) * 1e6;
+    }
+    fwrite(output, 1, output_len, stdout);
+    if (repeat > 1) {
+        qsort(latency, repeat, sizeof(double), compare_double);
+        fprintf(stderr, "runs: %ld p50: %.1f us p99: %.1f us\n", repeat, latency[repeat / 2], latency[(repeat * 99) / 100]);
+    }
+    free(latency);
+    free(input);
+    free(output);
+    close(fd);
+    return status;
+}
+
+// Pipeline (--pipeline MODE a.tko b.tko ...): stage i's port-1 output feeds
+// stage i+1's port-3 input through a channel of queue_words words. Stage 0 reads
+// stdin (or -b), the last stage writes stdout (or -B), and -m sizes each stage.
+//   cores  one process per stage, so stages run in parallel; a stage that finds
+//          its channel empty or full spins, then yields, then naps
+//   coop   every stage in this process, each with its own guest memory, run in
+//          turn until it blocks, so a queue fills or drains between switches
+// The exit status is the last nonzero stage status, as under pipefail. Each
+// stage's words, stalls and time go to stderr at the end.
+#define DEFAULT_QUEUE_WORDS 4096
+static uint64_t queue_words = DEFAULT_QUEUE_WORDS;
+
+struct stage {
+    const char *path;
+    struct channel *in, *out;
+    struct stage_stats *stats;
+    pid_t pid;
+    bool done;
+    // coop: the machine while another stage runs
+    uint64_t registers[32], program_counter, mem_size, io_done;
+    uint8_t *memory;
+    uint64_t *dirty_pages;
+};
+
+// Both ends are done with a stage's channels once it stops, however it stopped
+static void stage_finish(struct stage *s) {
+    if (s->out) atomic_store_explicit(&s->out->closed, true, memory_order_release);
+    if (s->in) atomic_store_explicit(&s->in->reader_gone, true, memory_order_release);
+}
+
+static void stage_save(struct stage *s) {
+    memcpy(s->registers, registers, sizeof(registers));
+    s->program_counter = program_counter;
+    s->memory = memory;
+    s->dirty_pages = dirty_pages;
+    s->mem_size = mem_size;
+    s->io_done = io_done;
+}
+
+static void stage_switch(struct stage *s) {
+    memcpy(registers, s->registers, sizeof(registers));
+    program_counter = s->program_counter;
+    memory = s->memory;
+    dirty_pages = s->dirty_pages;
+    mem_size = s->mem_size;
+    io_done = s->io_done;
+    in_channel = s->in;
+    out_channel = s->out;
+    stage_stats = s->stats;
+    stage_blocked = 0;
+    halt_program = false;
+}
+
+// Wait, in cores mode, until the channel this stage blocked on can move
+static void channel_wait(void) {
+    struct timespec nap = { 0, 20000 };
+    for (int spins = 0;; spins++) {
+        if (stage_blocked == 1) {
+            if (atomic_load_explicit(&in_channel->tail, memory_order_acquire) != atomic_load_explicit(&in_channel->head, memory_order_relaxed) ||
+                atomic_load_explicit(&in_channel->closed, memory_order_acquire)) return;
+        } else {
+            if (atomic_load_explicit(&out_channel->tail, memory_order_relaxed) - atomic_load_explicit(&out_channel->head, memory_order_acquire) < out_channel->cap ||
+                atomic_load_explicit(&out_channel->reader_gone, memory_order_acquire)) return;
+        }
+        if (spins < 64) continue;
+        if (spins < 256) sched_yield();
+        else nanosleep(&nap, NULL);
+    }
+}
+
+// cores: one stage in a child process; returns its exit status
+static int stage_process(struct stage *s) {
+    in_channel = s->in;
+    out_channel = s->out;
+    stage_stats = s->stats;
+    read_binary(s->path);
+    for (;;) {
+        stage_blocked = 0;
+        run();
+        if (!stage_blocked) break;
+        channel_wait();
+        halt_program = false;
+    }
+    stage_finish(s);
+    return 0;
+}
+
+static void run_cores(struct stage *stages, int count) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    fflush(stdout);
+    fflush(stderr);
+    if (raw_out) fflush(raw_out);
+    for (int i = 0; i < count; i++) {
+        stages[i].pid = fork();
+        if (stages[i].pid == 0) exit(stage_process(&stages[i]));
+        if (stages[i].pid < 0) {
+            for (int j = 0; j < i; j++) kill(stages[j].pid, SIGKILL);
+            error_exit("Cannot start pipeline stage");
+        }
+    }
+    // A stage's stdio buffers belong to its child now
+    raw_in_close();
+    for (int left = count; left > 0;) {
+        int wstatus;
+        pid_t pid = waitpid(-1, &wstatus, 0);
+        if (pid < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        for (int i = 0; i < count; i++) {
+            if (stages[i].pid != pid || stages[i].done) continue;
+            stages[i].done = true;
+            stages[i].stats->status = WIFEXITED(wstatus) ? WEXITSTATUS(wstatus) : 128 + WTERMSIG(wstatus);
+            stages[i].stats->seconds = seconds_since(&start);
+            stage_finish(&stages[i]);
+            left--;
+        }
+    }
+}
+
+// Load a coop stage, or run it until it blocks or stops, with its exits ending
+// only the stage; returns false if it exited. Nothing here changes between the
+// setjmp and a longjmp, so run_coop's loop state never has to survive one.
+static bool coop_step(struct stage *s, bool load) {
+    jmp_buf abort_here;
+    request_status = 0;
+    request_abort = &abort_here;
+    if (setjmp(abort_here) == 0) {
+        if (load) read_binary(s->path);
+        else run();
+        request_abort = NULL;
+        return true;
+    }
+    request_abort = NULL;
+    s->stats->status = request_status;
+    return false;
+}
+
+static void run_coop(struct stage *stages, int count) {
+    for (int i = 0; i < count; i++) {
+        struct stage *s = &stages[i];
+        uint64_t size = requested_mem_size ? requested_mem_size : MEM_SIZE;
+        uint8_t *m = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        uint64_t *d = calloc(DIRTY_WORDS(size), sizeof(uint64_t));
+        if (m == MAP_FAILED || !d) error_exit("Invalid memory size");
+        // Taken over like any memory set_memory_size made, should the program ask for another size
+        memory = m;
+        dirty_pages = d;
+        mem_size = size;
+        reset();
+        stage_save(s);
+        stage_switch(s);
+        if (!coop_step(s, true)) {
+            s->done = true;
+            stage_finish(s);
+        }
+        stage_save(s);
+    }
+
+    int live = 0;
+    for (int i = 0; i < count; i++) live += !stages[i].done;
+    while (live > 0) {
+        for (int i = 0; i < count; i++) {
+            struct stage *s = &stages[i];
+            if (s->done) continue;
+            stage_switch(s);
+            struct timespec start;
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            s->done = !coop_step(s, false) || !stage_blocked;
+            s->stats->seconds += seconds_since(&start);
+            stage_save(s);
+            if (s->done) {
+                stage_finish(s);
+                live--;
+            }
+        }
+    }
+
+    for (int i = 0; i < count; i++) {
+        munmap(stages[i].memory, stages[i].mem_size);
+        free(stages[i].dirty_pages);
+    }
+    memory = default_memory;
+    dirty_pages = default_dirty_pages;
+    mem_size = MEM_SIZE;
+}
+
+static int pipeline(const char *mode, char **paths, int count) {
+    bool coop = strcmp(mode, "coop") == 0;
+    if (!coop && strcmp(mode, "cores") != 0) error_exit("Invalid pipeline mode");
+    if (count < 1) error_exit("Invalid tinker filepath");
+    for (int i = 0; i < count; i++) {
+        const char *dot = strrchr(paths[i], '.');
+        if (!dot || strcmp(dot, ".tko") != 0) error_exit("Invalid tinker filepath");
+    }
+
+    // Stats, then the channels, each on cache lines of its own, all shared with the children
+    size_t stats_bytes = ((count * sizeof(struct stage_stats)) + 63) & ~(size_t)63;
+    size_t channel_bytes = (sizeof(struct channel) + queue_words * 8 + 63) & ~(size_t)63;
+    size_t shared_bytes = stats_bytes + (count - 1) * channel_bytes;
+    uint8_t *shared = mmap(NULL, shared_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    struct stage *stages = calloc(count, sizeof(struct stage));
+    if (shared == MAP_FAILED || !stages) error_exit("Out of memory");
+    for (int i = 0; i < count; i++) {
+        stages[i].path = paths[i];
+        stages[i].stats = (struct stage_stats *)shared + i;
+        if (i + 1 < count) {
+            stages[i].out = (struct channel *)(shared + stats_bytes + i * channel_bytes);
+            stages[i].out->cap = queue_words;
+        }
+        if (i > 0) stages[i].in = stages[i - 1].out;
+    }
+
+    if (coop) run_coop(stages, count);
+    else run_cores(stages, count);
+    in_channel = out_channel = NULL;
+    stage_stats = NULL;
+
+    int status = 0;
+    for (int i = 0; i < count; i++) {
+        const struct stage_stats *st = stages[i].stats;
+        double secs = st->seconds > 0 ? st->seconds : 1e-9;
+        fprintf(stderr, "stage %d %s: in %" PRIu64 " words (%.0f/s, %" PRIu64 " stalls), out %" PRIu64 " words (%.0f/s, %" PRIu64 " stalls), %.3f s, exit %d\n",
+                i, stages[i].path, st->words_in, st->words_in / secs, st->stalls_in,
+                st->words_out, st->words_out / secs, st->stalls_out, st->seconds, st->status);
+        if (st->status) status = st->status;
+    }
+    munmap(shared, shared_bytes);
+    free(stages);
+    return status;
 }
 
 int main(int argc, char** argv) {
-    if (argc < 2) error_exit("Invalid tinker filepath");
+    int argi = 1;
+
+    // A clean machine even when main runs again in the same process (tests/test_runner.c)
+    requested_mem_size = 0;
+    instruction_limit = 0;
+    time_limit = 0;
+    const char *serve_path = NULL, *client_path = NULL, *pipeline_mode = NULL;
+    long repeat = 1;
+    queue_words = DEFAULT_QUEUE_WORDS;
+    const char *map_specs[MAX_MAPS];
+    int map_spec_count = 0;
+    raw_in_close();
+    if (raw_out && raw_out != stdout) fclose(raw_out);
+    raw_out = NULL;
+    profile_path = NULL;
+    free_profile();
+    stats_stop();
+    stats_on = false;
+    stats_interval = 0;
+    memset(stats_ops, 0, sizeof(stats_ops));
+    stats_words_in = stats_words_out = 0;
+    const char *stats_path = NULL;
+    unmap_files();
+    set_memory_size(MEM_SIZE);
+    if (!memory_pristine) memset(memory, 0, mem_size);
+    reset();
+
+    while (argc - argi >= 2 && argv[argi][0] == '-') {
+        const char *value = argv[argi + 1];
+        char *end = NULL;
+        if (strcmp(argv[argi], "-m") == 0) {
+            requested_mem_size = parse_mem_size(value);
+        } else if (strcmp(argv[argi], "-i") == 0) {
+            errno = 0;
+            instruction_limit = strtoull(value, &end, 10);
+            if (errno || end == value || *end || value[0] == '-' || instruction_limit == 0) error_exit("Invalid instruction limit");
+        } else if (strcmp(argv[argi], "-t") == 0) {
+            time_limit = strtod(value, &end);
+            if (end == value || *end || !(time_limit > 0) || time_limit > 1e9) error_exit("Invalid time limit");
+        } else if (strcmp(argv[argi], "-d") == 0) {
+            serve_path = value;
+        } else if (strcmp(argv[argi], "-c") == 0) {
+            client_path = value;
+        } else if (strcmp(argv[argi], "-r") == 0) {
+            repeat = strtol(value, &end, 10);
+            if (end == value || *end || repeat < 1 || repeat > 10000000) error_exit("Invalid repeat count");
+        } else if (strcmp(argv[argi], "--map") == 0) {
+            if (map_spec_count == MAX_MAPS) error_exit("Too many maps");
+            map_specs[map_spec_count++] = value;
+        } else if (strcmp(argv[argi], "-p") == 0) {
+            profile_path = value;
+        } else if (strcmp(argv[argi], "-s") == 0) {
+            stats_interval = strtod(value, &end);
+            if (end == value || *end || !(stats_interval >= 0) || stats_interval > 1e9) error_exit("Invalid stats interval");
+            stats_on = true;
+        } else if (strcmp(argv[argi], "-S") == 0) {
+            stats_path = value;
+            stats_on = true;
+        } else if (strcmp(argv[argi], "--pipeline") == 0) {
+            pipeline_mode = value;
+        } else if (strcmp(argv[argi], "-q") == 0) {
+            errno = 0;
+            queue_words = strtoull(value, &end, 10);
+            if (errno || end == value || *end || value[0] == '-' || queue_words == 0 ||
+                (queue_words & (queue_words - 1)) || queue_words > (1ULL << 30)) error_exit("Invalid queue size");
+        } else if (strcmp(argv[argi], "-b") == 0) {
+            raw_in_open(value);
+        } else if (strcmp(argv[argi], "-B") == 0) {
+            if (raw_out && raw_out != stdout) fclose(raw_out);
+            raw_out = strcmp(value, "-") == 0 ? stdout : fopen(value, "wb");
+            if (!raw_out) error_exit("Cannot open raw output");
+        } else {
+            break;
+        }
+        argi += 2;
+    }
+    if (serve_path && (raw_in.open || raw_out)) error_exit("Raw I/O is not available in daemon mode");
+    if (serve_path && map_spec_count) error_exit("--map is not available in daemon mode");
+    if ((serve_path || client_path) && profile_path) error_exit("Profiling is not available in daemon mode");
+    if ((serve_path || client_path) && stats_on) error_exit("Statistics are not available in daemon mode");
+    if (pipeline_mode) {
+        if (serve_path || client_path || map_spec_count || profile_path || stats_on || instruction_limit || time_limit > 0) {
+            error_exit("Option not available in pipeline mode");
+        }
+        return pipeline(pipeline_mode, argv + argi, argc - argi);
+    }
+    if (serve_path) serve(serve_path, argv + argi, argc - argi);
+    if (argc - argi < 1) error_exit("Invalid tinker filepath");
+    if (client_path) return client(client_path, argv[argi], repeat);
 
-    const char *dot = strrchr(argv[1], '.');
+    const char *dot = strrchr(argv[argi], '.');
 
     if (!dot || strcmp(dot, ".tko") != 0) {
         error_exit("Invalid tinker filepath");
     }
 
-    read_binary(argv[1]);
+    read_binary(argv[argi]);
+    for (int i = 0; i < map_spec_count; i++) map_file(map_specs[i]);
+    if (stats_path) stats_open(stats_path);
+    if (stats_on) signal(SIGUSR1, on_stats_signal);
     run();
+    write_profile();
+    stats_stop();
     return 0;
 }
\ No newline at end of file
@@ -5,40 +5,70 @@
 
 SymbolTable* create_table() {
     SymbolTable* table = malloc(sizeof(SymbolTable));
-    for (int i = 0; i < TABLE_SIZE; i++) {
-        table->buckets[i] = NULL;
-    }
+    table->bucket_count = TABLE_SIZE;
+    table->count = 0;
+    table->buckets = calloc(table->bucket_count, sizeof(SymbolEntry*));
     return table;
 }
 
 //djb2
-unsigned long hash_label(char *str) {
+static unsigned long hash_string(const char *str) {
     unsigned long hash = 5381;
     int c;
     while ((c = *str++)) {
         hash = ((hash << 5) + hash) + c;
     }
-    return hash % TABLE_SIZE;
+    return hash;
+}
+
+// Bucket index in a table of TABLE_SIZE buckets; a table that has grown
+// reduces hash_string by its own bucket_count
+unsigned long hash_label(char *str) {
+    return hash_string(str) % TABLE_SIZE;
+}
+
+// Keep chains short when linking thousands of objects
+static void grow_table(SymbolTable* table) {
+    unsigned long new_count = table->bucket_count * 2 + 1;
+    SymbolEntry** new_buckets = calloc(new_count, sizeof(SymbolEntry*));
+    if (!new_buckets) return;
+
+    for (unsigned long i = 0; i < table->bucket_count; i++) {
+        SymbolEntry* entry = table->buckets[i];
+        while (entry != NULL) {
+            SymbolEntry* next = entry->next;
+            unsigned long index = hash_string(entry->label_name) % new_count;
+            entry->next = new_buckets[index];
+            new_buckets[index] = entry;
+            entry = next;
+        }
+    }
+    free(table->buckets);
+    table->buckets = new_buckets;
+    table->bucket_count = new_count;
 }
 
 int insert_label(SymbolTable* table, char* name, uint64_t addr) {
     if (lookup_label(table, name) != (uint64_t)-1) return 1;
-    unsigned int index = hash_label(name);
+    if (table->count >= table->bucket_count * 2) grow_table(table);
+
+    unsigned long index = hash_string(name) % table->bucket_count;
     SymbolEntry* new_entry = malloc(sizeof(SymbolEntry));
     
-    strncpy(new_entry->label_name, name, 63);
-    new_entry->label_name[63] = '\0';
+    strncpy(new_entry->label_name, name, MAX_LABEL - 1);
+    new_entry->label_name[MAX_LABEL - 1] = '\0';
     new_entry->address = addr;
     
     // Insert at head
     new_entry->next = table->buckets[index];
     table->buckets[index] = new_entry;
+    table->count++;
 
     return 0;
 }
 
 uint64_t lookup_label(SymbolTable* table, char* name) {
-    unsigned int index = hash_label(name);
+    unsigned long index = hash_string(name) % table->bucket_count;
     SymbolEntry* entry = table->buckets[index];
     
     while (entry != NULL) {
@@ -51,14 +81,21 @@ uint64_t lookup_label(SymbolTable* table, char* name) {
     return (uint64_t)-1; 
 }
 
-void free_table(SymbolTable* table) {
-    for (int i = 0; i < TABLE_SIZE; i++) {
+void clear_table(SymbolTable* table) {
+    for (unsigned long i = 0; i < table->bucket_count; i++) {
         SymbolEntry* entry = table->buckets[i];
         while (entry != NULL) {
             SymbolEntry* temp = entry;
             entry = entry->next;
             free(temp);
         }
+        table->buckets[i] = NULL;
     }
+    table->count = 0;
+}
+
+void free_table(SymbolTable* table) {
+    clear_table(table);
+    free(table->buckets);
     free(table);
 }
\ No newline at end of file
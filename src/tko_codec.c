@@ -0,0 +1,310 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tko_codec.h"
+
+// Growable output buffer for the compressors. Running out of memory frees it
+// and sets failed; later writes are dropped, and tko_compress reports it.
+typedef struct {
+    uint8_t *data;
+    uint64_t size, cap;
+    int failed;
+} ByteBuf;
+
+static void buf_put(ByteBuf *b, const uint8_t *src, uint64_t n) {
+    if (b->failed) return;
+    if (b->size + n > b->cap) {
+        uint64_t cap = b->cap ? b->cap : 256;
+        while (cap < b->size + n) cap *= 2;
+        uint8_t *data = realloc(b->data, cap);
+        if (!data) {
+            free(b->data);
+            b->data = NULL;
+            b->size = b->cap = 0;
+            b->failed = 1;
+            return;
+        }
+        b->data = data;
+        b->cap = cap;
+    }
+    memcpy(b->data + b->size, src, n);
+    b->size += n;
+}
+
+static void buf_byte(ByteBuf *b, uint8_t v) {
+    buf_put(b, &v, 1);
+}
+
+static void buf_varint(ByteBuf *b, uint64_t v) {
+    while (v >= 0x80) {
+        buf_byte(b, (uint8_t)(v | 0x80));
+        v >>= 7;
+    }
+    buf_byte(b, (uint8_t)v);
+}
+
+// LZ
+
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_OFFSET 65535
+#define LZ_HASH_BITS 14
+
+static uint32_t lz_hash(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+static void lz_length(ByteBuf *b, uint64_t len) {
+    // continuation of a nibble that was 15
+    while (len >= 255) {
+        buf_byte(b, 255);
+        len -= 255;
+    }
+    buf_byte(b, (uint8_t)len);
+}
+
+static void lz_sequence(ByteBuf *b, const uint8_t *lit, uint64_t lit_len, uint64_t match_len, uint64_t offset) {
+    uint64_t m = match_len ? match_len - LZ_MIN_MATCH : 0;
+    uint8_t token = (uint8_t)(((lit_len < 15 ? lit_len : 15) << 4) | (m < 15 ? m : 15));
+    buf_byte(b, token);
+    if (lit_len >= 15) lz_length(b, lit_len - 15);
+    buf_put(b, lit, lit_len);
+    if (match_len == 0) return;
+    buf_byte(b, (uint8_t)(offset & 0xFF));
+    buf_byte(b, (uint8_t)(offset >> 8));
+    if (m >= 15) lz_length(b, m - 15);
+}
+
+static void lz_compress(ByteBuf *b, const uint8_t *src, uint64_t n) {
+    int64_t *table = malloc(sizeof(int64_t) << LZ_HASH_BITS);
+    if (!table) {
+        b->failed = 1;
+        return;
+    }
+    for (int i = 0; i < (1 << LZ_HASH_BITS); i++) table[i] = -1;
+
+    uint64_t pos = 0, anchor = 0;
+    while (pos + LZ_MIN_MATCH <= n) {
+        uint32_t h = lz_hash(src + pos);
+        int64_t cand = table[h];
+        table[h] = (int64_t)pos;
+
+        if (cand >= 0 && pos - (uint64_t)cand <= LZ_MAX_OFFSET && memcmp(src + cand, src + pos, LZ_MIN_MATCH) == 0) {
+            uint64_t len = LZ_MIN_MATCH;
+            while (pos + len < n && src[cand + len] == src[pos + len]) len++;
+            lz_sequence(b, src + anchor, pos - anchor, len, pos - (uint64_t)cand);
+            pos += len;
+            anchor = pos;
+        } else {
+            pos++;
+        }
+    }
+    if (anchor < n) lz_sequence(b, src + anchor, n - anchor, 0, 0);
+    free(table);
+}
+
+// DELTA64 / STRIDE64: code each word's difference from a prediction. DELTA64
+// predicts the previous word, STRIDE64 the previous word plus the previous step.
+
+static void delta64_compress(ByteBuf *b, const uint8_t *src, uint64_t n, int stride) {
+    uint64_t words = n / 8, prev = 0, step = 0;
+    for (uint64_t i = 0; i < words; ) {
+        uint64_t w;
+        memcpy(&w, src + 8 * i, 8);
+        uint64_t d = w - (prev + step);
+        if (d == 0) {
+            // Every following word the prediction also gets right joins the run
+            uint64_t run = 1, p = w;
+            while (i + run < words) {
+                uint64_t next;
+                memcpy(&next, src + 8 * (i + run), 8);
+                if (next != p + step) break;
+                p = next;
+                run++;
+            }
+            buf_byte(b, 0);
+            buf_varint(b, run);
+            prev = p;
+            i += run;
+            continue;
+        }
+        buf_varint(b, (d << 1) ^ (uint64_t)((int64_t)d >> 63));
+        if (stride) step = w - prev;
+        prev = w;
+        i++;
+    }
+}
+
+int tko_compress(int codec, const uint8_t *src, uint64_t n, uint8_t **out, uint64_t *out_size) {
+    ByteBuf b = { NULL, 0, 0, 0 };
+    if (codec == TKO_CODEC_LZ) lz_compress(&b, src, n);
+    else if (codec == TKO_CODEC_DELTA64) delta64_compress(&b, src, n, 0);
+    else if (codec == TKO_CODEC_STRIDE64) delta64_compress(&b, src, n, 1);
+    else buf_put(&b, src, n);
+    *out = b.data;
+    *out_size = b.size;
+    return b.failed ? -1 : 0;
+}
+
+int tko_compress_best(const uint8_t *src, uint64_t n, int allow_delta, uint8_t **out, uint64_t *out_size) {
+    int best = TKO_CODEC_NONE;
+    *out = NULL;
+    *out_size = n;
+
+    int codecs[3] = { TKO_CODEC_LZ, TKO_CODEC_DELTA64, TKO_CODEC_STRIDE64 };
+    for (int i = 0; i < 3; i++) {
+        if (codecs[i] != TKO_CODEC_LZ && (!allow_delta || n % 8 != 0)) continue;
+        uint8_t *buf;
+        uint64_t size;
+        if (tko_compress(codecs[i], src, n, &buf, &size) != 0) {
+            free(*out);
+            *out = NULL;
+            *out_size = n;
+            return -1;
+        }
+        if (size < *out_size) {
+            free(*out);
+            *out = buf;
+            *out_size = size;
+            best = codecs[i];
+        } else {
+            free(buf);
+        }
+    }
+    return best;
+}
+
+// Streaming decoder input: a bounded window of the file read through a small buffer
+
+typedef struct {
+    FILE *f;
+    uint64_t remaining;   // compressed bytes not yet pulled into buf
+    uint8_t buf[4096];
+    size_t pos, len;
+} Reader;
+
+static int reader_fill(Reader *r) {
+    if (r->pos < r->len) return 0;
+    if (r->remaining == 0) return -1;
+    size_t want = r->remaining < sizeof(r->buf) ? (size_t)r->remaining : sizeof(r->buf);
+    size_t got = fread(r->buf, 1, want, r->f);
+    if (got == 0) return -1;
+    r->remaining -= got;
+    r->pos = 0;
+    r->len = got;
+    return 0;
+}
+
+static inline int read_byte(Reader *r) {
+    if (r->pos < r->len) return r->buf[r->pos++];
+    if (reader_fill(r) != 0) return -1;
+    return r->buf[r->pos++];
+}
+
+static int read_bytes(Reader *r, uint8_t *dst, uint64_t n) {
+    while (n > 0) {
+        if (reader_fill(r) != 0) return -1;
+        size_t chunk = r->len - r->pos;
+        if (chunk > n) chunk = (size_t)n;
+        memcpy(dst, r->buf + r->pos, chunk);
+        r->pos += chunk;
+        dst += chunk;
+        n -= chunk;
+    }
+    return 0;
+}
+
+static int read_varint(Reader *r, uint64_t *v) {
+    *v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        int c = read_byte(r);
+        if (c < 0) return -1;
+        *v |= (uint64_t)(c & 0x7F) << shift;
+        if (!(c & 0x80)) return 0;
+    }
+    return -1;
+}
+
+static int lz_length_ext(Reader *r, uint64_t *len) {
+    int c;
+    do {
+        c = read_byte(r);
+        if (c < 0) return -1;
+        *len += (uint64_t)c;
+    } while (c == 255);
+    return 0;
+}
+
+static int lz_decompress(Reader *r, uint8_t *dst, uint64_t dst_size) {
+    uint64_t out = 0;
+    while (out < dst_size) {
+        int token = read_byte(r);
+        if (token < 0) return -1;
+
+        uint64_t lit = (uint64_t)token >> 4;
+        if (lit == 15 && lz_length_ext(r, &lit) != 0) return -1;
+        if (lit > dst_size - out) return -1;
+        if (read_bytes(r, dst + out, lit) != 0) return -1;
+        out += lit;
+        if (out == dst_size) break;
+
+        int lo = read_byte(r), hi = read_byte(r);
+        if (lo < 0 || hi < 0) return -1;
+        uint64_t offset = (uint64_t)lo | ((uint64_t)hi << 8);
+        uint64_t match = (uint64_t)(token & 0xF);
+        if (match == 15 && lz_length_ext(r, &match) != 0) return -1;
+        match += LZ_MIN_MATCH;
+        if (offset == 0 || offset > out || match > dst_size - out) return -1;
+
+        // Overlapping matches replicate the last offset bytes, so copy those byte by byte
+        uint8_t *from = dst + out - offset;
+        if (offset >= match) memcpy(dst + out, from, match);
+        else for (uint64_t i = 0; i < match; i++) dst[out + i] = from[i];
+        out += match;
+    }
+    return 0;
+}
+
+static int delta64_decompress(Reader *r, uint8_t *dst, uint64_t dst_size, int stride) {
+    if (dst_size % 8 != 0) return -1;
+    uint64_t words = dst_size / 8, prev = 0, step = 0;
+    for (uint64_t i = 0; i < words; ) {
+        uint64_t zz;
+        if (read_varint(r, &zz) != 0) return -1;
+        if (zz == 0) {
+            uint64_t run;
+            if (read_varint(r, &run) != 0 || run == 0 || run > words - i) return -1;
+            for (uint64_t k = 0; k < run; k++) {
+                prev += step;
+                memcpy(dst + 8 * (i + k), &prev, 8);
+            }
+            i += run;
+            continue;
+        }
+        uint64_t w = prev + step + ((zz >> 1) ^ (0 - (zz & 1)));
+        memcpy(dst + 8 * i, &w, 8);
+        if (stride) step = w - prev;
+        prev = w;
+        i++;
+    }
+    return 0;
+}
+
+int tko_decompress(FILE *in, uint64_t in_size, int codec, uint8_t *dst, uint64_t dst_size) {
+    Reader r;
+    r.f = in;
+    r.remaining = in_size;
+    r.pos = r.len = 0;
+
+    int rc;
+    if (codec == TKO_CODEC_LZ) rc = lz_decompress(&r, dst, dst_size);
+    else if (codec == TKO_CODEC_DELTA64) rc = delta64_decompress(&r, dst, dst_size, 0);
+    else if (codec == TKO_CODEC_STRIDE64) rc = delta64_decompress(&r, dst, dst_size, 1);
+    else if (codec == TKO_CODEC_NONE) rc = (in_size == dst_size) ? read_bytes(&r, dst, dst_size) : -1;
+    else rc = -1;
+
+    // Trailing bytes mean the section does not describe this stream
+    if (rc == 0 && (r.pos != r.len || r.remaining != 0)) rc = -1;
+    return rc;
+}
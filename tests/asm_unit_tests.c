@@ -2,26 +2,20 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <unistd.h>
-#include <sys/wait.h>
-#include <fcntl.h>
+#include <pthread.h>
 
+#include "assemble.c"
 #define main hw5_asm_main
 #include "assembler.c"
 #undef main
 
-#define EXPECT_DEATH(statement) do { \
-    pid_t pid = fork(); \
-    if (pid == 0) { \
-        int fd = open("/dev/null", O_WRONLY); \
-        dup2(fd, STDERR_FILENO); \
-        close(fd); \
+// The context the helpers below report errors through
+static Asm ctx;
+
+#define EXPECT_ERROR(statement) do { \
+    if (setjmp(ctx.fail) == 0) { \
         statement; \
-        exit(0); \
-    } else { \
-        int status; \
-        waitpid(pid, &status, 0); \
-        assert(WIFEXITED(status) && WEXITSTATUS(status) == 1); \
+        assert(!"expected an assembler error"); \
     } \
 } while(0)
 
@@ -46,16 +40,16 @@ void test_line_has_non_ws() {
 }
 
 void test_enforce_leading_space_rule() {
-    enforce_leading_space_rule("\taddi r1, 10");
-    enforce_leading_space_rule(".code");
-    EXPECT_DEATH(enforce_leading_space_rule(" addi r1, 10"));
+    enforce_leading_space_rule(&ctx, "\taddi r1, 10");
+    enforce_leading_space_rule(&ctx, ".code");
+    EXPECT_ERROR(enforce_leading_space_rule(&ctx, " addi r1, 10"));
 }
 
 void test_enforce_tab_rule_if_statement() {
-    enforce_tab_rule_if_statement("\taddi r1, 10", "addi r1, 10");
-    enforce_tab_rule_if_statement(".code", ".code");
-    enforce_tab_rule_if_statement(":label", ":label");
-    EXPECT_DEATH(enforce_tab_rule_if_statement("addi r1, 10", "addi r1, 10"));
+    enforce_tab_rule_if_statement(&ctx, "\taddi r1, 10", "addi r1, 10");
+    enforce_tab_rule_if_statement(&ctx, ".code", ".code");
+    enforce_tab_rule_if_statement(&ctx, ":label", ":label");
+    EXPECT_ERROR(enforce_tab_rule_if_statement(&ctx, "addi r1, 10", "addi r1, 10"));
 }
 
 void test_is_valid_label_name() {
@@ -66,9 +60,9 @@ void test_is_valid_label_name() {
 }
 
 void test_enforce_label_only() {
-    enforce_label_only(":valid_label   \t ");
-    EXPECT_DEATH(enforce_label_only(":invalid_label addi"));
-    EXPECT_DEATH(enforce_label_only(":1bad"));
+    enforce_label_only(&ctx, ":valid_label   \t ");
+    EXPECT_ERROR(enforce_label_only(&ctx, ":invalid_label addi"));
+    EXPECT_ERROR(enforce_label_only(&ctx, ":1bad"));
 }
 
 void test_parse_register() {
@@ -82,6 +76,7 @@ void test_parse_register() {
 void test_get_opcode() {
     assert(get_opcode("add") == OP_ADD);
     assert(get_opcode("halt") == MACRO_HALT);
+    assert(get_opcode("outs") == MACRO_OUTS);
     assert(get_opcode("mov") == OP_MOV_RR);
     assert(get_opcode("fake") == OP_UNKNOWN);
 }
@@ -132,17 +127,17 @@ void test_parse_int64_strict() {
 }
 
 void test_check_bounds_signed() {
-    check_bounds_signed(2047, 12, "msg");
-    check_bounds_signed(-2048, 12, "msg");
-    EXPECT_DEATH(check_bounds_signed(2048, 12, "msg"));
-    EXPECT_DEATH(check_bounds_signed(-2049, 12, "msg"));
+    check_bounds_signed(&ctx, 2047, 12, "msg");
+    check_bounds_signed(&ctx, -2048, 12, "msg");
+    EXPECT_ERROR(check_bounds_signed(&ctx, 2048, 12, "msg"));
+    EXPECT_ERROR(check_bounds_signed(&ctx, -2049, 12, "msg"));
 }
 
 void test_check_bounds_unsigned() {
-    check_bounds_unsigned(4095, 12, "msg");
-    check_bounds_unsigned(0, 12, "msg");
-    EXPECT_DEATH(check_bounds_unsigned(4096, 12, "msg"));
-    EXPECT_DEATH(check_bounds_unsigned(-1, 12, "msg"));
+    check_bounds_unsigned(&ctx, 4095, 12, "msg");
+    check_bounds_unsigned(&ctx, 0, 12, "msg");
+    EXPECT_ERROR(check_bounds_unsigned(&ctx, 4096, 12, "msg"));
+    EXPECT_ERROR(check_bounds_unsigned(&ctx, -1, 12, "msg"));
 }
 
 void test_parse_mem_operand() {
@@ -162,6 +157,208 @@ void test_parse_mem_operand() {
     assert(parse_mem_operand("r1(10)", &base_reg, &lit, t) == 1);
 }
 
+void test_symbol_table() {
+    SymbolTable *t = create_table();
+    char name[32];
+
+    // Enough labels to grow the buckets several times
+    for (int i = 0; i < 1000; i++) {
+        snprintf(name, sizeof(name), "label%d", i);
+        assert(hash_label(name) < TABLE_SIZE);
+        assert(insert_label(t, name, 8 * i) == 0);
+    }
+    assert(t->bucket_count > TABLE_SIZE);
+    for (int i = 0; i < 1000; i++) {
+        snprintf(name, sizeof(name), "label%d", i);
+        assert(lookup_label(t, name) == (uint64_t)(8 * i));
+    }
+    assert(insert_label(t, "label7", 0) == 1);
+    assert(lookup_label(t, "missing") == (uint64_t)-1);
+    free_table(t);
+}
+
+void test_ld_size() {
+    assert(ld_size(0) == 4);
+    assert(ld_size(1) == 8);
+    assert(ld_size(4095) == 8);
+    assert(ld_size(0x10000) == 12);
+    assert(ld_size(0x2004) == 12);
+    assert(ld_size(0x2005) == 16);
+    assert(ld_size(~0ULL) == 48);
+}
+
+void test_v2_layout() {
+    const char *src = ".code\n\tclr r1\n:loop\n\taddi r1, 1\n\tld r2, :loop\n\tbr r2\n.data\n:table\n\t7\n";
+    AsmOptions opts;
+    AsmResult res;
+    asm_default_options(&opts);
+    opts.format = ASM_EXEC_V2;
+    assert(assemble(src, strlen(src), &opts, &res) == 0);
+    FILE *f = fmemopen(res.image, res.image_size, "rb");
+
+    struct tinker_v2_header v2;
+    assert(fread(&v2, sizeof(v2), 1, f) == 1);
+    assert(v2.file_type == TINKER_EXEC_V2);
+    assert(v2.entry == 0x2000);
+    assert(v2.section_count == 5);
+
+    struct tinker_section sec[5];
+    fseek(f, v2.section_table_offset, SEEK_SET);
+    assert(fread(sec, sizeof(sec[0]), 5, f) == 5);
+    for (int i = 0; i < 5; i++) assert(sec[i].offset % TINKER_V2_ALIGN == 0);
+    assert(sec[0].type == TINKER_SEC_CODE && sec[0].addr == 0x2000 && sec[0].size == 24);
+    assert(sec[1].type == TINKER_SEC_DATA && sec[1].addr == 0x10000 && sec[1].size == 8);
+
+    // Symbols are sorted by address: loop (0x2004) before table (0x10000)
+    assert(sec[2].type == TINKER_SEC_SYMTAB && sec[2].size == 2 * sizeof(struct tinker_symbol));
+    struct tinker_symbol syms[2];
+    char strtab[64];
+    fseek(f, sec[2].offset, SEEK_SET);
+    assert(fread(syms, sizeof(syms[0]), 2, f) == 2);
+    assert(sec[3].type == TINKER_SEC_STRTAB && sec[3].size <= sizeof(strtab));
+    fseek(f, sec[3].offset, SEEK_SET);
+    assert(fread(strtab, 1, sec[3].size, f) == sec[3].size);
+    assert(syms[0].value == 0x2004 && strcmp(strtab + syms[0].name, "loop") == 0);
+    assert(syms[1].value == 0x10000 && strcmp(strtab + syms[1].name, "table") == 0);
+
+    // One line entry per statement, with its source line
+    assert(sec[4].type == TINKER_SEC_LINES && sec[4].size == 4 * sizeof(struct tinker_line));
+    struct tinker_line lines[4];
+    fseek(f, sec[4].offset, SEEK_SET);
+    assert(fread(lines, sizeof(lines[0]), 4, f) == 4);
+    assert(lines[0].addr == 0x2000 && lines[0].line == 2);
+    assert(lines[1].addr == 0x2004 && lines[1].line == 4);
+    assert(lines[2].addr == 0x2008 && lines[2].line == 5);
+    assert(lines[3].addr == 0x2014 && lines[3].line == 6);
+    assert(res.line_count == 4 && memcmp(res.lines, lines, sizeof(lines)) == 0);
+    fclose(f);
+
+    asm_result_free(&res);
+}
+
+void test_assemble_errors() {
+    AsmOptions opts;
+    AsmResult res;
+    asm_default_options(&opts);
+
+    // Caught in pass_one, and in pass_two on the expansion of line 3
+    const char *bad_label = ".code\n\tclr r1\n\tbrr :nowhere\n";
+    assert(assemble(bad_label, strlen(bad_label), &opts, &res) == -1);
+    assert(strcmp(res.error, "Label not found") == 0 && res.error_line == 3);
+    assert(res.image == NULL && res.listing == NULL);
+    const char *bad_literal = ".code\n\tclr r1\n\n\taddi r1, 4096\n\thalt\n";
+    assert(assemble(bad_literal, strlen(bad_literal), &opts, &res) == -1);
+    assert(strcmp(res.error, "Literal exceeds 12-bit unsigned range") == 0 && res.error_line == 4);
+
+    // .incbin needs a reader; a layout error has no line
+    const char *incbin = ".code\n\thalt\n.data\n\t.incbin \"table.bin\"\n";
+    assert(assemble(incbin, strlen(incbin), &opts, &res) == -1);
+    assert(strstr(res.error, "file reader") && res.error_line == 4);
+    opts.data_begin = 0x2000;
+    const char *overlap = ".code\n\thalt\n.data\n\t1\n";
+    assert(assemble(overlap, strlen(overlap), &opts, &res) == -1);
+    assert(res.error_line == 0);
+}
+
+// Each thread assembles the same program and must get the same bytes
+typedef struct {
+    const char *src;
+    const AsmResult *expected;
+    int failures;
+} AsmThread;
+
+static void *assemble_repeatedly(void *arg) {
+    AsmThread *job = arg;
+    AsmOptions opts;
+    asm_default_options(&opts);
+    opts.format = ASM_EXEC_V2_COMPRESSED;
+    for (int i = 0; i < 50; i++) {
+        AsmResult res;
+        if (assemble(job->src, strlen(job->src), &opts, &res) != 0 ||
+            res.image_size != job->expected->image_size ||
+            memcmp(res.image, job->expected->image, res.image_size) != 0) {
+            job->failures++;
+        }
+        asm_result_free(&res);
+    }
+    return NULL;
+}
+
+void test_assemble_threads() {
+    const char *src = ".code\n\tld r1, :table\n\tld r2, 1000000\n:loop\n\tmov r3, (r1)(8)\n"
+                      "\tsubi r2, 1\n\tbrnz r4, r2\n\thalt\n.data\n:table\n\t.fill 64, 7\n\t.zero 4096\n\t42\n";
+    AsmOptions opts;
+    AsmResult expected;
+    asm_default_options(&opts);
+    opts.format = ASM_EXEC_V2_COMPRESSED;
+    assert(assemble(src, strlen(src), &opts, &expected) == 0);
+
+    pthread_t threads[8];
+    AsmThread jobs[8];
+    for (int i = 0; i < 8; i++) {
+        jobs[i] = (AsmThread){ src, &expected, 0 };
+        assert(pthread_create(&threads[i], NULL, assemble_repeatedly, &jobs[i]) == 0);
+    }
+    for (int i = 0; i < 8; i++) {
+        pthread_join(threads[i], NULL);
+        assert(jobs[i].failures == 0);
+    }
+    asm_result_free(&expected);
+}
+
+static void check_codec_roundtrip(int codec, const uint8_t *src, uint64_t n) {
+    uint8_t *z;
+    uint64_t zn;
+    assert(tko_compress(codec, src, n, &z, &zn) == 0);
+    FILE *f = tmpfile();
+    fwrite(z, 1, zn, f);
+    rewind(f);
+
+    uint8_t *back = malloc(n + 1);
+    assert(tko_decompress(f, zn, codec, back, n) == 0);
+    assert(memcmp(back, src, n) == 0);
+
+    // Truncated input must be rejected, not read past
+    if (zn > 0) {
+        rewind(f);
+        assert(tko_decompress(f, zn - 1, codec, back, n) == -1);
+    }
+    fclose(f);
+    free(back);
+    free(z);
+}
+
+void test_codecs() {
+    uint64_t n = 4096;
+    uint64_t *words = malloc(n * 8);
+
+    // Lookup-table shaped data: a ramp, a zero run, then repeats
+    for (uint64_t i = 0; i < n; i++) words[i] = i < 1000 ? i * 12345 : (i < 3000 ? 0 : i % 7);
+    check_codec_roundtrip(TKO_CODEC_LZ, (uint8_t *)words, n * 8);
+    check_codec_roundtrip(TKO_CODEC_DELTA64, (uint8_t *)words, n * 8);
+    check_codec_roundtrip(TKO_CODEC_STRIDE64, (uint8_t *)words, n * 8);
+
+    uint8_t *z;
+    uint64_t zn;
+    assert(tko_compress_best((uint8_t *)words, n * 8, 1, &z, &zn) != TKO_CODEC_NONE);
+    assert(zn < n * 8 / 4);
+    free(z);
+
+    // Incompressible bytes stay raw
+    uint64_t x = 88172645463325252ULL;
+    for (uint64_t i = 0; i < n; i++) {
+        x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+        words[i] = x;
+    }
+    check_codec_roundtrip(TKO_CODEC_LZ, (uint8_t *)words, n * 8);
+    check_codec_roundtrip(TKO_CODEC_DELTA64, (uint8_t *)words, n * 8);
+    check_codec_roundtrip(TKO_CODEC_STRIDE64, (uint8_t *)words, n * 8);
+    assert(tko_compress_best((uint8_t *)words, n * 8, 1, &z, &zn) == TKO_CODEC_NONE);
+    assert(z == NULL && zn == n * 8);
+
+    check_codec_roundtrip(TKO_CODEC_LZ, (uint8_t *)words, 3);
+    free(words);
+}
 
 int main() {
     test_trim_line();
@@ -178,6 +375,12 @@ int main() {
     test_check_bounds_signed();
     test_check_bounds_unsigned();
     test_parse_mem_operand();
+    test_symbol_table();
+    test_ld_size();
+    test_v2_layout();
+    test_assemble_errors();
+    test_assemble_threads();
+    test_codecs();
 
     printf("ALL TESTS PASSED\n");
     return 0;
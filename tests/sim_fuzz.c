@@ -0,0 +1,568 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+#include <fcntl.h>
+
+#define main hw5_sim_main
+#include "simulator.c"
+#undef main
+
+// sim_fuzz: differential fuzzer for the simulator. Random programs (mostly valid
+// instructions, some raw words), data images and input streams run through the
+// reference fetch/execute loop and through every engine in the table below, each
+// in its own child process. Registers, PC, a hash of guest memory, printed output
+// and the exit status must all agree. A divergence is shrunk to a minimal program
+// and written out as fuzz_repro.tko / fuzz_repro.in.
+//
+// Engines are compared on their final state, so an engine need not stop after
+// every instruction. The reference stops a looping program after MAX_STEPS the
+// way -i does, and engines with that budget are compared on the stop too. Add
+// new execution paths to `engines`.
+//
+// -a HW5_AOT adds hw5-aot: each case is translated, compiled as aot_tests.sh
+// does (run from the repo root) and run as its own program. The translation
+// keeps the guest registers in C locals, so only exit status, output and guest
+// memory are compared for it.
+
+#define MAX_CODE 256
+#define MAX_DATA 64
+#define MAX_INPUT 16
+#define CODE_BEGIN 0x2000
+#define DATA_BEGIN 0x10000
+#define MAX_STEPS (1 << 20)
+#define STEP_LIMIT_STATUS 124
+#define TIMEOUT_MS 500     // backstop for an engine that loops where the reference halts
+#define AOT_CC "gcc -O1 -I./src -I./include"
+#define AOT_RUNTIME "./src/symbol_table.c ./src/tko_codec.c -lm"
+
+// mov r0, r0
+#define NOP ((uint32_t)OP_MOV_RR << 27)
+
+typedef struct {
+    uint32_t code[MAX_CODE];
+    int code_len;
+    uint64_t data[MAX_DATA];
+    int data_len;
+    char input[MAX_INPUT][24];
+    int input_len;
+} Case;
+
+// What a run leaves behind, written by an atexit hook
+typedef struct {
+    uint64_t registers[32];
+    uint64_t pc;
+    uint64_t mem_hash;
+} State;
+
+typedef struct {
+    int status;                 // exit status, or 128 + signal
+    uint64_t registers[32];
+    uint64_t pc;
+    uint64_t mem_hash;
+    char output[4096];
+    size_t output_len;
+} Outcome;
+
+typedef struct {
+    const char *name;
+    bool compressed;            // load from a compressed v2 file rather than v1
+    bool bounded;               // stops after MAX_STEPS as the reference does
+    void (*run)(void);
+    bool translated;            // hw5-aot's translation, run as a program of its own
+} Engine;
+
+// A program that loops stops as under -i MAX_STEPS: the count is checked only
+// when a taken branch ends a block, so a bounded engine stops on the same
+// instruction. Engines without the bound skip such cases.
+static void reference_run(void) {
+    uint64_t steps = 0;
+    while (!halt_program) {
+        uint32_t instr = fetch();
+        uint64_t next = program_counter;
+        execute(instr);
+        steps++;
+        if (program_counter != next && steps >= MAX_STEPS) exit(STEP_LIMIT_STATUS);
+    }
+}
+
+// Deliberately wrong (subi by 7 subtracts 8), to check that the harness
+// finds and shrinks divergences; enabled with -x
+static void broken_run(void) {
+    while (!halt_program) {
+        uint32_t instr = fetch();
+        if (((instr >> 27) & 0x1F) == OP_SUBI && (instr & 0xFFF) == 7) registers[(instr >> 22) & 0x1F] -= 8;
+        else execute(instr);
+    }
+}
+
+// The -i/-t loop, with the reference's budget
+static void limited_run(void) {
+    instruction_limit = MAX_STEPS;
+    run();
+}
+
+static const Engine reference = { "reference", false, true, reference_run };
+
+static Engine engines[5] = {
+    { "run", false, false, run },
+    { "v2-z load", true, false, run },
+    { "run -i", false, true, limited_run },
+};
+static int engine_count = 3;
+static const char *aot_path = NULL;
+
+// Random
+
+static uint64_t rng_state;
+
+static uint64_t rng_next(void) {
+    // xorshift64*
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+static int rng_below(int n) {
+    return (int)(rng_next() % (uint64_t)n);
+}
+
+static uint32_t make_instr(int op, int rd, int rs, int rt, uint32_t lit) {
+    return ((op & 0x1F) << 27) | ((rd & 0x1F) << 22) | ((rs & 0x1F) << 17) | ((rt & 0x1F) << 12) | (lit & 0xFFF);
+}
+
+// Few registers, so instructions feed each other; r31 now and then for the stack
+static int fuzz_reg(void) {
+    return rng_below(16) == 0 ? 31 : rng_below(8);
+}
+
+static void emit(Case *c, uint32_t instr) {
+    if (c->code_len < MAX_CODE - 1) c->code[c->code_len++] = instr;
+}
+
+static void gen_instr(Case *c) {
+    static const int rrr[] = { OP_AND, OP_OR, OP_XOR, OP_SHFTR, OP_SHFTL, OP_ADD, OP_SUB, OP_MUL, OP_DIV,
+                               OP_ADDF, OP_SUBF, OP_MULF, OP_DIVF };
+    static const int ri[] = { OP_SHFTRI, OP_SHFTLI, OP_ADDI, OP_SUBI, OP_MOV_L };
+    int rd = fuzz_reg(), rs = fuzz_reg(), rt = fuzz_reg();
+
+    switch (rng_below(20)) {
+        case 0: case 1: case 2: case 3: case 4:
+            emit(c, make_instr(rrr[rng_below(13)], rd, rs, rt, 0));
+            break;
+        case 5: case 6: case 7: case 8:
+            emit(c, make_instr(ri[rng_below(5)], rd, 0, 0, rng_below(8) ? rng_below(64) : (uint32_t)rng_next()));
+            break;
+        case 9:
+            emit(c, make_instr(rng_below(2) ? OP_MOV_RR : OP_NOT, rd, rs, 0, 0));
+            break;
+        case 10:
+            // rd = the data segment base
+            emit(c, make_instr(OP_XOR, rd, rd, rd, 0));
+            emit(c, make_instr(OP_ADDI, rd, 0, 0, DATA_BEGIN >> 12));
+            emit(c, make_instr(OP_SHFTLI, rd, 0, 0, 12));
+            break;
+        case 11: case 12: {
+            uint32_t lit = rng_below(8) ? (uint32_t)(rng_below(2 * MAX_DATA) - MAX_DATA / 2) * 8 : (uint32_t)rng_next();
+            if (rng_below(2)) emit(c, make_instr(OP_MOV_ML, rd, rs, 0, lit));
+            else emit(c, make_instr(OP_MOV_SM, rd, rs, 0, lit));
+            break;
+        }
+        case 13:
+            // mostly short forward jumps, so most programs terminate
+            emit(c, make_instr(OP_BRR_L, 0, 0, 0, rng_below(8) ? 4 * (1 + rng_below(8)) : (uint32_t)rng_next() & 0x7FC));
+            break;
+        case 14: {
+            static const int ctl[] = { OP_BR, OP_BRR_R, OP_BRNZ, OP_BRGT, OP_CALL, OP_RET };
+            emit(c, make_instr(ctl[rng_below(6)], rd, rs, rt, 0));
+            break;
+        }
+        case 15:
+            emit(c, make_instr(OP_PRIV, rd, rs, 0, 3));
+            break;
+        case 16: case 17:
+            // out to port 1 or 3
+            emit(c, make_instr(OP_XOR, 7, 7, 7, 0));
+            emit(c, make_instr(OP_ADDI, 7, 0, 0, rng_below(2) ? 1 : 3));
+            emit(c, make_instr(OP_PRIV, 7, rs, 0, 4));
+            break;
+        case 18:
+            emit(c, make_instr(OP_PRIV, rd, rs, rt, rng_below(4) ? 0 : (uint32_t)rng_next()));
+            break;
+        default:
+            // an arbitrary word, often an undefined opcode
+            emit(c, (uint32_t)rng_next());
+            break;
+    }
+}
+
+static void gen_case(Case *c, int max_len) {
+    memset(c, 0, sizeof(*c));
+    int len = 1 + rng_below(max_len);
+    while (c->code_len < len) gen_instr(c);
+    c->code[c->code_len++] = make_instr(OP_PRIV, 0, 0, 0, 0);
+
+    c->data_len = rng_below(MAX_DATA + 1);
+    for (int i = 0; i < c->data_len; i++) {
+        c->data[i] = rng_below(4) ? rng_next() >> rng_below(64) : 0;
+    }
+
+    c->input_len = rng_below(MAX_INPUT + 1);
+    for (int i = 0; i < c->input_len; i++) {
+        static const char *bad[] = { "-1", "+2", "x", "18446744073709551616", "0x10", "3.5" };
+        if (rng_below(10) == 0) snprintf(c->input[i], sizeof(c->input[i]), "%s", bad[rng_below(6)]);
+        else snprintf(c->input[i], sizeof(c->input[i]), "%llu", (unsigned long long)(rng_next() >> rng_below(64)));
+    }
+}
+
+// Files
+
+static void write_v1(const Case *c, const char *path) {
+    struct tinker_file_header h = {
+        TINKER_EXEC, CODE_BEGIN, (uint64_t)c->code_len * 4, DATA_BEGIN, (uint64_t)c->data_len * 8
+    };
+    FILE *f = fopen(path, "wb");
+    if (!f) error_exit("Cannot open output file");
+    fwrite(&h, sizeof(h), 1, f);
+    fwrite(c->code, 4, c->code_len, f);
+    fwrite(c->data, 8, c->data_len, f);
+    fclose(f);
+}
+
+static uint64_t align_up(uint64_t v) {
+    return (v + TINKER_V2_ALIGN - 1) & ~(uint64_t)(TINKER_V2_ALIGN - 1);
+}
+
+// The same image as a compressed v2 file: a code and a data section, each in
+// whatever codec tko_compress_best picks
+static void write_v2z(const Case *c, const char *path) {
+    const uint8_t *src[2] = { (const uint8_t *)c->code, (const uint8_t *)c->data };
+    uint64_t size[2] = { (uint64_t)c->code_len * 4, (uint64_t)c->data_len * 8 };
+    uint8_t *packed[2];
+    uint64_t packed_size[2];
+    int codec[2];
+
+    struct tinker_v2_header h;
+    memset(&h, 0, sizeof(h));
+    h.file_type = TINKER_EXEC_V2;
+    h.entry = CODE_BEGIN;
+    h.section_count = 2;
+    h.section_table_offset = sizeof(h);
+    h.flags = TINKER_V2_COMPRESSED;
+
+    struct tinker_section sec[2];
+    memset(sec, 0, sizeof(sec));
+    uint64_t off = align_up(sizeof(h) + sizeof(sec));
+    for (int i = 0; i < 2; i++) {
+        codec[i] = tko_compress_best(src[i], size[i], i == 1, &packed[i], &packed_size[i]);
+        if (codec[i] < 0) error_exit("Out of memory");
+        sec[i].type = i == 0 ? TINKER_SEC_CODE : TINKER_SEC_DATA;
+        sec[i].flags = codec[i];
+        sec[i].addr = i == 0 ? CODE_BEGIN : DATA_BEGIN;
+        sec[i].offset = off;
+        sec[i].size = packed_size[i];
+        sec[i].mem_size = size[i];
+        off = align_up(off + packed_size[i]);
+    }
+
+    FILE *f = fopen(path, "wb");
+    if (!f) error_exit("Cannot open output file");
+    fwrite(&h, sizeof(h), 1, f);
+    fwrite(sec, sizeof(sec), 1, f);
+    for (int i = 0; i < 2; i++) {
+        fseek(f, sec[i].offset, SEEK_SET);
+        fwrite(codec[i] == TKO_CODEC_NONE ? src[i] : packed[i], 1, packed_size[i], f);
+        free(packed[i]);
+    }
+    fclose(f);
+}
+
+static void write_input(const Case *c, const char *path) {
+    FILE *f = fopen(path, "w");
+    if (!f) error_exit("Cannot open output file");
+    for (int i = 0; i < c->input_len; i++) fprintf(f, "%s\n", c->input[i]);
+    fclose(f);
+}
+
+// Running an engine
+
+static int state_fd = -1;
+
+static uint64_t hash_memory(void) {
+    uint64_t h = 0xcbf29ce484222325ULL;   // FNV-1a
+    for (uint64_t i = 0; i < mem_size; i++) h = (h ^ memory[i]) * 0x100000001b3ULL;
+    return h;
+}
+
+// Runs from exit(), so error_exit paths report their state too
+static void report_state(void) {
+    State st;
+    memcpy(st.registers, registers, sizeof(registers));
+    st.pc = program_counter;
+    st.mem_hash = hash_memory();
+    if (write(state_fd, &st, sizeof(st)) != (ssize_t)sizeof(st)) _exit(125);
+}
+
+// The same hook, appended to the translated program; it reports a State to the
+// descriptor in FUZZ_STATE_FD
+static const char aot_hook[] =
+    "\nstatic void fuzz_report_state(void) {\n"
+    "\tuint64_t st[34];\n"
+    "\tmemcpy(st, registers, sizeof(registers));\n"
+    "\tst[32] = program_counter;\n"
+    "\tst[33] = 0xcbf29ce484222325ULL;\n"
+    "\tfor (uint64_t i = 0; i < mem_size; i++) st[33] = (st[33] ^ memory[i]) * 0x100000001b3ULL;\n"
+    "\tif (write(atoi(getenv(\"FUZZ_STATE_FD\")), st, sizeof(st)) != (ssize_t)sizeof(st)) _exit(125);\n"
+    "}\n"
+    "__attribute__((constructor)) static void fuzz_hook(void) { atexit(fuzz_report_state); }\n";
+
+// fuzz_case.tko through hw5-aot into the program fuzz_aot; on failure there is
+// no program, and the run's exit status shows it
+static void translate_case(void) {
+    remove("fuzz_aot");
+    char cmd[4096];
+    snprintf(cmd, sizeof(cmd), "%s fuzz_case.tko fuzz_aot.c > /dev/null 2>&1", aot_path);
+    if (system(cmd) != 0) return;
+    FILE *f = fopen("fuzz_aot.c", "a");
+    if (!f) return;
+    fputs(aot_hook, f);
+    fclose(f);
+    if (system(AOT_CC " -o fuzz_aot fuzz_aot.c " AOT_RUNTIME " > /dev/null 2>&1") != 0) remove("fuzz_aot");
+}
+
+static void run_engine(const Engine *e, Outcome *o) {
+    int fds[2];
+    if (pipe(fds) != 0) error_exit("pipe failed");
+    const char *out_path = "fuzz_out.tmp";
+    if (e->translated) translate_case();
+
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) error_exit("fork failed");
+    if (pid == 0) {
+        close(fds[0]);
+        state_fd = fds[1];
+        if (!freopen("fuzz_in.tmp", "r", stdin) || !freopen(out_path, "w", stdout)) _exit(126);
+        int null_fd = open("/dev/null", O_WRONLY);
+        dup2(null_fd, STDERR_FILENO);
+        struct itimerval timeout = { { 0, 0 }, { 0, TIMEOUT_MS * 1000 } };
+        setitimer(ITIMER_REAL, &timeout, NULL);   // kept across exec
+        if (e->translated) {
+            char fd[16];
+            snprintf(fd, sizeof(fd), "%d", state_fd);
+            setenv("FUZZ_STATE_FD", fd, 1);
+            execl("./fuzz_aot", "fuzz_aot", (char *)NULL);
+            _exit(127);
+        }
+        atexit(report_state);
+        read_binary(e->compressed ? "fuzz_case_z.tko" : "fuzz_case.tko");
+        e->run();
+        exit(0);
+    }
+    close(fds[1]);
+
+    memset(o, 0, sizeof(*o));
+    State state;
+    ssize_t got = read(fds[0], &state, sizeof(state));
+    close(fds[0]);
+    int status;
+    waitpid(pid, &status, 0);
+
+    if (got == (ssize_t)sizeof(state)) {
+        memcpy(o->registers, state.registers, sizeof(o->registers));
+        o->pc = state.pc;
+        o->mem_hash = state.mem_hash;
+    }
+    o->status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+
+    FILE *f = fopen(out_path, "rb");
+    if (f) {
+        o->output_len = fread(o->output, 1, sizeof(o->output), f);
+        fclose(f);
+    }
+    remove(out_path);
+}
+
+// Name of the first field that differs, or NULL; registers and PC only where
+// the engine keeps them in the simulator's globals
+static const char *differs(const Outcome *a, const Outcome *b, const Engine *e) {
+    if (a->status != b->status) return "exit status";
+    if (a->status >= 128) return NULL;   // both timed out or crashed; state is meaningless
+    if (!e->translated && a->pc != b->pc) return "pc";
+    if (!e->translated && memcmp(a->registers, b->registers, sizeof(a->registers)) != 0) return "registers";
+    if (a->mem_hash != b->mem_hash) return "memory";
+    if (a->output_len != b->output_len || memcmp(a->output, b->output, a->output_len) != 0) return "output";
+    return NULL;
+}
+
+// Runs the case everywhere; returns the first diverging engine, or -1
+static int check_case(const Case *c, Outcome *ref, Outcome *got, const char **field) {
+    write_v1(c, "fuzz_case.tko");
+    write_v2z(c, "fuzz_case_z.tko");
+    write_input(c, "fuzz_in.tmp");
+
+    run_engine(&reference, ref);
+    for (int i = 0; i < engine_count; i++) {
+        if (ref->status == STEP_LIMIT_STATUS && !engines[i].bounded) continue;
+        run_engine(&engines[i], got);
+        *field = differs(ref, got, &engines[i]);
+        if (*field) return i;
+    }
+    return -1;
+}
+
+// Shrinking: keep any simplification under which some engine still diverges
+
+static bool still_diverges(const Case *c) {
+    Outcome ref, got;
+    const char *field;
+    return check_case(c, &ref, &got, &field) >= 0;
+}
+
+static void shrink(Case *c) {
+    bool progress = true;
+    while (progress) {
+        progress = false;
+
+        // Truncate to the shortest failing prefix, then a trailing halt
+        for (int len = 1; len < c->code_len; len++) {
+            Case t = *c;
+            t.code_len = len;
+            t.code[len - 1] = make_instr(OP_PRIV, 0, 0, 0, 0);
+            if (still_diverges(&t)) {
+                *c = t;
+                progress = true;
+                break;
+            }
+        }
+        // NOPs keep every other address, so branch targets are unchanged
+        for (int i = 0; i < c->code_len; i++) {
+            if (c->code[i] == NOP) continue;
+            Case t = *c;
+            t.code[i] = NOP;
+            if (still_diverges(&t)) {
+                *c = t;
+                progress = true;
+            }
+        }
+        while (c->data_len > 0) {
+            Case t = *c;
+            t.data_len--;
+            if (!still_diverges(&t)) break;
+            *c = t;
+            progress = true;
+        }
+        for (int i = 0; i < c->data_len; i++) {
+            if (c->data[i] == 0) continue;
+            Case t = *c;
+            t.data[i] = 0;
+            if (still_diverges(&t)) {
+                *c = t;
+                progress = true;
+            }
+        }
+        while (c->input_len > 0) {
+            Case t = *c;
+            t.input_len--;
+            if (!still_diverges(&t)) break;
+            *c = t;
+            progress = true;
+        }
+    }
+}
+
+static void print_outcome(const char *name, const Outcome *o) {
+    printf("  %-10s status %d, pc 0x%" PRIx64 ", memory hash %016" PRIx64 ", %zu output bytes\n",
+           name, o->status, o->pc, o->mem_hash, o->output_len);
+    for (int r = 0; r < 32; r++) {
+        if (o->registers[r]) printf("             r%-2d = 0x%" PRIx64 "\n", r, o->registers[r]);
+    }
+}
+
+static void report(const Case *c) {
+    Outcome ref, got;
+    const char *field;
+    int e = check_case(c, &ref, &got, &field);
+    if (e < 0) return;
+
+    printf("Divergence in %s (engine \"%s\")\n", field, engines[e].name);
+    printf("Program (%d words at 0x%x):\n", c->code_len, CODE_BEGIN);
+    for (int i = 0; i < c->code_len; i++) {
+        uint32_t w = c->code[i];
+        if (w == NOP) continue;
+        printf("  0x%05x: %08x  op 0x%02x rd r%u rs r%u rt r%u lit %u\n", CODE_BEGIN + 4 * i, w,
+               w >> 27, (w >> 22) & 0x1F, (w >> 17) & 0x1F, (w >> 12) & 0x1F, w & 0xFFF);
+    }
+    for (int i = 0; i < c->data_len; i++) printf("  data[%d] = 0x%" PRIx64 "\n", i, c->data[i]);
+    for (int i = 0; i < c->input_len; i++) printf("  input: %s\n", c->input[i]);
+    print_outcome("reference", &ref);
+    print_outcome(engines[e].name, &got);
+
+    write_v1(c, "fuzz_repro.tko");
+    write_input(c, "fuzz_repro.in");
+    printf("Reproducer: hw5-sim fuzz_repro.tko < fuzz_repro.in\n");
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-n cases] [-s seed] [-l max_instructions] [-a hw5-aot] [-x]\n", prog);
+    exit(1);
+}
+
+int main(int argc, char **argv) {
+    long cases = 1000;
+    uint64_t seed = 1;
+    int max_len = 48;
+
+    int c;
+    while ((c = getopt(argc, argv, "n:s:l:a:x")) != -1) {
+        switch (c) {
+            case 'n': cases = atol(optarg); break;
+            case 's': seed = strtoull(optarg, NULL, 0); break;
+            case 'l': max_len = atoi(optarg); break;
+            case 'a':
+                aot_path = optarg;
+                engines[engine_count++] = (Engine){ "aot", false, false, NULL, true };
+                break;
+            case 'x': engines[engine_count++] = (Engine){ "broken", false, false, broken_run }; break;
+            default: usage(argv[0]);
+        }
+    }
+    if (cases < 1 || max_len < 1 || max_len > MAX_CODE - 8) usage(argv[0]);
+    rng_state = seed ? seed : 1;
+
+    int status = 0;
+    long halted = 0, errors = 0, bounded = 0;
+    Case fc;
+    for (long i = 0; i < cases; i++) {
+        gen_case(&fc, max_len);
+        Outcome ref, got;
+        const char *field;
+        int e = check_case(&fc, &ref, &got, &field);
+        if (ref.status == 0) halted++;
+        else if (ref.status == 1) errors++;
+        else bounded++;
+        if (e < 0) continue;
+        printf("Case %ld (seed %" PRIu64 ") diverges; shrinking\n", i, seed);
+        shrink(&fc);
+        report(&fc);
+        status = 1;
+        break;
+    }
+    remove("fuzz_case.tko");
+    remove("fuzz_case_z.tko");
+    remove("fuzz_in.tmp");
+    if (aot_path) {
+        remove("fuzz_aot.c");
+        remove("fuzz_aot");
+    }
+    if (status == 0) {
+        printf("%ld cases (%ld halted, %ld error exits, %ld stopped at the step bound), %d engines, no divergence\n",
+               cases, halted, errors, bounded, engine_count);
+    }
+    return status;
+}
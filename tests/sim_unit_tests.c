@@ -387,6 +387,36 @@ void wrap_oob_data() {
     read_binary("oob_data.tko");
 }
 
+void wrap_overlap() {
+    struct tinker_file_header h;
+    memset(&h, 0, sizeof(h));
+    h.code_seg_begin = 0x2000;
+    h.code_seg_size = 16;
+    h.data_seg_begin = 0x2008;
+    h.data_seg_size = 8;
+    FILE *f = fopen("overlap.tko", "wb");
+    fwrite(&h, sizeof(h), 1, f);
+    uint8_t zeros[24] = { 0 };
+    fwrite(zeros, 1, sizeof(zeros), f);
+    fclose(f);
+    read_binary("overlap.tko");
+}
+
+void test_memory_size() {
+    EXPECT_DEATH(parse_mem_size("100"));
+    EXPECT_DEATH(parse_mem_size("4097"));
+    EXPECT_DEATH(parse_mem_size("lots"));
+
+    assert(parse_mem_size("64K") == 65536);
+    set_memory_size(parse_mem_size("2M"));
+    assert(mem_size == 2 * 1024 * 1024);
+    check8(mem_size - 8);
+    memory[mem_size - 1] = 7;
+
+    set_memory_size(MEM_SIZE);
+    assert(memory == default_memory);
+}
+
 void test_binary_loader() {
     EXPECT_DEATH(wrap_bad_ext());
     EXPECT_DEATH(wrap_no_args());
@@ -394,6 +424,7 @@ void test_binary_loader() {
     EXPECT_DEATH(wrap_bad_header());
     EXPECT_DEATH(wrap_oob_code());
     EXPECT_DEATH(wrap_oob_data());
+    EXPECT_DEATH(wrap_overlap());
     
     struct tinker_file_header h;
     memset(&h, 0, sizeof(h));
@@ -416,6 +447,7 @@ void test_binary_loader() {
     remove("bad_header.tko");
     remove("oob_code.tko");
     remove("oob_data.tko");
+    remove("overlap.tko");
 }
 
 int main() {
@@ -431,6 +463,7 @@ int main() {
     test_execution_deaths();
     test_fetch_and_run();
     test_binary_loader();
+    test_memory_size();
     
     printf("ALL TESTS PASSED\n");
     return 0;
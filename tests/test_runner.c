@@ -0,0 +1,1012 @@
+#define _XOPEN_SOURCE 700
+#define _DEFAULT_SOURCE   // MAP_ANONYMOUS for the simulator's guest memory
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <setjmp.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+// The assembler and simulator as libraries: their mains are renamed, and exit()
+// (error_exit included) unwinds back to the runner instead of ending the process
+void test_runner_exit(int status) __attribute__((noreturn));
+#define exit test_runner_exit
+
+#include "assemble.c"
+#define main hw5_asm_main
+#include "assembler.c"
+#undef main
+
+#define main hw5_sim_main
+#define error_exit sim_error_exit
+#include "simulator.c"
+#undef main
+#undef error_exit
+#undef exit
+
+// test_runner: run the cases of build/asm_tests.sh, build/sim_tests.sh and
+// build/prog_tests.sh on every core, calling hw5_asm_main/hw5_sim_main in-process.
+//
+// The scripts stay the source of truth. Their top-level statements are read
+// with a small shell-word parser: VAR=value assignments, `printf ... > file`
+// setup, and calls to test_valid, test_error, run_test, run_app_test,
+// run_status_test, run_profile_test, run_pipeline_test, run_stats_test and
+// run_blocked_test. Function bodies and other commands are skipped. Each case
+// is checked the way the script's function checks it, and a call to any other
+// function the script defines (or one with too few arguments) fails, so a
+// helper the runner does not know can never drop its cases unnoticed.
+//
+// Runs that fork stages of their own, take a signal or block on input go
+// through spawn_main, in a child process.
+//
+// Workers are forked once, each with its own scratch directory (the scripts'
+// fixed temp file names then never collide), and take every Nth case.
+
+#define MAX_CASES 1024
+#define MAX_SCRIPTS 8
+#define MAX_WORDS 16
+#define MAX_SETUP 32
+#define MAX_VARS 64
+#define MAX_FUNCS 16
+
+typedef enum { CASE_VALID, CASE_ERROR, CASE_SIM, CASE_APP, CASE_STATUS, CASE_PROFILE, CASE_PIPELINE, CASE_STATS, CASE_BLOCKED,
+               CASE_UNKNOWN } CaseKind;
+
+typedef struct {
+    int script;
+    CaseKind kind;
+    char *args[MAX_WORDS];    // expanded arguments after the function name
+    int argc;
+    char *why;                // why a CASE_UNKNOWN cannot run
+} TestCase;
+
+typedef struct {
+    char *path;
+    char *content;
+    size_t len;
+} SetupFile;
+
+typedef struct {
+    const char *path;
+    SetupFile setup[MAX_SETUP];
+    int setup_count;
+    char *var_name[MAX_VARS];
+    char *var_value[MAX_VARS];
+    int var_count;
+    char *funcs[MAX_FUNCS];   // the functions the script defines
+    int func_count;
+} Script;
+
+enum { RESULT_PASS, RESULT_FAIL, RESULT_SKIP };
+
+typedef struct {
+    int index;
+    int status;
+    double ms;
+    char detail[1024];
+} Result;
+
+static Script scripts[MAX_SCRIPTS];
+static int script_count = 0;
+static TestCase cases[MAX_CASES];
+static int case_count = 0;
+static char launch_dir[4096];
+
+// Growable byte buffer
+
+typedef struct {
+    char *data;
+    size_t len, cap;
+} Buf;
+
+static void buf_add(Buf *b, const char *s, size_t n) {
+    if (b->len + n + 1 > b->cap) {
+        b->cap = (b->len + n + 1) * 2;
+        b->data = realloc(b->data, b->cap);
+        if (!b->data) {
+            fprintf(stderr, "Error: Out of memory\n");
+            _exit(1);
+        }
+    }
+    memcpy(b->data + b->len, s, n);
+    b->len += n;
+    b->data[b->len] = '\0';
+}
+
+static void buf_char(Buf *b, char c) {
+    buf_add(b, &c, 1);
+}
+
+static char *buf_take(Buf *b) {
+    if (!b->data) buf_add(b, "", 0);
+    char *s = b->data;
+    b->data = NULL;
+    b->len = b->cap = 0;
+    return s;
+}
+
+// exit() from the assembler or simulator lands here
+
+static jmp_buf exit_jmp;
+static bool exit_armed = false;
+static int exit_code;
+
+void test_runner_exit(int status) {
+    fflush(stdout);
+    fflush(stderr);
+    if (!exit_armed) exit(status);
+    exit_code = status;
+    longjmp(exit_jmp, 1);
+}
+
+// Shell words
+
+static const char *lookup_var(const Script *s, const char *name, size_t n) {
+    for (int i = s->var_count - 1; i >= 0; i--) {
+        if (strlen(s->var_name[i]) == n && strncmp(s->var_name[i], name, n) == 0) return s->var_value[i];
+    }
+    return "";
+}
+
+// $NAME or ${NAME}; p points at the '$'. Anything else (like $((...))) stays literal.
+static const char *expand_var(const Script *s, const char *p, Buf *out) {
+    const char *start = p + 1;
+    bool braced = *start == '{';
+    if (braced) start++;
+    const char *end = start;
+    while (isalnum((unsigned char)*end) || *end == '_') end++;
+    if (end == start || (braced && *end != '}')) {
+        buf_char(out, '$');
+        return p + 1;
+    }
+    const char *v = lookup_var(s, start, end - start);
+    buf_add(out, v, strlen(v));
+    return braced ? end + 1 : end;
+}
+
+typedef struct {
+    char *words[MAX_WORDS];
+    bool op[MAX_WORDS];       // an unquoted redirection
+    int count;
+} Statement;
+
+// Read one statement starting at *pp; returns false at end of input
+static bool next_statement(const Script *s, const char **pp, Statement *st) {
+    const char *p = *pp;
+    st->count = 0;
+
+    // separators and comments between statements
+    for (;;) {
+        while (*p == ' ' || *p == '\t' || *p == '\n' || *p == ';') p++;
+        if (*p == '#') {
+            while (*p && *p != '\n') p++;
+            continue;
+        }
+        break;
+    }
+    if (!*p) {
+        *pp = p;
+        return false;
+    }
+
+    while (*p && *p != '\n' && *p != ';') {
+        if (*p == ' ' || *p == '\t') {
+            p++;
+            continue;
+        }
+        if (*p == '\\' && p[1] == '\n') {
+            p += 2;
+            continue;
+        }
+        if (*p == '#') {
+            while (*p && *p != '\n') p++;
+            break;
+        }
+
+        Buf w = { 0 };
+        bool is_op = false;
+        if (*p == '>' || *p == '<' || *p == '|' || *p == '&') {
+            while (*p == '>' || *p == '<' || *p == '|' || *p == '&') buf_char(&w, *p++);
+            is_op = true;
+        }
+        while (!is_op && *p && *p != ' ' && *p != '\t' && *p != '\n' && *p != ';' &&
+               *p != '>' && *p != '<' && *p != '|' && *p != '&') {
+            if (*p == '\\') {
+                if (p[1] == '\n') p += 2;
+                else if (p[1]) {
+                    buf_char(&w, p[1]);
+                    p += 2;
+                } else p++;
+            } else if (*p == '\'') {
+                p++;
+                while (*p && *p != '\'') buf_char(&w, *p++);
+                if (*p) p++;
+            } else if (*p == '"') {
+                p++;
+                while (*p && *p != '"') {
+                    if (*p == '\\' && (p[1] == '$' || p[1] == '`' || p[1] == '"' || p[1] == '\\')) {
+                        buf_char(&w, p[1]);
+                        p += 2;
+                    } else if (*p == '\\' && p[1] == '\n') {
+                        p += 2;
+                    } else if (*p == '$') {
+                        p = expand_var(s, p, &w);
+                    } else {
+                        buf_char(&w, *p++);
+                    }
+                }
+                if (*p) p++;
+            } else if (*p == '$') {
+                p = expand_var(s, p, &w);
+            } else {
+                buf_char(&w, *p++);
+            }
+        }
+        if (st->count < MAX_WORDS) {
+            st->op[st->count] = is_op;
+            st->words[st->count++] = buf_take(&w);
+        } else {
+            free(w.data);
+        }
+    }
+    *pp = p;
+    return true;
+}
+
+static void free_statement(Statement *st) {
+    for (int i = 0; i < st->count; i++) free(st->words[i]);
+    st->count = 0;
+}
+
+// One backslash escape as printf (and its %b) understand it; p points after the backslash
+static const char *printf_escape(const char *p, Buf *out, bool in_b) {
+    switch (*p) {
+        case 'n': buf_char(out, '\n'); return p + 1;
+        case 't': buf_char(out, '\t'); return p + 1;
+        case 'r': buf_char(out, '\r'); return p + 1;
+        case 'a': buf_char(out, '\a'); return p + 1;
+        case 'b': buf_char(out, '\b'); return p + 1;
+        case 'f': buf_char(out, '\f'); return p + 1;
+        case 'v': buf_char(out, '\v'); return p + 1;
+        case '\\': buf_char(out, '\\'); return p + 1;
+        case '"': buf_char(out, '"'); return p + 1;
+        case 'x': {
+            int v = 0, n = 0;
+            p++;
+            while (n < 2 && isxdigit((unsigned char)*p)) {
+                v = v * 16 + (isdigit((unsigned char)*p) ? *p - '0' : tolower((unsigned char)*p) - 'a' + 10);
+                p++;
+                n++;
+            }
+            if (n == 0) buf_add(out, "\\x", 2);
+            else buf_char(out, (char)v);
+            return p;
+        }
+        default:
+            if (*p >= '0' && *p <= '7') {
+                // \NNN in a format, \0NNN in %b
+                if (in_b && *p == '0') p++;
+                int v = 0, n = 0;
+                while (n < 3 && *p >= '0' && *p <= '7') {
+                    v = v * 8 + (*p++ - '0');
+                    n++;
+                }
+                buf_char(out, (char)v);
+                return p;
+            }
+            buf_char(out, '\\');
+            return p;
+    }
+}
+
+static void printf_b(const char *arg, Buf *out) {
+    while (*arg) {
+        if (*arg == '\\' && arg[1]) arg = printf_escape(arg + 1, out, true);
+        else buf_char(out, *arg++);
+    }
+}
+
+// The shell printf builtin, for %b, %s, %% and escapes; the format repeats while arguments remain
+static void shell_printf(const char *fmt, char **args, int nargs, Buf *out) {
+    int next = 0;
+    do {
+        int before = next;
+        for (const char *p = fmt; *p; ) {
+            if (*p == '\\' && p[1]) {
+                p = printf_escape(p + 1, out, false);
+            } else if (*p == '%' && p[1] == '%') {
+                buf_char(out, '%');
+                p += 2;
+            } else if (*p == '%' && (p[1] == 'b' || p[1] == 's')) {
+                const char *arg = next < nargs ? args[next++] : "";
+                if (p[1] == 'b') printf_b(arg, out);
+                else buf_add(out, arg, strlen(arg));
+                p += 2;
+            } else {
+                buf_char(out, *p++);
+            }
+        }
+        if (next == before) break;
+    } while (next < nargs);
+}
+
+// Scripts
+
+static char *read_file(const char *path, size_t *len) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return NULL;
+    Buf b = { 0 };
+    char chunk[4096];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0) buf_add(&b, chunk, n);
+    fclose(f);
+    if (len) *len = b.len;
+    return buf_take(&b);
+}
+
+static bool is_assignment(const char *w) {
+    if (!isalpha((unsigned char)*w) && *w != '_') return false;
+    while (isalnum((unsigned char)*w) || *w == '_') w++;
+    return *w == '=';
+}
+
+static void load_script(const char *path) {
+    if (script_count == MAX_SCRIPTS) return;
+    char *text = read_file(path, NULL);
+    if (!text) {
+        fprintf(stderr, "Error: Cannot open %s\n", path);
+        _exit(1);
+    }
+    int si = script_count++;
+    Script *s = &scripts[si];
+    s->path = path;
+
+    const char *p = text;
+    Statement st;
+    while (next_statement(s, &p, &st)) {
+        if (st.count == 0) continue;
+        const char *cmd = st.words[0];
+        size_t cmd_len = strlen(cmd);
+
+        if (cmd_len > 2 && strcmp(cmd + cmd_len - 2, "()") == 0) {
+            // function definition: skip to the closing brace in column 0
+            if (s->func_count < MAX_FUNCS) s->funcs[s->func_count++] = strndup(cmd, cmd_len - 2);
+            const char *end = strstr(p, "\n}");
+            p = end ? end + 2 : p + strlen(p);
+        } else if (is_assignment(cmd) && st.count == 1 && s->var_count < MAX_VARS) {
+            const char *eq = strchr(cmd, '=');
+            s->var_name[s->var_count] = strndup(cmd, eq - cmd);
+            s->var_value[s->var_count++] = strdup(eq + 1);
+        } else if (strcmp(cmd, "printf") == 0 && st.count >= 4 && st.op[st.count - 2] &&
+                   strcmp(st.words[st.count - 2], ">") == 0 && s->setup_count < MAX_SETUP) {
+            Buf out = { 0 };
+            shell_printf(st.words[1], st.words + 2, st.count - 4, &out);
+            SetupFile *f = &s->setup[s->setup_count++];
+            f->path = strdup(st.words[st.count - 1]);
+            f->len = out.len;
+            f->content = buf_take(&out);
+        } else if (case_count < MAX_CASES) {
+            static const struct { const char *name; CaseKind kind; int min_args; } kinds[] = {
+                { "test_valid", CASE_VALID, 3 }, { "test_error", CASE_ERROR, 3 },
+                { "run_test", CASE_SIM, 3 }, { "run_app_test", CASE_APP, 4 },
+                { "run_status_test", CASE_STATUS, 5 }, { "run_profile_test", CASE_PROFILE, 4 },
+                { "run_pipeline_test", CASE_PIPELINE, 6 }, { "run_stats_test", CASE_STATS, 2 },
+                { "run_blocked_test", CASE_BLOCKED, 2 },
+            };
+            CaseKind kind = CASE_UNKNOWN;
+            const char *why = "test_runner has no case kind for";
+            bool is_case = false;
+            for (int k = 0; k < (int)(sizeof(kinds) / sizeof(kinds[0])); k++) {
+                if (strcmp(cmd, kinds[k].name) != 0) continue;
+                is_case = true;
+                if (st.count - 1 >= kinds[k].min_args) kind = kinds[k].kind;
+                else why = "too few arguments to";
+            }
+            for (int f = 0; f < s->func_count && !is_case; f++) is_case = strcmp(cmd, s->funcs[f]) == 0;
+            if (is_case) {
+                TestCase *c = &cases[case_count++];
+                c->script = si;
+                c->kind = kind;
+                c->argc = st.count - 1;
+                for (int a = 1; a < st.count; a++) c->args[a - 1] = strdup(st.words[a]);
+                if (kind == CASE_UNKNOWN) {
+                    char detail[256];
+                    snprintf(detail, sizeof(detail), "(%s %s)", why, cmd);
+                    c->why = strdup(detail);
+                }
+            }
+        }
+        free_statement(&st);
+    }
+    free(text);
+}
+
+// Running one case
+
+static const char *arg(const TestCase *c, int i) {
+    return i < c->argc ? c->args[i] : "";
+}
+
+static void write_file(const char *path, const char *data, size_t len) {
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        fprintf(stderr, "Error: Cannot write %s\n", path);
+        _exit(1);
+    }
+    fwrite(data, 1, len, f);
+    fclose(f);
+}
+
+static bool file_exists(const char *path) {
+    struct stat st;
+    return stat(path, &st) == 0;
+}
+
+// Call one of the mains with stdin from in_path and stdout+stderr to out_path
+// (either may be NULL for /dev/null); returns its exit status
+static int call_main(int (*entry)(int, char **), char **argv, int argc, const char *in_path, const char *out_path) {
+    fflush(stdout);
+    fflush(stderr);
+    int saved_out = dup(STDOUT_FILENO), saved_err = dup(STDERR_FILENO);
+    int fd = open(out_path ? out_path : "/dev/null", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    dup2(fd, STDOUT_FILENO);
+    dup2(fd, STDERR_FILENO);
+    close(fd);
+    if (!freopen(in_path ? in_path : "/dev/null", "r", stdin)) _exit(1);
+
+    int status;
+    exit_armed = true;
+    if (setjmp(exit_jmp) == 0) status = entry(argc, argv);
+    else status = exit_code;
+    exit_armed = false;
+
+    fflush(stdout);
+    fflush(stderr);
+    dup2(saved_out, STDOUT_FILENO);
+    dup2(saved_err, STDERR_FILENO);
+    close(saved_out);
+    close(saved_err);
+    return status;
+}
+
+// call_main in a child process, where exit() ends the child, for runs that fork
+// or must be waited on; stderr goes to err_path (NULL for /dev/null), which may
+// be out_path. Returns the child's pid.
+static pid_t spawn_main(int (*entry)(int, char **), char **argv, int argc, const char *in_path,
+                        const char *out_path, const char *err_path) {
+    fflush(stdout);
+    fflush(stderr);
+    pid_t pid = fork();
+    if (pid != 0) return pid;
+
+    int out = open(out_path ? out_path : "/dev/null", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    int err = (err_path && out_path && strcmp(err_path, out_path) == 0) ? dup(out) :
+              open(err_path ? err_path : "/dev/null", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    dup2(out, STDOUT_FILENO);
+    dup2(err, STDERR_FILENO);
+    close(out);
+    close(err);
+    if (!freopen(in_path ? in_path : "/dev/null", "r", stdin)) _exit(1);
+    exit(entry(argc, argv));
+}
+
+// A spawned child's exit status, as the shell reports it
+static int wait_status(pid_t pid) {
+    int wstatus;
+    if (pid < 0 || waitpid(pid, &wstatus, 0) < 0) return -1;
+    return WIFEXITED(wstatus) ? WEXITSTATUS(wstatus) : 128 + WTERMSIG(wstatus);
+}
+
+// argv for a main: prog, the whitespace-split flags, then the rest
+static int build_argv(char **argv, char *flags_copy, const char *prog, const char *a, const char *b) {
+    int n = 0;
+    argv[n++] = (char *)prog;
+    for (char *t = strtok(flags_copy, " \t\n"); t && n < MAX_WORDS - 3; t = strtok(NULL, " \t\n")) argv[n++] = t;
+    if (a) argv[n++] = (char *)a;
+    if (b) argv[n++] = (char *)b;
+    argv[n] = NULL;
+    return n;
+}
+
+static int run_assembler(const char *flags, const char *input, const char *output, const char *out_path) {
+    char *copy = strdup(flags);
+    char *argv[MAX_WORDS];
+    int argc = build_argv(argv, copy, "hw5-asm", input, output);
+    int status = call_main(hw5_asm_main, argv, argc, NULL, out_path);
+    free(copy);
+    return status;
+}
+
+static int simulate(const char *flags, const char *tko, const char *in_path, const char *out_path) {
+    char *copy = strdup(flags);
+    char *argv[MAX_WORDS];
+    int argc = build_argv(argv, copy, "hw5-sim", tko, NULL);
+    int status = call_main(hw5_sim_main, argv, argc, in_path, out_path);
+    free(copy);
+    return status;
+}
+
+// Trimmed lines joined with ';' (the scripts' sed + paste), optionally without .code/.data lines
+static char *join_lines(const char *text, bool drop_sections) {
+    Buf out = { 0 };
+    bool first = true;
+    const char *p = text;
+    while (*p) {
+        const char *end = strchr(p, '\n');
+        if (!end) end = p + strlen(p);
+        bool section = drop_sections && (strncmp(p, ".code", 5) == 0 || strncmp(p, ".data", 5) == 0);
+        if (!section) {
+            const char *a = p, *b = end;
+            while (a < b && isspace((unsigned char)*a)) a++;
+            while (b > a && isspace((unsigned char)b[-1])) b--;
+            if (!first) buf_char(&out, ';');
+            buf_add(&out, a, b - a);
+            first = false;
+        }
+        p = *end ? end + 1 : end;
+    }
+    return buf_take(&out);
+}
+
+// Words joined by single spaces (the scripts' xargs)
+static char *squeeze(const char *text) {
+    Buf out = { 0 };
+    const char *p = text;
+    while (*p) {
+        while (isspace((unsigned char)*p)) p++;
+        if (!*p) break;
+        if (out.len) buf_char(&out, ' ');
+        while (*p && !isspace((unsigned char)*p)) buf_char(&out, *p++);
+    }
+    return buf_take(&out);
+}
+
+static char *read_text(const char *path) {
+    char *t = read_file(path, NULL);
+    return t ? t : strdup("");
+}
+
+static void write_printf_b(const char *path, const char *text) {
+    Buf b = { 0 };
+    printf_b(text, &b);
+    buf_char(&b, '\n');
+    write_file(path, b.data, b.len);
+    free(b.data);
+}
+
+static void case_valid(const TestCase *c, Result *r) {
+    write_printf_b("comprehensive.tk", arg(c, 1));
+    remove("intermediate.tk");
+    run_assembler(arg(c, 3), "comprehensive.tk", "comprehensive.tko", NULL);
+    if (!file_exists("intermediate.tk")) {
+        r->status = RESULT_FAIL;
+        snprintf(r->detail, sizeof(r->detail), "(intermediate.tk not generated)");
+        return;
+    }
+    char *inter = read_text("intermediate.tk");
+    char *actual = join_lines(inter, true);
+    char *expected = join_lines(arg(c, 2), false);
+    if (strcmp(actual, expected) != 0) {
+        r->status = RESULT_FAIL;
+        snprintf(r->detail, sizeof(r->detail), "\n   Expected: %s\n   Got     : %s", expected, actual);
+    }
+    free(inter);
+    free(actual);
+    free(expected);
+    remove("comprehensive.tko");
+    remove("intermediate.tk");
+}
+
+static void case_error(const TestCase *c, Result *r) {
+    write_printf_b("comprehensive.tk", arg(c, 1));
+    run_assembler(arg(c, 3), "comprehensive.tk", "comprehensive.tko", "case.out");
+    char *output = read_text("case.out");
+    if (!strstr(output, arg(c, 2))) {
+        r->status = RESULT_FAIL;
+        snprintf(r->detail, sizeof(r->detail), "\n   Expected Error: %s\n   Got Output    : %s", arg(c, 2), output);
+    }
+    free(output);
+}
+
+static void run_program(const char *tko, const char *input, bool always_echo, const char *sim_flags, char **output) {
+    const char *in_path = NULL;
+    if (*input || always_echo) {
+        Buf b = { 0 };
+        buf_add(&b, input, strlen(input));
+        buf_char(&b, '\n');
+        write_file("case.in", b.data, b.len);
+        free(b.data);
+        in_path = "case.in";
+    }
+    simulate(sim_flags, tko, in_path, "case.out");
+    char *raw = read_text("case.out");
+    *output = squeeze(raw);
+    free(raw);
+}
+
+static void case_sim(const TestCase *c, Result *r) {
+    char fmt[8192];
+    snprintf(fmt, sizeof(fmt), ".code\n\tld r29, 1\n\tld r28, 3\n%s\n\thalt\n", arg(c, 1));
+    Buf prog = { 0 };
+    shell_printf(fmt, NULL, 0, &prog);
+    write_file("tester_tmp.tk", prog.data, prog.len);
+    free(prog.data);
+
+    remove("tester_tmp.tko");
+    run_assembler("", "tester_tmp.tk", "tester_tmp.tko", NULL);
+    if (!file_exists("tester_tmp.tko")) {
+        r->status = RESULT_FAIL;
+        snprintf(r->detail, sizeof(r->detail), "(Assembler failed to create .tko file)");
+        return;
+    }
+    char *output;
+    run_program("tester_tmp.tko", arg(c, 3), false, "", &output);
+    if (strcmp(output, arg(c, 2)) != 0) {
+        r->status = RESULT_FAIL;
+        snprintf(r->detail, sizeof(r->detail), "(Expected '%s', got '%s')", arg(c, 2), output);
+    }
+    free(output);
+    remove("tester_tmp.tko");
+}
+
+// A source path as the worker sees it: its own setup directory first, then the launch directory
+static void resolve_source(const char *path, char *out, size_t size) {
+    snprintf(out, size, "%s", path);
+    if (!file_exists(out) && path[0] != '/') snprintf(out, size, "%s/%s", launch_dir, path);
+}
+
+static void case_app(const TestCase *c, Result *r) {
+    char source[8192];
+    resolve_source(arg(c, 1), source, sizeof(source));
+    if (!file_exists(source)) {
+        r->status = RESULT_SKIP;
+        snprintf(r->detail, sizeof(r->detail), "(%s not found)", arg(c, 1));
+        return;
+    }
+
+    remove("app_test.tko");
+    run_assembler(arg(c, 4), source, "app_test.tko", NULL);
+    if (!file_exists("app_test.tko")) {
+        r->status = RESULT_FAIL;
+        snprintf(r->detail, sizeof(r->detail), "(Assembler failed)");
+        return;
+    }
+    char *output;
+    run_program("app_test.tko", arg(c, 2), true, arg(c, 5), &output);
+    char *expected = squeeze(arg(c, 3));
+    if (strcmp(output, expected) != 0) {
+        r->status = RESULT_FAIL;
+        snprintf(r->detail, sizeof(r->detail), "\n   Expected : %s\n   Got      : %s", expected, output);
+    }
+    free(output);
+    free(expected);
+    remove("app_test.tko");
+}
+
+static void case_status(const TestCase *c, Result *r) {
+    char source[8192];
+    resolve_source(arg(c, 1), source, sizeof(source));
+    run_assembler("", source, "app_test.tko", NULL);
+    int status = simulate(arg(c, 2), "app_test.tko", NULL, "case.out");
+    char *output = read_text("case.out");
+    if (status != atoi(arg(c, 3)) || !strstr(output, arg(c, 4))) {
+        r->status = RESULT_FAIL;
+        snprintf(r->detail, sizeof(r->detail), "\n   Expected : status %s, %s\n   Got      : status %d, %s",
+                 arg(c, 3), arg(c, 4), status, output);
+    }
+    free(output);
+    remove("app_test.tko");
+}
+
+// Profile a run with -p, then check the build laid out with -P from it as case_app does
+static void case_profile(const TestCase *c, Result *r) {
+    char source[8192];
+    resolve_source(arg(c, 1), source, sizeof(source));
+    remove("profile_tmp.txt");
+    run_assembler(arg(c, 4), source, "app_test.tko", NULL);
+    char *output;
+    run_program("app_test.tko", arg(c, 2), true, "-p profile_tmp.txt", &output);
+    free(output);
+    remove("app_test.tko");
+    if (!file_exists("profile_tmp.txt")) {
+        r->status = RESULT_FAIL;
+        snprintf(r->detail, sizeof(r->detail), "(no profile written)");
+        return;
+    }
+
+    char flags[8192];
+    snprintf(flags, sizeof(flags), "%s -P profile_tmp.txt", arg(c, 4));
+    TestCase app = *c;
+    app.args[4] = flags;
+    app.argc = 5;
+    case_app(&app, r);
+    remove("profile_tmp.txt");
+}
+
+// Each source assembled as a stage, run as one --pipeline on stdin; only stdout is compared
+static void case_pipeline(const TestCase *c, Result *r) {
+    char flags[8192];
+    int len = snprintf(flags, sizeof(flags), "-q 16 --pipeline %s", arg(c, 1));
+    for (int i = 5; i < c->argc; i++) {
+        char source[4096], stage[64];
+        resolve_source(arg(c, i), source, sizeof(source));
+        snprintf(stage, sizeof(stage), "stage%d_tmp.tko", i - 5);
+        run_assembler("", source, stage, NULL);
+        len += snprintf(flags + len, sizeof(flags) - len, " %s", stage);
+    }
+
+    Buf in = { 0 };
+    buf_add(&in, arg(c, 2), strlen(arg(c, 2)));
+    buf_char(&in, '\n');
+    write_file("case.in", in.data, in.len);
+    free(in.data);
+    char *copy = strdup(flags);
+    char *argv[MAX_WORDS];
+    int argc = build_argv(argv, copy, "hw5-sim", NULL, NULL);
+    int status = wait_status(spawn_main(hw5_sim_main, argv, argc, "case.in", "case.out", NULL));
+    free(copy);
+
+    char *raw = read_text("case.out");
+    char *output = squeeze(raw);
+    char *expected = squeeze(arg(c, 3));
+    if (status != atoi(arg(c, 4)) || strcmp(output, expected) != 0) {
+        r->status = RESULT_FAIL;
+        snprintf(r->detail, sizeof(r->detail), "\n   Expected : status %s, %s\n   Got      : status %d, %s",
+                 arg(c, 4), expected, status, output);
+    }
+    free(raw);
+    free(output);
+    free(expected);
+    for (int i = 5; i < c->argc; i++) {
+        char stage[64];
+        snprintf(stage, sizeof(stage), "stage%d_tmp.tko", i - 5);
+        remove(stage);
+    }
+}
+
+// A looping guest asked for its counters with SIGUSR1 until -t stops it: they
+// must reach stderr, and -S must leave a stats file
+static void case_stats(const TestCase *c, Result *r) {
+    char source[8192];
+    resolve_source(arg(c, 1), source, sizeof(source));
+    run_assembler("", source, "app_test.tko", NULL);
+    remove("stats_tmp.bin");
+
+    char flags[] = "-t 1 -s 0 -S stats_tmp.bin";
+    char *argv[MAX_WORDS];
+    int argc = build_argv(argv, flags, "hw5-sim", "app_test.tko", NULL);
+    pid_t pid = spawn_main(hw5_sim_main, argv, argc, NULL, NULL, "stats_tmp.txt");
+    struct timespec nap = { 0, 300000000 };
+    nanosleep(&nap, NULL);
+    if (pid > 0) kill(pid, SIGUSR1);
+    int status = wait_status(pid);
+
+    char *text = read_text("stats_tmp.txt");
+    char *map = read_text("stats_tmp.bin");
+    bool counted = false;
+    for (const char *p = strstr(text, "branch: "); p && !counted; p = strstr(p + 1, "branch: ")) {
+        counted = (p == text || p[-1] == '\n') && p[8] >= '1' && p[8] <= '9';
+    }
+    if (status != 124 || !counted || strncmp(map, "TKTSTATS", 8) != 0) {
+        r->status = RESULT_FAIL;
+        char *got = squeeze(text);
+        snprintf(r->detail, sizeof(r->detail), "\n   Got      : status %d, %s", status, got);
+        free(got);
+    }
+    free(text);
+    free(map);
+    remove("app_test.tko");
+    remove("stats_tmp.bin");
+    remove("stats_tmp.txt");
+}
+
+// -t must stop a guest blocked on input: stdin is a FIFO that gets its word
+// only after a second, where the script pipes from (sleep 1; echo 5)
+static void case_blocked(const TestCase *c, Result *r) {
+    char source[8192];
+    resolve_source(arg(c, 1), source, sizeof(source));
+    run_assembler("", source, "app_test.tko", NULL);
+    remove("blocked_tmp.fifo");
+    if (mkfifo("blocked_tmp.fifo", 0600) != 0) {
+        r->status = RESULT_FAIL;
+        snprintf(r->detail, sizeof(r->detail), "(cannot create a FIFO)");
+        return;
+    }
+
+    char flags[4096];
+    snprintf(flags, sizeof(flags), "-t 0.1 %s", arg(c, 2));
+    char *argv[MAX_WORDS];
+    int argc = build_argv(argv, flags, "hw5-sim", "app_test.tko", NULL);
+    pid_t pid = spawn_main(hw5_sim_main, argv, argc, "blocked_tmp.fifo", "case.out", "case.out");
+    int fd = pid > 0 ? open("blocked_tmp.fifo", O_WRONLY) : -1;
+    if (fd >= 0) {
+        struct timespec nap = { 1, 0 };
+        nanosleep(&nap, NULL);
+        void (*old)(int) = signal(SIGPIPE, SIG_IGN);   // the guest is gone by now
+        if (write(fd, "5\n", 2) < 0) {}
+        signal(SIGPIPE, old);
+        close(fd);
+    }
+    int status = wait_status(pid);
+
+    char *output = read_text("case.out");
+    if (status != 124 || strncmp(output, "Time limit exceeded", 19) != 0) {
+        r->status = RESULT_FAIL;
+        snprintf(r->detail, sizeof(r->detail), "\n   Expected : status 124, Time limit exceeded\n   Got      : status %d, %s",
+                 status, output);
+    }
+    free(output);
+    remove("app_test.tko");
+    remove("blocked_tmp.fifo");
+}
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+// Workers
+
+static void setup_dirs(const char *root, int worker) {
+    for (int s = 0; s < script_count; s++) {
+        char dir[4096];
+        snprintf(dir, sizeof(dir), "%s/w%d_%d", root, worker, s);
+        if (mkdir(dir, 0755) != 0 || chdir(dir) != 0) {
+            fprintf(stderr, "Error: Cannot create %s\n", dir);
+            _exit(1);
+        }
+        for (int i = 0; i < scripts[s].setup_count; i++) {
+            write_file(scripts[s].setup[i].path, scripts[s].setup[i].content, scripts[s].setup[i].len);
+        }
+    }
+}
+
+static void worker(const char *root, int id, int workers, int fd) {
+    setup_dirs(root, id);
+    for (int i = id; i < case_count; i += workers) {
+        const TestCase *c = &cases[i];
+        char dir[4096];
+        snprintf(dir, sizeof(dir), "%s/w%d_%d", root, id, c->script);
+        if (chdir(dir) != 0) _exit(1);
+
+        Result r;
+        memset(&r, 0, sizeof(r));
+        r.index = i;
+        double t0 = now_ms();
+        switch (c->kind) {
+            case CASE_VALID: case_valid(c, &r); break;
+            case CASE_ERROR: case_error(c, &r); break;
+            case CASE_SIM: case_sim(c, &r); break;
+            case CASE_APP: case_app(c, &r); break;
+            case CASE_STATUS: case_status(c, &r); break;
+            case CASE_PROFILE: case_profile(c, &r); break;
+            case CASE_PIPELINE: case_pipeline(c, &r); break;
+            case CASE_STATS: case_stats(c, &r); break;
+            case CASE_BLOCKED: case_blocked(c, &r); break;
+            case CASE_UNKNOWN:
+                r.status = RESULT_FAIL;
+                snprintf(r.detail, sizeof(r.detail), "%s", c->why);
+                break;
+        }
+        r.ms = now_ms() - t0;
+        if (write(fd, &r, sizeof(r)) != (ssize_t)sizeof(r)) _exit(1);
+    }
+    _exit(0);
+}
+
+static int remove_entry(const char *path, const struct stat *sb, int flag, struct FTW *ftw) {
+    (void)sb;
+    (void)flag;
+    (void)ftw;
+    return remove(path);
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-j workers] [-q] [script.sh...]\n", prog);
+    _exit(1);
+}
+
+int main(int argc, char **argv) {
+    int workers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    bool quiet = false;
+
+    int c;
+    while ((c = getopt(argc, argv, "j:q")) != -1) {
+        switch (c) {
+            case 'j': workers = atoi(optarg); break;
+            case 'q': quiet = true; break;
+            default: usage(argv[0]);
+        }
+    }
+    if (workers < 1) workers = 1;
+    if (!getcwd(launch_dir, sizeof(launch_dir))) usage(argv[0]);
+
+    if (optind < argc) {
+        for (int i = optind; i < argc; i++) load_script(argv[i]);
+    } else {
+        // From the repo root, or from a directory the scripts were copied into
+        const char *dir = file_exists("build/asm_tests.sh") ? "build/" : "";
+        static const char *names[] = { "asm_tests.sh", "sim_tests.sh", "prog_tests.sh" };
+        static char paths[3][64];
+        for (int i = 0; i < 3; i++) {
+            snprintf(paths[i], sizeof(paths[i]), "%s%s", dir, names[i]);
+            load_script(paths[i]);
+        }
+    }
+    if (case_count == 0) usage(argv[0]);
+    if (workers > case_count) workers = case_count;
+
+    char root[] = "/tmp/tinker_tests.XXXXXX";
+    if (!mkdtemp(root)) {
+        fprintf(stderr, "Error: Cannot create a scratch directory\n");
+        return 1;
+    }
+
+    int fds[2];
+    if (pipe(fds) != 0) return 1;
+    double t0 = now_ms();
+    fflush(stdout);
+    for (int w = 0; w < workers; w++) {
+        pid_t pid = fork();
+        if (pid < 0) return 1;
+        if (pid == 0) {
+            close(fds[0]);
+            worker(root, w, workers, fds[1]);
+        }
+    }
+    close(fds[1]);
+
+    static Result results[MAX_CASES];
+    static bool seen[MAX_CASES];
+    Result r;
+    while (read(fds[0], &r, sizeof(r)) == (ssize_t)sizeof(r)) {
+        if (r.index >= 0 && r.index < case_count) {
+            results[r.index] = r;
+            seen[r.index] = true;
+        }
+    }
+    while (wait(NULL) > 0) {}
+    double wall = now_ms() - t0;
+    nftw(root, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+
+    int pass = 0, fail = 0, skip = 0, slowest = 0;
+    for (int s = 0; s < script_count; s++) {
+        printf("== %s\n", scripts[s].path);
+        for (int i = 0; i < case_count; i++) {
+            if (cases[i].script != s) continue;
+            const char *name = arg(&cases[i], 0);
+            if (!seen[i]) {
+                fail++;
+                printf("FAIL: %s (worker died)\n", name);
+                continue;
+            }
+            const Result *x = &results[i];
+            if (x->ms > results[slowest].ms) slowest = i;
+            if (x->status == RESULT_PASS) {
+                pass++;
+                if (!quiet) printf("PASS: %-32s %8.2f ms\n", name, x->ms);
+            } else if (x->status == RESULT_SKIP) {
+                skip++;
+                printf("SKIP: %s %s\n", name, x->detail);
+            } else {
+                fail++;
+                printf("FAIL: %-32s %8.2f ms %s\n", name, x->ms, x->detail);
+            }
+        }
+    }
+    printf("----\n");
+    printf("Tests Completed: %d\n", pass + fail);
+    printf("Passed: %d\n", pass);
+    printf("Failed: %d\n", fail);
+    if (skip) printf("Skipped: %d\n", skip);
+    printf("Wall time: %.1f ms on %d workers (slowest case: %s, %.2f ms)\n",
+           wall, workers, arg(&cases[slowest], 0), results[slowest].ms);
+    return fail > 0;
+}